@@ -0,0 +1,78 @@
+
+#pragma once
+
+#include "QS3API.h"
+#include "QS3Fwd.h"
+
+#include <QObject>
+#include <QByteArray>
+#include <QVector>
+#include <QList>
+
+/// QS3BufferPool
+
+/** Size classed pool of byte buffers for response bodies.
+
+    Buffers are allocated in power of two size classes from 4 KB to 8 MB
+    and returned buffers are kept for reuse up to maxPooledBytes, so a long
+    running client downloading many similarly sized objects does not
+    allocate and free a new body for each of them. Larger buffers are
+    allocated and freed as usual.
+
+    QS3Client reads get bodies into pooled buffers. Bodies of
+    QS3GetObjectResponse are returned when the response is destroyed and
+    QS3Result bodies after the handler returns, if nothing else holds a
+    reference to them. Handlers that keep the data can release it later
+    with QS3Client::bufferPool()->release(). */
+class QTS3SHARED_EXPORT QS3BufferPool : public QObject
+{
+Q_OBJECT
+
+public:
+    explicit QS3BufferPool(qint64 maxPooledBytes, QObject *parent = 0);
+    ~QS3BufferPool();
+
+    struct Statistics
+    {
+        Statistics();
+
+        /// Buffers acquired from the pool and allocated because the pool had none.
+        quint64 hits;
+        quint64 misses;
+
+        /// Buffers returned to the pool and released buffers that were freed instead.
+        quint64 returned;
+        quint64 discarded;
+
+        /// Bytes currently held by the pool.
+        qint64 pooledBytes;
+    };
+
+    /// Returns a buffer of size bytes. The capacity is rounded up to the size class.
+    QByteArray acquire(int size);
+
+    /// Returns a buffer to the pool and clears it.
+    /** A buffer shared with other QByteArrays is only dereferenced, the last holder
+        returns it. Buffers outside the size classes or over the pool limit are freed. */
+    void release(QByteArray &buffer);
+
+    /// Sets the maximum bytes kept in the pool, 0 disables pooling. Excess buffers are freed.
+    void setMaxPooledBytes(qint64 maxPooledBytes);
+    qint64 maxPooledBytes() const;
+
+    Statistics statistics() const;
+
+    /// Frees all pooled buffers.
+    void clear();
+
+private:
+    /// Returns the size class index for size, -1 if it is too large to pool.
+    static int sizeClass(int size);
+    static int classCapacity(int sizeClass);
+
+    void trim();
+
+    QVector<QList<QByteArray> > free_;
+    qint64 maxPooledBytes_;
+    Statistics stats_;
+};
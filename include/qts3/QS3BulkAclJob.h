@@ -0,0 +1,127 @@
+
+#pragma once
+
+#include "QS3API.h"
+#include "QS3Fwd.h"
+#include "QS3Defines.h"
+
+#include <QObject>
+#include <QString>
+#include <QQueue>
+#include <QHash>
+#include <QPointer>
+#include <QElapsedTimer>
+
+/// QS3BulkAclJob
+
+/** Applies a canned ACL to every object under a prefix.
+
+    The prefix is listed one page at a time into a bounded queue, the page
+    size follows the processing rate. The queue is processed with a limited
+    number of concurrent setCannedAcl requests. Optionally a sample of the
+    keys have their current ACL checked with getAcl first and are skipped
+    if it already matches.
+
+    Create with QS3Client::setCannedAclForPrefix. Options must be set
+    before control returns to the event loop, the job starts there. */
+class QTS3SHARED_EXPORT QS3BulkAclJob : public QObject, public QS3ResultHandler
+{
+Q_OBJECT
+
+friend class QS3Client;
+
+public:
+    ~QS3BulkAclJob();
+
+    /// Sets the maximum number of concurrent ACL requests. Default 16.
+    void setMaxConcurrent(int maxConcurrent);
+
+    /// Sets the maximum number of listed keys waiting to be processed. Default 5000.
+    void setMaxQueued(int maxQueued);
+
+    /// Sets the ratio of keys, from 0.0 to 1.0, whose current ACL is checked with getAcl before setting it. Default 0.0.
+    /** Checking costs one extra request per sampled key but skips keys that already have the ACL. */
+    void setVerifySampleRate(qreal rate);
+
+    /// Prefix the job applies to.
+    QString prefix() const;
+
+    /// Canned ACL the job applies.
+    QS3::CannedAcl cannedAcl() const;
+
+    /// Number of keys received from the listing so far.
+    int listed() const;
+
+    /// Number of keys whose ACL was set.
+    int updated() const;
+
+    /// Number of keys skipped because their ACL already matched.
+    int skipped() const;
+
+    /// Number of keys processed, updated, skipped or failed.
+    int processed() const;
+
+    /// Failed keys and their errors. Listing failure is reported with the prefix as key.
+    QHash<QString, QS3Error> failures() const;
+
+    /// Returns true when the job has finished.
+    bool isFinished() const;
+
+public slots:
+    /// Stops the job. Ongoing requests are canceled and finished is emitted.
+    void cancel();
+
+signals:
+    /// Emitted after each processed key.
+    void progress(QS3BulkAclJob *job, int processed, int listed);
+
+    /// Emitted once when all keys have been processed or the job was canceled.
+    void finished(QS3BulkAclJob *job);
+
+private slots:
+    void start();
+    void onListObjects(QS3ListObjectsResponse *response);
+
+private:
+    QS3BulkAclJob(QS3Client *client, const QString &prefix, QS3::CannedAcl cannedAcl);
+
+    /// QS3ResultHandler
+    void handleResult(const QS3Result &result);
+
+    /// Issues requests for queued keys and lists more when the queue runs low.
+    void pump();
+    void listNextPage();
+
+    /// Sizes the next page to what is processed during one listing round trip.
+    void tunePageSize(qint64 listMsecs);
+    void finish();
+
+    enum RequestTag
+    {
+        VerifyRequest = 1,
+        SetRequest
+    };
+
+    QPointer<QS3Client> client_;
+    QString prefix_;
+    QS3::CannedAcl cannedAcl_;
+
+    int maxConcurrent_;
+    int maxQueued_;
+    qreal verifySampleRate_;
+
+    QQueue<QString> queue_;
+    QHash<QS3RequestId, QString> ongoing_;
+    QS3ListObjectsResponse *listing_;
+    QString marker_;
+    QElapsedTimer listTimer_;
+    QElapsedTimer runTimer_;
+    uint pageSize_;
+    bool listingDone_;
+    bool finished_;
+
+    int listed_;
+    int updated_;
+    int skipped_;
+    QHash<QString, QS3Error> failures_;
+};
@@ -10,6 +10,12 @@
 #include <QStringList>
 #include <QByteArray>
 #include <QUrl>
+#include <QDateTime>
+#include <QList>
+#include <QSet>
+#include <QMap>
+#include <QElapsedTimer>
+#include <QPointer>
 
 /** QS3Client provides access to Amazon S3 file storage.
    
@@ -20,6 +26,11 @@
        and the error signals in QS3Client. 
     2) Connect to the QS3Client finished signals, one for each type
        of response and the error signals in QS3Client.
+
+    Additionally most requests can be issued with a QS3ResultHandler.
+    The handler receives a QS3Result value directly when the request
+    completes. No response QObject is allocated and no QS3Client
+    signals are emitted for these requests, use this for high request rates.
 */
 
 class QTS3SHARED_EXPORT QS3Client : public QObject
@@ -41,6 +52,113 @@ public slots:
         prefix and delimiter for filtering. */
     QS3ListObjectsResponse *listObjects(const QString &prefix = "", const QString &delimiter = "", uint maxObjects = 1000);
 
+    /// List bucket objects into compact storage.
+    /** Same as listObjects but the objects are collected to QS3ListObjectsResponse::compactObjects.
+        Use this for very large listings, see QS3CompactObjectList.
+        @param QString prefix for the request.
+        @param QString delimiter for the request.
+        @param uint maximum objects to return with single response.
+        @return QS3ListObjectsResponse response object. */
+    QS3ListObjectsResponse *listObjectsCompact(const QString &prefix = "", const QString &delimiter = "", uint maxObjects = 1000);
+
+    /// List a single page of bucket objects.
+    /** Unlike listObjects the listing is not continued automatically. If the returned
+        response isTruncated, request the next page with QS3ListObjectsResponse::lastKey as marker.
+        @param QString prefix for the request.
+        @param QString marker, objects after this key are returned. Empty for the first page.
+        Sent as start-after with QS3Config::listObjectsV2.
+        @param QString delimiter for the request.
+        @param uint maximum objects to return.
+        @return QS3ListObjectsResponse response object. */
+    QS3ListObjectsResponse *listObjectsPage(const QString &prefix, const QString &marker, const QString &delimiter = "", uint maxObjects = 1000);
+
+    /// List one level of a folder.
+    /** Returns the objects directly in folder and its subfolders as isDir entries, see
+        QS3ListObjectsResponse::commonPrefixes. Objects deeper in the tree are not listed,
+        so a folder with few direct children costs one request regardless of its size.
+        @param QString folder, empty for the bucket root. A trailing "/" is added if missing.
+        @param uint maximum entries to return with single response.
+        @return QS3ListObjectsResponse response object. */
+    QS3ListObjectsResponse *browse(const QString &folder = "", uint maxObjects = 1000);
+
+    /// Build a local existence index of the keys under prefix.
+    /** The prefix is listed once into a Bloom filter, after that exists answers keys that
+        are not under the prefix in S3 without a request. Keys this client writes under
+        the prefix are added to the index. See QS3ExistenceIndex for its limits.
+        @param QString prefix to index, empty for the whole bucket.
+        @param double target false positive rate of the filter. Default 0.01.
+        @return QS3ExistenceIndex index object. The listing starts when control returns to the event loop.
+        @note The index is deleted with the client, delete it yourself if you need to free it earlier. */
+    QS3ExistenceIndex *buildExistenceIndex(const QString &prefix, double falsePositiveRate = 0.01);
+
+    /// Check locally if key can exist.
+    /** Returns QS3::DoesNotExist if a ready existence index covering key does not contain it,
+        QS3::MayExist if one does and QS3::ExistenceUnknown if no ready index covers key.
+        Only DoesNotExist is certain for the changes made by this client, MayExist needs a request to confirm.
+        @param QString key aka path in the bucket. */
+    QS3::Existence exists(const QString &key) const;
+
+    /// Set canned ACL to all objects under prefix.
+    /** The prefix is listed page by page into a bounded queue that is processed with
+        a limited number of concurrent setCannedAcl requests. See QS3BulkAclJob for options.
+        @param QString prefix.
+        @param QS3::CannedAcl canned acl to apply.
+        @return QS3BulkAclJob job object. The job starts when control returns to the event loop. 
+        @note The job is deleted with the client, delete it yourself after finished if you need to free it earlier. */
+    QS3BulkAclJob *setCannedAclForPrefix(const QString &prefix, QS3::CannedAcl cannedAcl);
+
+    /// Get many objects with a limited number of concurrent requests.
+    /** Each object is delivered with QS3GetManyJob::received as it completes, or in the
+        order of keys, and finished reports per key status and totals. See QS3GetManyJob for options.
+        @param QStringList keys aka paths in the bucket.
+        @return QS3GetManyJob job object. The job starts when control returns to the event loop.
+        @note The job is deleted with the client, delete it yourself after finished if you need to free it earlier. */
+    QS3GetManyJob *getMany(const QStringList &keys);
+
+    /// Open a pack object for reading its members.
+    /** Upload packs built with QS3PackWriter with put. The index is read and cached once,
+        members are fetched with ranged gets. See QS3PackReader.
+        @param QString key of the pack object.
+        @return QS3PackReader reader object. The index is read when control returns to the event loop.
+        @note The reader is deleted with the client, delete it yourself if you need to free it earlier. */
+    QS3PackReader *openPack(const QString &key);
+
+    /// Upload a file in parts with a journal for resuming.
+    /** Completed parts are recorded to the journal file, if the process exits the upload
+        can be continued with resumeMultipart. The journal is removed when the upload completes.
+        See QS3MultipartUpload for options.
+        @param QString key to upload.
+        @param QString file name of the file to upload.
+        @param QString journal file name. Use the QS3MultipartUpload::JournalSuffix suffix for abortStaleMultipart.
+        @param QS3FileMetadata Metadata.
+        @param QS3::CannedAcl Applied canned ACL to uploaded file. By default QS3::BucketOwnerFullControl is used.
+        @return QS3MultipartUpload job object. The job starts when control returns to the event loop. */
+    QS3MultipartUpload *putMultipart(const QString &key, const QString &fileName, const QString &journalFileName, const QS3FileMetadata &metadata, QS3::CannedAcl cannedAcl = QS3::BucketOwnerFullControl);
+
+    /// Resume an interrupted multipart upload from its journal.
+    /** Parts in the journal are verified with a list parts request, only missing parts are uploaded.
+        If the upload no longer exists in S3 it is started again.
+        @param QString journal file name.
+        @return QS3MultipartUpload job object. */
+    QS3MultipartUpload *resumeMultipart(const QString &journalFileName);
+
+    /// Upload data of unknown length from a source device.
+    /** Sources that end within one part are uploaded with a single put, longer ones
+        switch to a multipart upload. At most one part is held in memory. See QS3StreamUpload.
+        @param QString key to upload.
+        @param QIODevice open readable source. Must outlive the job.
+        @param QS3FileMetadata Metadata.
+        @param QS3::CannedAcl Applied canned ACL to uploaded file. By default QS3::BucketOwnerFullControl is used.
+        @return QS3StreamUpload job object. The job starts when control returns to the event loop. */
+    QS3StreamUpload *putStream(const QString &key, QIODevice *source, const QS3FileMetadata &metadata, QS3::CannedAcl cannedAcl = QS3::BucketOwnerFullControl);
+
+    /// Abort multipart uploads of old journals.
+    /** Uploaded parts of unfinished uploads are stored and billed by S3 until the upload is aborted.
+        @param QString directory with journals named with QS3MultipartUpload::JournalSuffix.
+        @param int journals not modified in this many seconds are aborted and removed.
+        @return QList<QS3MultipartUpload*> job objects, one per aborted journal. */
+    QList<QS3MultipartUpload*> abortStaleMultipart(const QString &journalDirectory, int maxAgeSecs);
+
     /// Remove object with key.
     /** @param QString key aka path in the bucket.
         @return QS3DeleteObjectResponse response object. 
@@ -65,8 +183,17 @@ public slots:
 
     /// Get object with key.
     /** @param QString key aka path in the bucket.
-        @return QS3GetObjectResponse response object. */
+        @return QS3GetObjectResponse response object.
+        @note If an identical get is already ongoing the response will receive its result, see QS3Config::coalesceRequests.
+        @note Slow gets can be sent again to cut tail latency, see QS3Config::hedgeRequests. */
     QS3GetObjectResponse *get(const QString &key);
+
+    /// Get a byte range of object with key.
+    /** @param QString key aka path in the bucket.
+        @param qint64 offset of the first byte.
+        @param qint64 length in bytes, if negative the rest of the object from offset is returned.
+        @return QS3GetObjectResponse response object. See QS3GetObjectResponse::totalSize for the full object size. */
+    QS3GetObjectResponse *get(const QString &key, qint64 offset, qint64 length);
     
     /// Put new object to bucket with key and file.
     /** @param QString key to upload.
@@ -74,7 +201,8 @@ public slots:
         @param QS3FileMetadata File metadata.
         @param QS3::CannedAcl Applied canned ACL to uploaded file. By default QS3::BucketOwnerFullControl is used.
         @return QS3PutObjectResponse response object.
-        @note Returned response can be null if invalid input params were given. */
+        @note Returned response can be null if invalid input params were given.
+        @note See QS3Config::memoryMapUploads for uploading without reading the file to memory. */
     QS3PutObjectResponse *put(const QString &key, QFile *file, const QS3FileMetadata &metadata, QS3::CannedAcl cannedAcl = QS3::BucketOwnerFullControl);
     
     /// Put new object to bucket with key and file data.
@@ -118,6 +246,140 @@ public slots:
     /** @return QString bucket name. */
     QString bucket() const;
 
+public:
+    /// Callback API variants of the above functions.
+    /** The QS3ResultHandler is called once when the request finishes. 
+        @return QS3RequestId request id or 0 if invalid input params were given. */
+    QS3RequestId remove(const QString &key, QS3ResultHandler *handler, quint64 tag = 0);
+    QS3RequestId copy(const QString &sourceKey, const QString &destinationKey, QS3::CannedAcl cannedAcl, QS3ResultHandler *handler, quint64 tag = 0);
+    QS3RequestId get(const QString &key, QS3ResultHandler *handler, quint64 tag = 0);
+    QS3RequestId get(const QString &key, qint64 offset, qint64 length, QS3ResultHandler *handler, quint64 tag = 0);
+    QS3RequestId put(const QString &key, const QByteArray &data, const QS3FileMetadata &metadata, QS3::CannedAcl cannedAcl, QS3ResultHandler *handler, quint64 tag = 0);
+    QS3RequestId getAcl(const QString &key, QS3ResultHandler *handler, quint64 tag = 0);
+    QS3RequestId setCannedAcl(const QString &key, QS3::CannedAcl cannedAcl, QS3ResultHandler *handler, quint64 tag = 0);
+
+    /// Multipart upload requests.
+    /** See QS3MultipartUpload for uploading large files with these. Results of
+        initiate, list and complete have the result XML in QS3Result::data, uploaded
+        parts have their ETag in QS3Result::eTag.
+        http://docs.aws.amazon.com/AmazonS3/latest/dev/mpuoverview.html */
+    QS3RequestId initiateMultipartUpload(const QString &key, const QS3FileMetadata &metadata, QS3::CannedAcl cannedAcl, QS3ResultHandler *handler, quint64 tag = 0);
+    QS3RequestId uploadPart(const QString &key, const QString &uploadId, int partNumber, const QByteArray &data, QS3ResultHandler *handler, quint64 tag = 0);
+    QS3RequestId listParts(const QString &key, const QString &uploadId, int partNumberMarker, QS3ResultHandler *handler, quint64 tag = 0);
+    QS3RequestId completeMultipartUpload(const QString &key, const QString &uploadId, const QMap<int, QString> &partETags, QS3ResultHandler *handler, quint64 tag = 0);
+    QS3RequestId abortMultipartUpload(const QString &key, const QString &uploadId, QS3ResultHandler *handler, quint64 tag = 0);
+
+    /// Generates a pre-signed url for key.
+    /** The url can be used without credentials, eg. by a browser, until it expires.
+        @param QString HTTP verb the url is valid for: GET, HEAD, PUT or DELETE.
+        @param QString key aka path in the bucket.
+        @param QDateTime expiration time. At most a week from now with SignatureV4.
+        @return QUrl pre-signed url or invalid url if invalid input params were given. */
+    QUrl presign(const QString &httpVerb, const QString &key, const QDateTime &expires);
+
+    /// Generates pre-signed urls for multiple keys.
+    /** Faster than calling presign for each key, the urls are built and signed
+        without intermediate QUrl parsing.
+        @param QString HTTP verb the urls are valid for: GET, HEAD, PUT or DELETE.
+        @param QStringList keys.
+        @param QDateTime expiration time.
+        @return QList<QByteArray> percent encoded urls in the same order as keys. An empty entry for an invalid key. */
+    QList<QByteArray> presign(const QString &httpVerb, const QStringList &keys, const QDateTime &expires);
+
+    /// Limits the transfer bandwidth of the client.
+    /** Requests are never dropped, replies are read and upload data is handed to the
+        network only as fast as the limit allows. Uploads started before the limit was
+        set and ongoing downloads started without any download limit are not paced.
+        @param QS3::TransferDirection direction to limit.
+        @param qint64 bytes per second, 0 removes the limit. */
+    void setBandwidthLimit(QS3::TransferDirection direction, qint64 bytesPerSecond);
+
+    /// Limits the transfer bandwidth of requests with priority.
+    /** Requests are limited by both the client wide and their priority class limit.
+        @param QS3::TransferDirection direction to limit.
+        @param QS3::Priority priority class to limit.
+        @param qint64 bytes per second, 0 removes the limit. */
+    void setBandwidthLimit(QS3::TransferDirection direction, QS3::Priority priority, qint64 bytesPerSecond);
+
+    /// Returns the client wide bandwidth limit for direction, 0 if not limited.
+    qint64 bandwidthLimit(QS3::TransferDirection direction) const;
+
+    /// Sets the priority class of future requests.
+    /** The priority selects the bandwidth limit of the request and is
+        passed to QNetworkRequest::setPriority. Default QS3::NormalPriority.
+        @param QS3::Priority priority. */
+    void setPriority(QS3::Priority priority);
+
+    /// Returns the priority class of future requests.
+    QS3::Priority priority() const;
+
+    /// Sets the timeouts of future requests.
+    /** A request that times out fails with a timeout error, its network request is aborted.
+        Defaults are QS3Config::requestTimeout and QS3Config::stallTimeout.
+        @param int milliseconds from sending until the request must be finished, 0 for no limit.
+        @param int milliseconds without any data transferred after which the request fails, 0 for no limit. */
+    void setTimeouts(int requestTimeout, int stallTimeout);
+
+    /// Returns the current concurrent request window for the prefix of key.
+    /** @param QString key aka path in the bucket.
+        @return int window size or 0 if QS3Config::adaptiveConcurrency is disabled. */
+    int concurrencyLimit(const QString &key) const;
+
+    /// Returns the pool that response bodies are read to.
+    /** Use it for statistics or to release QS3Result::data that a handler kept.
+        The pool is destroyed with the client. See QS3Config::bufferPoolBytes. */
+    QS3BufferPool *bufferPool() const;
+
+    /// Starts recording request timelines for traceJson.
+    /** Each finished request is recorded with its type, key, status, bytes and
+        the times it was scheduled, signed, sent, got headers, received its body and
+        was parsed and emitted. Spans are kept in a ring buffer, the oldest ones are
+        overwritten. A low sample rate keeps tracing cheap enough to leave on.
+        Previously recorded spans are discarded.
+        @param int maximum number of spans kept.
+        @param double fraction of requests recorded, 0 to 1. */
+    void startTrace(int maxSpans = 10000, double sampleRate = 1.0);
+
+    /// Stops recording new requests. Recorded spans are kept until the next startTrace.
+    void stopTrace();
+
+    /// Returns the recorded spans as Chrome trace event JSON.
+    /** Open it in chrome://tracing or https://ui.perfetto.dev. Empty if tracing was never started. */
+    QByteArray traceJson() const;
+
+    /// Writes traceJson to fileName.
+    /** @return bool true if the file was written. */
+    bool writeTrace(const QString &fileName) const;
+
+    /// Records every request issued from now on to fileName.
+    /** Each finished request is written with its type, key, byte range, sizes,
+        status, issue time, duration and the number of requests in flight when it
+        was issued. Replay the workload with the qts3tester replay command to compare
+        client versions with a real request mix. See QS3Recording.
+        @param QString recording file name, truncated if it exists.
+        @return bool true if the file was opened. */
+    bool startRecording(const QString &fileName);
+
+    /// Stops recording and closes the recording file.
+    void stopRecording();
+
+    /// Replaces the transport that sends the HTTP requests.
+    /** The built-in transport is selected with QS3Config::transport. Can only be
+        changed while no requests are in flight, queued requests use the new transport.
+        @param QS3Transport transport, the client takes ownership.
+        @return bool true if the transport was set. */
+    bool setTransport(QS3Transport *transport);
+
+    /// Returns the transport that sends the HTTP requests.
+    QS3Transport *transport() const;
+
+    /// Cancels an ongoing request issued with a QS3ResultHandler.
+    /** The handler will not be called for a canceled request. To cancel a request
+        issued with the signal API see QS3Response::cancel.
+        @param QS3RequestId request id.
+        @return bool true if the request was found and canceled. */
+    bool cancel(QS3RequestId id);
+
 signals:
     /// QS3ListObjectsResponse has finished.
     /** @note Do not store the emitted pointer. It will be automatically destroyed. */
@@ -159,19 +421,227 @@ private slots:
     /// Private handler for internal Amazon replies.
     void onReply(QNetworkReply *reply);
 
+    /// Records the time until response headers for adaptive concurrency.
+    void onMetaDataChanged();
+
+    /// Cancels the request of response.
+    void onCancelRequested(QS3Response *response);
+
+    /// Fails requests that are past their deadline or have stalled.
+    void onTimeoutTimer();
+
+    /// Records transfer activity for stall detection.
+    void onTransferProgress();
+
+    /// Sends hedges for gets that are slower than usual.
+    void onHedgeTimer();
+
+    /// Reads available data of a throttled reply.
+    void onReadyRead();
+
+    /// Continues reading throttled replies as the bandwidth limits refill.
+    void onThrottleTimer();
+
+    /// Fails the requests the transport could not send.
+    void onUnsentRequests();
+
 private:
+    /// Starts a list object request.
+    QS3ListObjectsResponse *startListObjects(const QString &prefix, const QString &delimiter, uint maxObjects, bool compact, const QString &marker, bool autoContinue);
+
     /// Continues a list object request with current marker.
-    void listObjectsContinue(QS3ListObjectsResponse *response);
+    void listObjectsContinue(QS3Request *request);
+
+    /// Request factories. Validate input and setup the request, return null on invalid input.
+    QS3Request *createRemoveRequest(const QString &key);
+    QS3Request *createCopyRequest(const QString &sourceBucket, const QString &sourceKey, const QString &destinationKey, QS3::CannedAcl cannedAcl);
+    QS3Request *createGetRequest(const QString &key, qint64 offset = 0, qint64 length = -1);
+    QS3Request *createPutRequest(const QString &key, const QByteArray &data, const QS3FileMetadata &metadata, QS3::CannedAcl cannedAcl);
+    QS3Request *createMappedPutRequest(const QString &key, const QString &fileName, const QS3FileMetadata &metadata, QS3::CannedAcl cannedAcl);
+    QS3Request *createGetAclRequest(const QString &key);
+    QS3Request *createSetCannedAclRequest(const QString &key, QS3::CannedAcl cannedAcl);
+    QS3Request *createMultipartRequest(QS3::RequestType type, const QString &key, const QString &verb, const Q3SQueryParams &params, const QByteArray &body = QByteArray());
+
+    /// Sends the request, or queues it until its prefix has a free concurrency slot. Takes ownership of request.
+    /** @return QS3RequestId id of the request. */
+    QS3RequestId send(QS3Request *request);
+
+    /// Signs and sends the request to the network.
+    /** @return QNetworkReply reply or null if the request could not be sent, it fails from the event loop then. */
+    QNetworkReply *dispatch(QS3Request *request);
+
+    /// Fails the request with error from the event loop, its id may not have been returned to the caller yet.
+    void failUnsent(QS3Request *request, const QString &error);
+
+    /// Returns true if the failed get of reply can continue from the data received so far.
+    bool canResume(QS3Request *request, QNetworkReply *reply) const;
+
+    /// Sends the get again for the bytes not yet received.
+    void resume(QS3Request *request, QNetworkReply *reply, const QByteArray &data);
+
+    /// Returns the key prefix for adaptive concurrency.
+    QString concurrencyPrefix(const QString &key) const;
+
+    /// Releases the concurrency slot of a finished request and sends queued requests.
+    void releaseConcurrency(QS3Request *request, QNetworkReply *reply, const QByteArray &data);
+
+    /// Sends queued requests of prefix while its window allows.
+    void dispatchQueued(const QString &prefix);
+
+    /// Sends the request for handler. Takes ownership of request.
+    QS3RequestId send(QS3Request *request, QS3ResultHandler *handler, quint64 tag);
+
+    /// Returns the limiters that apply to requests with priority.
+    QList<QS3RateLimiter*> limiters(QS3::TransferDirection direction, QS3::Priority priority) const;
+
+    /// Returns if any limiter applies to requests with priority.
+    bool isThrottled(QS3::TransferDirection direction, QS3::Priority priority) const;
+
+    /// Cancels a request by id. Response requests only if response is given, handler requests otherwise.
+    bool cancelRequest(QS3RequestId id, QS3Response *response);
+
+    /// Destroys a canceled request, its response fails with a canceled error.
+    void finishCanceled(QS3Request *request);
+
+    /// Destroys a request that failed without a reply, its handler or response fails with error.
+    void finishFailed(QS3Request *request, const QString &error);
+
+    /// Aborts the network request of reply and fails its requests with reason.
+    void abortRequest(QNetworkReply *reply, const QString &reason, bool retryable = false);
+
+    /// Sends a duplicate of the request for reply.
+    /** @return bool true if the hedge was sent, false if the prefix of the request has no free concurrency slot. */
+    bool sendHedge(QNetworkReply *reply, QS3Request *request);
+
+    /// Releases the concurrency slot taken for a hedge of request, when one of the pair is gone.
+    void releaseHedgeSlot(QS3Request *request);
+
+    /// Keeps the reply of a hedged pair that got headers first and aborts the other one.
+    void resolveHedge(QNetworkReply *winner);
+
+    /// Moves the request and its followers from reply to another reply of the same request.
+    void moveRequest(QNetworkReply *from, QNetworkReply *to);
+
+    /// Reads as much of the reply to QS3Request::received as the download limits allow.
+    void readThrottled(QNetworkReply *reply, QS3Request *request);
+
+    /// Reads up to maxBytes of the reply to QS3Request::received, moving to a larger pooled buffer when needed.
+    /** @return qint64 number of bytes read. */
+    qint64 readReceived(QNetworkReply *reply, QS3Request *request, qint64 maxBytes);
+
+    /// Returns the body read to QS3Request::received and resets it.
+    QByteArray takeReceived(QS3Request *request);
+
+    /// Returns the QS3Request::received buffer to the pool.
+    void discardReceived(QS3Request *request);
+
+    /// Completes a request by calling its QS3ResultHandler.
+    /** @param bool true if the request failed, a reply with an error may still have delivered every requested byte. */
+    void finishResult(QS3Request *request, QNetworkReply *reply, const QByteArray &data, bool failed);
+
+    /// Completes a request by filling its QS3Response and emitting finished signals.
+    /** @param bool true if the request failed, see finishResult. */
+    void finishResponse(QS3Request *request, QNetworkReply *reply, const QByteArray &data, bool failed);
 
     /// Executes the amazon Authorization header signing.
-    /** @note Set any "x-amz-" headers before calling this functions. */
-    void prepareRequest(QNetworkRequest *request, QString httpVerb);
+    /** @note Set any "x-amz-" headers before calling this functions.
+        @param QByteArray payload hash for SignatureV4, see payloadHash. */
+    void prepareRequest(QNetworkRequest *request, QString httpVerb, const QByteArray &payloadHash = QByteArray());
+
+    /// Returns the SignatureV4 payload hash of the request body, computed once per request.
+    QByteArray payloadHash(QS3Request *request);
     
+    /// Appends the CanonicalizedResource element of the string to sign to data.
+    void appendCanonicalResource(QByteArray &data, const QUrl &url) const;
+
     /// Generates proper url with query parameters.
     QS3UrlPair generateUrl(QString key, const Q3SQueryParams &queryParams = Q3SQueryParams());
+
+    /// Returns the encoded bucket url without a path.
+    QByteArray baseUrl() const;
+
+    /// Updates the values derived from the bucket and credentials.
+    void updateRequestTemplate();
+
+    /// Returns the client clock in microseconds for tracing.
+    qint64 traceClock() const;
+
+    /// Returns the recording entry of a finished request, without its duration.
+    QS3RecordedRequest recordedRequest(QS3Request *request, QNetworkReply *reply, qint64 bytesReceived) const;
     
     QS3Config config_;
-    QNetworkAccessManager *network_;
-    QHash<QNetworkReply*, QS3Response*> requests_;
+    QS3Transport *transport_;
+    QS3HmacSha1 *signer_;
+
+    /// Signer with cached signing keys if QS3Config::signatureVersion is SignatureV4, otherwise null.
+    QS3SignerV4 *signerV4_;
+
+    /// Per client parts of every request: the bucket url, the bucket part of the
+    /// CanonicalizedResource and the Authorization header up to the signature.
+    QByteArray baseUrl_;
+    QByteArray bucketResource_;
+    QByteArray authPrefix_;
+
+    /// Date header of the current second, see prepareRequest.
+    QByteArray date_;
+    uint dateTime_;
+    QHash<QNetworkReply*, QS3Request*> requests_;
+
+    /// Coalesced requests waiting for an identical ongoing reply.
+    QMultiHash<QNetworkReply*, QS3Request*> followers_;
+
+    /// Ongoing coalescable replies by QS3Request::coalesceKey.
+    QHash<QByteArray, QNetworkReply*> inflight_;
+
+    /// Requests the transport could not send, failed by onUnsentRequests with QS3Request::abortReason.
+    QList<QS3Request*> unsent_;
+
+    QS3RequestId nextRequestId_;
+
+    /// Adaptive concurrency windows, null if QS3Config::adaptiveConcurrency is disabled.
+    QS3ConcurrencyLimiter *concurrency_;
+
+    /// Bandwidth limiters by QS3::TransferDirection, index 0 is client wide, 1 + QS3::Priority per priority class.
+    /// Created with the client and never removed, upload devices hold pointers to them.
+    QS3RateLimiter *limiters_[2][4];
+
+    /// Priority of future requests.
+    QS3::Priority priority_;
+
+    /// Reusable response body buffers.
+    QS3BufferPool *bufferPool_;
+
+    /// Recent get latencies until response headers and gets that may still be hedged.
+    QS3LatencyTracker *latencies_;
+    QSet<QNetworkReply*> hedgeCandidates_;
+    QTimer *hedgeTimer_;
+
+    /// Both replies of hedged requests mapped to each other. Only one of them is in requests_.
+    QHash<QNetworkReply*, QNetworkReply*> hedges_;
+
+    /// Hedges that may still be sent, grows by QS3Config::hedgeBudget per get.
+    double hedgeCredit_;
+
+    /// Timeouts of future requests.
+    int requestTimeout_;
+    int stallTimeout_;
+
+    /// Clock for request deadlines and stall detection.
+    QElapsedTimer clock_;
+    QTimer *timeoutTimer_;
+
+    /// Replies with data waiting for download bandwidth.
+    QSet<QNetworkReply*> throttled_;
+    QTimer *throttleTimer_;
+
+    /// Recorded request spans, null if tracing was never started.
+    QS3Tracer *tracer_;
+
+    /// Open recording file and its start time on the trace clock, null if not recording.
+    QS3Recording *recording_;
+    qint64 recordingStart_;
+
+    /// Existence indexes built with buildExistenceIndex.
+    QList<QPointer<QS3ExistenceIndex> > existenceIndexes_;
 };
 
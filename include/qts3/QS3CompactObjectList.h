@@ -0,0 +1,172 @@
+
+#pragma once
+
+#include "QS3API.h"
+#include "QS3Fwd.h"
+
+#include <QString>
+#include <QByteArray>
+#include <QBitArray>
+#include <QVector>
+#include <QHash>
+#include <QList>
+#include <QDateTime>
+
+/// QS3ObjectView
+
+/** Lightweight read only view to a single entry in QS3CompactObjectList.
+    @note The view is valid only as long as the list it points to is alive and not modified. */
+class QTS3SHARED_EXPORT QS3ObjectView
+{
+public:
+    QS3ObjectView(const QS3CompactObjectList *list, int index);
+
+    /// Object key.
+    QString key() const;
+
+    /// Object key as UTF-8 bytes.
+    QByteArray keyUtf8() const;
+
+    /// Object ETag in the same quoted form that S3 returns.
+    QString eTag() const;
+
+    /// Raw 16 byte MD5 digest of the ETag.
+    /** @note Returns an empty array for multipart and other non MD5 ETags. */
+    QByteArray eTagDigest() const;
+
+    /// Last modified time as milliseconds since epoch (UTC).
+    qint64 lastModifiedMSecs() const;
+
+    /// Last modified time (UTC).
+    QDateTime lastModified() const;
+
+    /// Object size in bytes.
+    qint64 size() const;
+
+    /// Is this object a folder.
+    bool isDir() const;
+
+    /// Index of this object in the list.
+    int index() const;
+
+    /// Returns a full QS3Object copy of the entry.
+    /** @note QS3Object::size is 32 bit, sizes of 4 GB and over are clamped to UINT_MAX. Use size for the real size. */
+    QS3Object toObject() const;
+
+private:
+    const QS3CompactObjectList *list_;
+    int index_;
+};
+
+/// QS3CompactObjectList
+
+/** Memory efficient alternative to QS3ObjectList for large listings.
+
+    Keys are stored front coded (shared prefix length + UTF-8 suffix) in a single
+    arena with a full key every RestartInterval entries, ETags as 16 byte binary
+    MD5 digests and timestamps and sizes as 64-bit integers in parallel arrays.
+    Keys should be appended in sorted order, as S3 returns them, for the
+    prefix compression to be effective.
+
+    Iterate with QS3ObjectView:
+    @code
+    for (QS3CompactObjectList::const_iterator iter = list.begin(); iter != list.end(); ++iter)
+        qDebug() << (*iter).key() << (*iter).size();
+    @endcode */
+class QTS3SHARED_EXPORT QS3CompactObjectList
+{
+friend class QS3ObjectView;
+
+public:
+    class const_iterator
+    {
+    public:
+        const_iterator(const QS3CompactObjectList *list, int index) : list_(list), index_(index) {}
+
+        QS3ObjectView operator*() const { return QS3ObjectView(list_, index_); }
+        const_iterator &operator++() { ++index_; return *this; }
+        const_iterator operator++(int) { const_iterator old(*this); ++index_; return old; }
+        bool operator==(const const_iterator &other) const { return index_ == other.index_ && list_ == other.list_; }
+        bool operator!=(const const_iterator &other) const { return !(*this == other); }
+
+    private:
+        const QS3CompactObjectList *list_;
+        int index_;
+    };
+
+    QS3CompactObjectList();
+    QS3CompactObjectList(const QS3CompactObjectList &other);
+    ~QS3CompactObjectList();
+
+    /// Appends a new entry.
+    /** @param QString key.
+        @param QString last modified time in the ISO 8601 format S3 returns eg. "2009-10-12T17:50:30.000Z".
+        @param QString ETag as returned by S3, with or without quotes.
+        @param qint64 size in bytes.
+        @param bool is the entry a folder. */
+    void append(const QString &key, const QString &lastModified, const QString &eTag, qint64 size, bool isDir = false);
+
+    /// Appends a new entry from a QS3Object.
+    void append(const QS3Object &object);
+
+    /// Number of entries.
+    int size() const;
+    int count() const { return size(); }
+    bool isEmpty() const;
+
+    /// Returns view to entry at index.
+    QS3ObjectView at(int index) const;
+    QS3ObjectView operator[](int index) const { return at(index); }
+
+    /// Returns view to the last entry. The list must not be empty.
+    QS3ObjectView last() const;
+
+    /// Returns key at index.
+    QString key(int index) const;
+
+    /// Returns key at index as UTF-8 bytes.
+    QByteArray keyUtf8(int index) const;
+
+    const_iterator begin() const { return const_iterator(this, 0); }
+    const_iterator end() const { return const_iterator(this, size()); }
+
+    /// Reserves space for entries.
+    /** Does nothing if the space is already reserved, otherwise at least doubles the
+        reserved space so that reserving for each appended page stays linear.
+        @param int entry count.
+        @param int expected average key suffix length in bytes after prefix compression. */
+    void reserve(int entries, int averageSuffixLength = 16);
+
+    /// Releases any unused reserved memory.
+    void squeeze();
+
+    /// Removes all entries.
+    void clear();
+
+    /// Returns approximate heap memory used by the list in bytes.
+    qint64 memoryUsage() const;
+
+    /// Converts the list to QS3ObjectList.
+    /** @note This expands every entry to QStrings, avoid for large lists. Sizes are clamped like in QS3ObjectView::toObject. */
+    QList<QS3Object> toObjectList() const;
+
+    /// A full key is stored every RestartInterval entries, this bounds random access key decoding.
+    static const int RestartInterval = 16;
+
+private:
+    void decodeKey(int index, QByteArray &dest) const;
+
+    QByteArray keyArena_;
+    QVector<quint32> keyOffsets_;
+    QVector<quint16> sharedLengths_;
+    QByteArray eTags_;
+    QVector<qint64> lastModified_;
+    QVector<qint64> sizes_;
+    QBitArray dirs_;
+
+    /// ETags that are not plain MD5 digests eg. multipart "<md5>-<parts>", by index.
+    QHash<int, QString> irregularETags_;
+
+    /// Last appended full key, used for prefix compression.
+    QByteArray lastKey_;
+};
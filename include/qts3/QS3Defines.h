@@ -2,18 +2,22 @@
 #pragma once
 
 #include "QS3API.h"
+#include "QS3CompactObjectList.h"
 
 #include <QObject>
 #include <QString>
+#include <QStringList>
 #include <QByteArray>
 #include <QUrl>
 #include <QHash>
 #include <QPair>
+#include <QPointer>
 
 typedef QHash<QString, QString> Q3SQueryParams;
 typedef QPair<QString, QString> QS3QueryPair;
 typedef QList<QS3QueryPair > QS3QueryPairList;
 typedef QPair<QString, QUrl> QS3UrlPair;
+typedef quint64 QS3RequestId;
 
 namespace QS3
 {
@@ -25,7 +29,12 @@ namespace QS3
         GetObject,
         PutObject,
         GetAcl,
-        SetAcl
+        SetAcl,
+        InitiateMultipartUpload,
+        UploadPart,
+        ListParts,
+        CompleteMultipartUpload,
+        AbortMultipartUpload
     };
     
     enum CannedAcl
@@ -38,6 +47,27 @@ namespace QS3
         BucketOwnerRead,
         BucketOwnerFullControl
     };
+
+    enum TransferDirection
+    {
+        Upload = 0,
+        Download
+    };
+
+    enum Priority
+    {
+        HighPriority = 0,
+        NormalPriority,
+        LowPriority
+    };
+
+    /// Local answer to whether a key exists, see QS3Client::exists.
+    enum Existence
+    {
+        ExistenceUnknown = 0,
+        DoesNotExist,
+        MayExist
+    };
 }
 
 /// QS3Config
@@ -56,6 +86,18 @@ public:
         AP_SOUTHEAST_2,     // s3-ap-southeast-2.amazonaws.com
         AP_NORTHEAST_1,     // s3-ap-northeast-1.amazonaws.com
     };
+
+    enum SignatureVersion
+    {
+        SignatureV2,        // HMAC-SHA1
+        SignatureV4         // AWS4-HMAC-SHA256
+    };
+
+    enum Transport
+    {
+        QtNetworkTransport, // QNetworkAccessManager
+        NativeTransport     // Built-in HTTP/1.1 engine on QTcpSocket
+    };
     
     QString accessKey;
     QString secredKey;
@@ -63,6 +105,88 @@ public:
     QString bucket;
     S3EndPoint endpoint;
 
+    /// If true concurrent identical GET and ACL get requests share a single network request. Default false.
+    /// A get that attaches to an ongoing one receives what S3 returned to the first, which may predate
+    /// a write that finished before the get was made. Puts, copies, removes, ACL sets and completed
+    /// multipart uploads sent by the client stop later gets of the key from attaching to older ones.
+    bool coalesceRequests;
+
+    /// If true QS3Client::put(QFile*) uploads directly from a memory mapping of the file
+    /// instead of reading it to memory. The mapping is kept until the network reply is deleted.
+    /// The file must not be truncated or replaced in place during the upload, reading a truncated
+    /// mapping raises SIGBUS on unix and terminates the application. Default false.
+    bool memoryMapUploads;
+
+    /// If true the number of concurrent requests is adapted per key prefix: the window grows while
+    /// latency is stable and shrinks on SlowDown responses or inflated latency. Requests over the
+    /// window are queued and signed when sent. Default false.
+    bool adaptiveConcurrency;
+
+    /// Initial and maximum concurrent requests per key prefix with adaptiveConcurrency. Default 8 and 128.
+    int initialConcurrency;
+    int maxConcurrency;
+
+    /// Number of leading key path segments that form the prefix for adaptiveConcurrency. Default 1.
+    int concurrencyPrefixDepth;
+
+    /// If true a get that has not received response headers within hedgePercentile of recently
+    /// observed latency is sent again. The first reply to receive headers is used and the other
+    /// one is aborted. Default false.
+    bool hedgeRequests;
+
+    /// Latency percentile in [0, 1] after which a get is hedged. Default 0.95.
+    double hedgePercentile;
+
+    /// Maximum fraction of gets that are hedged. Default 0.05.
+    double hedgeBudget;
+
+    /// Milliseconds from sending until a request must be finished, 0 for no limit. Default 0.
+    int requestTimeout;
+
+    /// Milliseconds without any data transferred after which a request fails, 0 for no limit. Default 0.
+    int stallTimeout;
+
+    /// How many times a get that fails on a network error or stall is resumed. The get is sent again
+    /// for the remaining bytes with If-Match on the original ETag, received data is kept. Default 3.
+    int resumeAttempts;
+
+    /// If true object listings use ListObjectsV2: pages are continued with a continuation token,
+    /// owner data is not fetched and keys are returned URL encoded so any key can be listed.
+    /// Not all S3 compatible services support it, so the original API is used unless enabled. Default false.
+    bool listObjectsV2;
+
+    /// Maximum bytes of response body buffers kept for reuse, 0 disables pooling.
+    /// See QS3BufferPool. Default 32 MB.
+    qint64 bufferPoolBytes;
+
+    /// Request and pre-signed url signing. Regions opened after 2014 only accept SignatureV4. Default SignatureV2.
+    SignatureVersion signatureVersion;
+
+    /// Region for SignatureV4, set from endpoint. Set it when using another region or host.
+    QString region;
+
+    /// If true SignatureV4 request bodies are signed with their SHA-256, computed once per request.
+    /// Otherwise they are sent as UNSIGNED-PAYLOAD and are not hashed at all. Default false.
+    bool signPayload;
+
+    /// HTTP transport of the client. NativeTransport is not limited to 6 connections per host,
+    /// applies the socket options below and reads response bodies from the socket straight into
+    /// result buffers. See QS3Client::setTransport for custom transports. Default QtNetworkTransport.
+    Transport transport;
+
+    /// Maximum connections per host with NativeTransport, requests over it wait. Default 16.
+    int connectionsPerHost;
+
+    /// Milliseconds an idle NativeTransport connection is kept open for reuse, 0 closes connections
+    /// after each request. Default 30000.
+    int idleConnectionTimeout;
+
+    /// If true NativeTransport sockets disable Nagle's algorithm. Default true.
+    bool tcpNoDelay;
+
+    /// Kernel send and receive buffer size of NativeTransport sockets in bytes, 0 for the system default. Default 0.
+    int socketBufferSize;
+
     QS3Config(const QString &accessKey_, const QString &secredKey_, const QString &bucket_, S3EndPoint endpoint_);
     QS3Config(const QS3Config &other);
     ~QS3Config();
@@ -142,6 +266,10 @@ public:
     QS3Acl(const QS3Acl &other);
     ~QS3Acl();
 
+    /// Returns true if the grants are exactly those that cannedAcl sets.
+    /** @note Bucket owner canned ACLs cannot be verified from object ACL, false is returned for them. */
+    bool matchesCannedAcl(QS3::CannedAcl cannedAcl) const;
+
     QString toString() const;
 };
 
@@ -167,6 +295,71 @@ public:
     QString toString() const;
 };
 
+/// QS3Result
+
+/** Lightweight result of a request issued with the QS3Client callback API.
+    Unlike QS3Response this is a plain value type, no QObject is allocated per request. */
+class QTS3SHARED_EXPORT QS3Result
+{
+public:
+    QS3Result();
+
+    /// Request id returned when the request was issued.
+    QS3RequestId id;
+
+    /// User provided tag given when the request was issued.
+    quint64 tag;
+
+    /// Type of the request.
+    QS3::RequestType type;
+
+    /// Did request completed succesfully.
+    bool succeeded;
+
+    /// HTTP response status code.
+    int httpStatusCode;
+
+    /// Request Amason S3 object key.
+    QString key;
+
+    /// S3 error object.
+    QS3Error error;
+
+    /// Response body. Object data for QS3::GetObject, the raw ACL XML for QS3::GetAcl
+    /// and the raw result XML for multipart upload requests other than QS3::UploadPart.
+    QByteArray data;
+
+    /// Object ETag for QS3::GetObject, part ETag for QS3::UploadPart.
+    QString eTag;
+
+    /// Full object size for QS3::GetObject. Differs from data size for ranged gets, -1 if not known.
+    qint64 totalSize;
+
+    /// Object offset of the first byte of data for QS3::GetObject. 0 unless S3 returned
+    /// a range, -1 if the range could not be parsed.
+    qint64 dataOffset;
+
+    /// Parses the ACL of a QS3::GetAcl result.
+    /** @param QS3Acl destination ACL.
+        @param QString error message if parsing fails.
+        @return bool true if parsing succeeded. */
+    bool parseAcl(QS3Acl &acl, QString &errorMessage) const;
+};
+
+/// QS3ResultHandler
+
+/** Interface for receiving results of requests issued with the QS3Client callback API.
+    The handler is called directly when the request completes, no signals are emitted.
+    @note The handler must outlive its requests or the requests must be canceled with QS3Client::cancel. */
+class QTS3SHARED_EXPORT QS3ResultHandler
+{
+public:
+    virtual ~QS3ResultHandler() {}
+
+    /// Called once when the request finishes, succeeded or not.
+    virtual void handleResult(const QS3Result &result) = 0;
+};
+
 /// QS3Response
 
 class QTS3SHARED_EXPORT QS3Response : public QObject
@@ -197,10 +390,23 @@ public:
     /// Type of the request.
     QS3::RequestType type;
 
+public slots:
+    /// Cancels the request.
+    /** The network request is aborted and its buffers are freed immediately. The response
+        fails with a canceled error, finished is emitted and the response is destroyed as usual. */
+    void cancel();
+
+signals:
+    /// Emitted by cancel, handled by QS3Client.
+    void cancelRequested(QS3Response *response);
+
 protected:
     /// Each inheriting class needs to implement this function
     /// and emit its finished/failed signal.
     virtual void emitFinished() = 0;
+
+private:
+    QS3RequestId requestId_;
 };
 
 /// QS3ListObjectsResponse
@@ -210,11 +416,35 @@ class QTS3SHARED_EXPORT QS3ListObjectsResponse : public QS3Response
 Q_OBJECT
 
 public:
-    QS3ListObjectsResponse(const QString &key, const QUrl &url, const QString &prefix_);
+    QS3ListObjectsResponse(const QString &key, const QUrl &url, const QString &prefix_, bool compact_ = false);
     
     bool isTruncated;
     QString prefix;
+
+    /// If true objects are collected to compactObjects, otherwise to objects.
+    bool compact;
+
+    /// If true truncated listings are continued until all objects have been received.
+    bool autoContinue;
+
+    /// If true the listing uses ListObjectsV2, see QS3Config::listObjectsV2.
+    bool v2;
+
+    /// Token to continue a truncated ListObjectsV2 listing from.
+    QString nextContinuationToken;
+
+    /// Objects, and with a delimiter the folders one level below prefix as isDir entries in key order.
     QS3ObjectList objects;
+    QS3CompactObjectList compactObjects;
+
+    /// Folders one level below prefix, ending with the delimiter. Only listed when a delimiter is given.
+    QStringList commonPrefixes;
+
+    /// Returns the number of received objects, regardless of the storage used.
+    int objectCount() const;
+
+    /// Returns the key of the last received object or empty string if there are none.
+    QString lastKey() const;
 
 signals:
     /// Request response finished.
@@ -270,10 +500,25 @@ class QTS3SHARED_EXPORT QS3GetObjectResponse : public QS3Response
 {
 Q_OBJECT
 
+friend class QS3Client;
+
 public:
     QS3GetObjectResponse(const QString &key, const QUrl &url);
+    ~QS3GetObjectResponse();
+
+    /// Object data. Returned to the client's QS3BufferPool when the response is destroyed,
+    /// unless a copy of it is still held.
     QByteArray data;
 
+    /// Object ETag.
+    QString eTag;
+
+    /// Full object size. Differs from data size for ranged gets, -1 if not known.
+    qint64 totalSize;
+
+    /// Object offset of the first byte of data. 0 unless S3 returned a range, -1 if the range could not be parsed.
+    qint64 dataOffset;
+
 signals:
     /// Request response finished.
     /** This signal will fire if the request succeeded and
@@ -289,6 +534,9 @@ private slots:
     
 protected:
     void emitFinished();
+
+private:
+    QPointer<QS3BufferPool> bufferPool_;
 };
 
 /// QS3PutObjectResponse
@@ -0,0 +1,98 @@
+
+#pragma once
+
+#include "QS3API.h"
+#include "QS3Fwd.h"
+#include "QS3Defines.h"
+
+#include <QObject>
+#include <QString>
+#include <QVector>
+#include <QPointer>
+
+/// QS3ExistenceIndex
+
+/** Answers negative existence checks for keys under a prefix locally.
+
+    The prefix is listed once page by page and the keys are hashed into a
+    Bloom filter, sized for the listed keys with headroom for new ones. Keys
+    this client puts, copies or starts a multipart upload to under the prefix
+    are added as the requests are sent. A key that is not in the filter does
+    not exist, a key that is may exist and needs a request to be sure.
+
+    Removed keys cannot be taken out of a Bloom filter, they stay as false
+    positives until the index is rebuilt. Changes made by other clients are
+    not seen, rebuild the index if the prefix is shared with other writers.
+
+    Create with QS3Client::buildExistenceIndex and query with
+    QS3Client::exists or exists here. */
+class QTS3SHARED_EXPORT QS3ExistenceIndex : public QObject
+{
+Q_OBJECT
+
+friend class QS3Client;
+
+public:
+    ~QS3ExistenceIndex();
+
+    /// Prefix the index covers.
+    QString prefix() const;
+
+    /// Returns true once the listing has completed and the index can answer.
+    bool isReady() const;
+
+    /// Returns true when the listing has completed or failed.
+    bool isFinished() const;
+
+    /// Error if the listing failed.
+    QS3Error error() const;
+
+    /// Returns true if key is under the prefix of this index.
+    bool covers(const QString &key) const;
+
+    /// Returns DoesNotExist or MayExist for a covered key when ready, otherwise ExistenceUnknown.
+    QS3::Existence exists(const QString &key) const;
+
+    /// Adds a key that was created under the prefix. Called by QS3Client for its own writes.
+    void add(const QString &key);
+
+    /// Number of keys in the index, listed and added.
+    qint64 keyCount() const;
+
+    /// Memory used by the filter in bytes.
+    qint64 sizeBytes() const;
+
+    /// Estimated false positive rate with the current number of keys.
+    double falsePositiveRate() const;
+
+signals:
+    /// Emitted once when the listing has completed or failed.
+    void finished(QS3ExistenceIndex *index);
+
+private slots:
+    void start();
+    void onListObjects(QS3ListObjectsResponse *response);
+
+private:
+    QS3ExistenceIndex(QS3Client *client, const QString &prefix, double falsePositiveRate);
+
+    static QString normalizedKey(const QString &key);
+
+    void listNextPage();
+    void build();
+    void finish();
+
+    QPointer<QS3Client> client_;
+    QString prefix_;
+    double targetFalsePositiveRate_;
+
+    QPointer<QS3ListObjectsResponse> listing_;
+    QString marker_;
+
+    /// Key hashes collected while listing, the filter is sized and filled when the listing ends.
+    QVector<quint64> pending_;
+    QS3BloomFilter *filter_;
+
+    bool finished_;
+    QS3Error error_;
+};
@@ -7,7 +7,15 @@ class QS3Client;
 class QS3Config;
 class QS3Error;
 class QS3Object;
+class QS3ObjectView;
+class QS3CompactObjectList;
 class QS3Response;
+class QS3Result;
+class QS3ResultHandler;
+class QS3Request;
+class QS3HmacSha1;
+class QS3SignerV4;
+class QS3Acl;
 class QS3ListObjectsResponse;
 class QS3RemoveObjectResponse;
 class QS3CopyObjectResponse;
@@ -16,10 +24,33 @@ class QS3PutObjectResponse;
 class QS3GetAclResponse;
 class QS3SetAclResponse;
 class QS3FileMetadata;
+class QS3ObjectDevice;
+class QS3BulkAclJob;
+class QS3ExistenceIndex;
+class QS3BloomFilter;
+class QS3GetManyJob;
+class QS3PackReader;
+class QS3PackWriter;
+class QS3PackMember;
+class QS3MultipartUpload;
+class QS3StreamUpload;
+class QS3RateLimiter;
+class QS3ConcurrencyLimiter;
+class QS3LatencyTracker;
+class QS3BufferPool;
+class QS3Tracer;
+class QS3Recording;
+class QS3RecordedRequest;
+class QS3Transport;
+class QS3NetworkTransport;
+class QS3HttpEngine;
+class QS3HttpReply;
 
 QT_BEGIN_NAMESPACE
 class QNetworkAccessManager;
 class QNetworkRequest;
 class QNetworkReply;
 class QFile;
+class QIODevice;
+class QTimer;
 QT_END_NAMESPACE
@@ -0,0 +1,127 @@
+
+#pragma once
+
+#include "QS3API.h"
+#include "QS3Fwd.h"
+#include "QS3Defines.h"
+
+#include <QObject>
+#include <QString>
+#include <QStringList>
+#include <QVector>
+#include <QHash>
+#include <QMap>
+#include <QPointer>
+#include <QElapsedTimer>
+
+/// QS3GetManyJob
+
+/** Gets a list of objects with a limited number of concurrent requests.
+
+    Each object is delivered with the received signal as soon as it completes,
+    or in the order of the keys if ordered delivery is enabled. Ordered results
+    that complete early are held in a bounded reorder buffer, new gets are not
+    started while it is full. finished is emitted once with every key
+    delivered, see succeeded, httpStatusCode and failures for per key status.
+
+    Create with QS3Client::getMany. Options must be set before control
+    returns to the event loop, the job starts there. */
+class QTS3SHARED_EXPORT QS3GetManyJob : public QObject, public QS3ResultHandler
+{
+Q_OBJECT
+
+friend class QS3Client;
+
+public:
+    ~QS3GetManyJob();
+
+    /// Sets the maximum number of concurrent gets. Default 16.
+    void setMaxConcurrent(int maxConcurrent);
+
+    /// Sets if objects are delivered in the order of the keys. Default false.
+    void setOrdered(bool ordered);
+
+    /// Sets the maximum number of completed objects held for ordered delivery. Default 64.
+    /** Bounds the memory held while an early key is still being fetched. */
+    void setMaxBuffered(int maxBuffered);
+
+    /// Keys the job gets, indexes of received refer to this list.
+    QStringList keys() const;
+
+    /// Number of objects delivered so far.
+    int delivered() const;
+
+    /// Returns true if the object at index was received successfully.
+    bool succeeded(int index) const;
+
+    /// HTTP status code of the get at index, 0 if not finished or it failed without a response.
+    int httpStatusCode(int index) const;
+
+    /// Errors of the failed gets by index in keys, a key listed more than once fails per index.
+    QHash<int, QS3Error> failures() const;
+
+    /// Total object bytes received.
+    qint64 bytesReceived() const;
+
+    /// Milliseconds from start until finished, or until now if still running.
+    qint64 elapsed() const;
+
+    /// Returns true when the job has finished.
+    bool isFinished() const;
+
+public slots:
+    /// Stops the job. Ongoing gets are canceled, undelivered keys fail and finished is emitted.
+    void cancel();
+
+signals:
+    /// Object of keys()[index] was received or failed.
+    /** @note The result data is returned to the client buffer pool after the signal,
+        copy it to keep it, see QS3BufferPool. */
+    void received(QS3GetManyJob *job, int index, const QS3Result &result);
+
+    /// Emitted after each delivered object.
+    void progress(QS3GetManyJob *job, int delivered, int total);
+
+    /// Emitted once when every key has been delivered or the job was canceled.
+    void finished(QS3GetManyJob *job);
+
+private slots:
+    void start();
+
+private:
+    QS3GetManyJob(QS3Client *client, const QStringList &keys);
+
+    /// QS3ResultHandler
+    void handleResult(const QS3Result &result);
+
+    /// Starts gets while the concurrency and reorder buffer limits allow.
+    void pump();
+
+    /// Records the result of index and emits it, or buffers it for ordered delivery.
+    void complete(int index, const QS3Result &result);
+    void deliver(int index, const QS3Result &result);
+    void finish();
+
+    QPointer<QS3Client> client_;
+    QStringList keys_;
+
+    int maxConcurrent_;
+    bool ordered_;
+    int maxBuffered_;
+
+    /// Next key to get and next index to deliver in ordered mode.
+    int next_;
+    int nextDelivered_;
+
+    QHash<QS3RequestId, int> ongoing_;
+    QMap<int, QS3Result> buffered_;
+    QVector<int> httpStatusCodes_;
+    QVector<bool> succeeded_;
+    QHash<int, QS3Error> failures_;
+
+    int delivered_;
+    qint64 bytesReceived_;
+    QElapsedTimer runTimer_;
+    qint64 elapsed_;
+    bool finished_;
+};
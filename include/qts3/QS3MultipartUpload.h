@@ -0,0 +1,179 @@
+
+#pragma once
+
+#include "QS3API.h"
+#include "QS3Fwd.h"
+#include "QS3Defines.h"
+
+#include <QObject>
+#include <QString>
+#include <QHash>
+#include <QMap>
+#include <QPointer>
+
+/// QS3MultipartUpload
+
+/** Uploads a file in parts with an on-disk journal.
+
+    The journal records the upload id, part size and the ETag of each
+    completed part as they finish. If the process exits during the upload
+    a new QS3Client can continue it with QS3Client::resumeMultipart: the
+    journaled parts are verified with a list parts request and only the
+    missing parts are uploaded. The journal is removed when the upload
+    completes or is aborted.
+
+    Create with QS3Client::putMultipart, QS3Client::resumeMultipart or
+    QS3Client::abortStaleMultipart. Options must be set before control
+    returns to the event loop, the job starts there. */
+class QTS3SHARED_EXPORT QS3MultipartUpload : public QObject, public QS3ResultHandler
+{
+Q_OBJECT
+
+friend class QS3Client;
+
+public:
+    ~QS3MultipartUpload();
+
+    /// Suffix of journal files found by QS3Client::abortStaleMultipart.
+    static const QString JournalSuffix;
+
+    /// Sets the part size in bytes. Default 8 MB, minimum 5 MB.
+    /** Raised automatically so that the file fits in the maximum 10000 parts.
+        Resumed uploads use the part size from the journal. */
+    void setPartSize(qint64 partSize);
+
+    /// Sets the maximum number of concurrent part uploads. Default 4.
+    /** Each ongoing part is held in memory. */
+    void setMaxConcurrent(int maxConcurrent);
+
+    /// Object key.
+    QString key() const;
+
+    /// File being uploaded.
+    QString fileName() const;
+
+    /// Journal file.
+    QString journalFileName() const;
+
+    /// Multipart upload id, empty until the upload has been initiated.
+    QString uploadId() const;
+
+    /// Bytes uploaded in completed parts, including parts completed before resuming.
+    qint64 uploadedBytes() const;
+
+    /// Total bytes to upload.
+    qint64 totalBytes() const;
+
+    /// Returns true when the job has finished.
+    bool isFinished() const;
+
+    /// Returns true if the upload was completed, or aborted for abort jobs.
+    bool succeeded() const;
+
+    /// Error if the job failed. The journal is kept for resuming unless the upload is invalid.
+    QS3Error error() const;
+
+    /// ETag of the completed object.
+    QString eTag() const;
+
+public slots:
+    /// Stops the job. Ongoing part uploads are canceled and finished is emitted.
+    /** The journal is kept, the upload can be resumed later or aborted with QS3Client::abortStaleMultipart. */
+    void cancel();
+
+signals:
+    /// Emitted after each uploaded part.
+    void progress(QS3MultipartUpload *job, qint64 uploadedBytes, qint64 totalBytes);
+
+    /// Emitted once when the job has completed, failed or was canceled.
+    void finished(QS3MultipartUpload *job);
+
+private slots:
+    void start();
+
+private:
+    enum Operation
+    {
+        Upload = 0,
+        Resume,
+        Abort
+    };
+
+    QS3MultipartUpload(QS3Client *client, const QString &key, const QString &fileName, const QString &journalFileName, const QS3FileMetadata &metadata, QS3::CannedAcl cannedAcl);
+    QS3MultipartUpload(QS3Client *client, const QString &journalFileName, Operation operation);
+
+    /// QS3ResultHandler
+    void handleResult(const QS3Result &result);
+
+    void initiate();
+    void onInitiated(const QS3Result &result);
+    void onPartsListed(const QS3Result &result);
+    void onPartUploaded(const QS3Result &result, int partNumber);
+    void onCompleted(const QS3Result &result);
+    void onAborted(const QS3Result &result);
+
+    /// Uploads missing parts up to the concurrency limit, completes when all parts are done.
+    void pump();
+    bool sendPart(int partNumber);
+
+    /// Journal
+    bool readJournal();
+    bool writeJournalHeader();
+    bool appendJournal(const QByteArray &line);
+    void removeJournal();
+
+    /// Returns true if the file is the same that was journaled.
+    bool fileMatchesJournal() const;
+
+    qint64 partLength(int partNumber) const;
+    void computeParts();
+    void fail(const QString &message, const QS3Error &error = QS3Error());
+    void finish();
+
+    enum RequestTag
+    {
+        InitiateRequest = 1,
+        ListRequest,
+        PartRequest,
+        CompleteRequest,
+        AbortRequest
+    };
+
+    QPointer<QS3Client> client_;
+    Operation operation_;
+
+    QString key_;
+    QString fileName_;
+    QString journalFileName_;
+    QString bucket_;
+    QS3FileMetadata metadata_;
+    QS3::CannedAcl cannedAcl_;
+
+    qint64 fileSize_;
+    uint fileModified_;
+    qint64 partSize_;
+    int partCount_;
+    int maxConcurrent_;
+
+    QString uploadId_;
+    QFile *file_;
+    QFile *journal_;
+
+    /// Part ETags from the journal before they are verified, and verified or uploaded parts.
+    QMap<int, QString> journalParts_;
+    QMap<int, QString> completedParts_;
+
+    /// Parts listed from S3 while resuming.
+    QHash<int, QString> listedETags_;
+    QHash<int, qint64> listedSizes_;
+
+    QHash<QS3RequestId, int> ongoing_;
+    QHash<int, int> attempts_;
+    int nextPart_;
+    qint64 uploadedBytes_;
+
+    bool finished_;
+    bool succeeded_;
+    QS3Error error_;
+    QString eTag_;
+};
@@ -0,0 +1,118 @@
+
+#pragma once
+
+#include "QS3API.h"
+#include "QS3Fwd.h"
+#include "QS3Defines.h"
+
+#include <QIODevice>
+#include <QString>
+#include <QCache>
+#include <QHash>
+#include <QSet>
+#include <QPair>
+#include <QPointer>
+
+QT_BEGIN_NAMESPACE
+class QEventLoop;
+QT_END_NAMESPACE
+
+/// QS3ObjectDevice
+
+/** Random access read only QIODevice over an Amazon S3 object.
+
+    Data is fetched with ranged gets in aligned blocks that are kept in
+    a bounded cache. Sequential reads increase the read ahead window and
+    adjacent missing blocks are fetched with a single range request.
+
+    The device is asynchronous like QTcpSocket. Reading returns the data
+    that is available in the cache and readyRead() is emitted when more
+    arrives. Use waitForReadyRead() for blocking reads.
+
+    @code
+    QS3ObjectDevice device(client, "archives/big.zip");
+    device.open(QIODevice::ReadOnly);
+    device.waitForSize();
+    device.seek(device.size() - 200 * 1024);
+    while (device.bytesAvailable() < 200 * 1024 && device.waitForReadyRead()) {}
+    QByteArray index = device.read(200 * 1024);
+    @endcode */
+class QTS3SHARED_EXPORT QS3ObjectDevice : public QIODevice, public QS3ResultHandler
+{
+Q_OBJECT
+
+public:
+    /** @param QS3Client client used for the requests. The client must outlive the device.
+        @param QString object key.
+        @param qint64 object size if already known eg. from a listing, otherwise it is resolved on open. */
+    QS3ObjectDevice(QS3Client *client, const QString &key, qint64 size = -1, QObject *parent = 0);
+    ~QS3ObjectDevice();
+
+    /// Object key.
+    QString key() const;
+
+    /// Sets the cache block size in bytes. Must be called before open. Default 256 KB.
+    void setBlockSize(qint64 blockSize);
+    qint64 blockSize() const;
+
+    /// Sets the maximum cache size in bytes. Default 16 MB.
+    void setCacheSize(qint64 cacheSize);
+    qint64 cacheSize() const;
+
+    /// Sets the maximum read ahead in blocks for sequential reads. Default 16.
+    void setMaxReadAhead(int blocks);
+    int maxReadAhead() const;
+
+    /// Returns true if the object size is known.
+    bool isSizeKnown() const;
+
+    /// Waits until the object size is known.
+    /** @return bool true if the size is known. */
+    bool waitForSize(int msecs = 30000);
+
+    /// QIODevice
+    bool open(OpenMode mode);
+    void close();
+    bool isSequential() const;
+    qint64 size() const;
+    bool seek(qint64 pos);
+    bool atEnd() const;
+    qint64 bytesAvailable() const;
+    bool waitForReadyRead(int msecs);
+
+    /// QS3ResultHandler
+    void handleResult(const QS3Result &result);
+
+protected:
+    qint64 readData(char *data, qint64 maxSize);
+    qint64 writeData(const char *data, qint64 maxSize);
+
+private:
+    /// Requests blocks [first, first+count) that are not cached or already requested.
+    /** Adjacent missing blocks are requested with a single ranged get. */
+    void fetch(qint64 first, int count);
+
+    /// Requests the block at pos and the current read ahead window.
+    void fetchAt(qint64 pos);
+
+    /// Returns number of contiguous cached bytes starting at pos.
+    qint64 cachedBytesAt(qint64 pos) const;
+
+    /// Waits until the request state changes or msecs elapse.
+    bool waitForResult(int msecs);
+
+    QPointer<QS3Client> client_;
+    QString key_;
+    qint64 size_;
+    qint64 blockSize_;
+    int maxReadAhead_;
+    int readAhead_;
+    qint64 lastReadEnd_;
+    bool fetchFailed_;
+
+    QCache<qint64, QByteArray> cache_;
+    QSet<qint64> pendingBlocks_;
+    QHash<QS3RequestId, QPair<qint64, int> > pendingRequests_;
+
+    QEventLoop *waitLoop_;
+};
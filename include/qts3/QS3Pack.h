@@ -0,0 +1,196 @@
+
+#pragma once
+
+#include "QS3API.h"
+#include "QS3Fwd.h"
+#include "QS3Defines.h"
+
+#include <QObject>
+#include <QString>
+#include <QStringList>
+#include <QByteArray>
+#include <QList>
+#include <QHash>
+#include <QSet>
+#include <QPointer>
+
+/// QS3PackMember
+
+/** A file stored in a pack object. */
+class QTS3SHARED_EXPORT QS3PackMember
+{
+public:
+    QS3PackMember();
+
+    /// Member name, unique within the pack.
+    QString name;
+
+    /// Byte offset in the pack object and length.
+    qint64 offset;
+    qint64 length;
+
+    /// SHA-256 of the member data.
+    QByteArray sha256;
+};
+
+/// QS3PackWriter
+
+/** Builds a pack object of many small files.
+
+    Small objects cost a request each to put and get, which dominates the
+    time and price of storing many of them. A pack concatenates the files
+    into one object after an index of their names, offsets, lengths and
+    hashes. Upload pack() with QS3Client::put and read members with
+    QS3PackReader, which fetches them with ranged gets.
+
+    The pack starts with the 8 byte magic "QS3PACK1" and the index size
+    as a big endian 32 bit integer, followed by the index and the data. */
+class QTS3SHARED_EXPORT QS3PackWriter
+{
+public:
+    QS3PackWriter();
+
+    /// Adds a member.
+    /** @param QString member name, must be unique and not empty.
+        @param QByteArray member data.
+        @return bool true if the member was added. */
+    bool add(const QString &name, const QByteArray &data);
+
+    /// Adds a member from the contents of fileName.
+    /** @return bool true if the file was read and the member added. */
+    bool addFile(const QString &name, const QString &fileName);
+
+    /// Number of members.
+    int count() const;
+
+    /// Returns the members, offsets are relative to the start of the pack.
+    QList<QS3PackMember> members() const;
+
+    /// Returns the pack object: header, index and member data.
+    QByteArray pack() const;
+
+    /// Removes all members.
+    void clear();
+
+private:
+    QList<QS3PackMember> members_;
+    QSet<QString> names_;
+    QByteArray data_;
+};
+
+/// QS3PackReader
+
+/** Reads members of a pack object written with QS3PackWriter.
+
+    The index is read once with a ranged get of the beginning of the pack
+    and cached. Requested members are sorted by offset and members that are
+    close to each other are fetched with a single ranged get. Gets requested
+    during the same event loop iteration are combined, so request all the
+    members you need at once. Members are verified against their hash.
+
+    Create with QS3Client::openPack. Members can be requested right away,
+    they are fetched once the index has been read. */
+class QTS3SHARED_EXPORT QS3PackReader : public QObject, public QS3ResultHandler
+{
+Q_OBJECT
+
+friend class QS3Client;
+
+public:
+    ~QS3PackReader();
+
+    /// Sets the maximum bytes between two members that are still fetched with one get. Default 16 KB.
+    /** The bytes in between are downloaded and discarded, larger gaps are worth a separate request. */
+    void setMaxGap(int maxGap);
+
+    /// Sets the maximum size of a single ranged get. Default 8 MB.
+    void setMaxRangeSize(int maxRangeSize);
+
+    /// Key of the pack object.
+    QString key() const;
+
+    /// Returns true when the index has been read.
+    bool isOpen() const;
+
+    /// Member names, empty until the index has been read.
+    QStringList members() const;
+
+    /// Returns true if the pack has a member with name.
+    bool contains(const QString &name) const;
+
+    /// Returns the member with name, length is 0 if there is none.
+    QS3PackMember member(const QString &name) const;
+
+    /// Number of ranged gets sent for members so far.
+    int rangeRequests() const;
+
+public slots:
+    /// Requests members, each one is delivered with received or failed.
+    void get(const QString &name);
+    void get(const QStringList &names);
+
+signals:
+    /// The index has been read.
+    void opened(QS3PackReader *reader);
+
+    /// Member data was received and verified.
+    void received(QS3PackReader *reader, const QString &name, const QByteArray &data);
+
+    /// Member could not be read. The name is empty if the index could not be read.
+    void failed(QS3PackReader *reader, const QString &name, const QString &message);
+
+private slots:
+    void start();
+
+    /// Fetches the requested members.
+    void flush();
+
+private:
+    QS3PackReader(QS3Client *client, const QString &key);
+
+    /// QS3ResultHandler
+    void handleResult(const QS3Result &result);
+
+    /// Reads the index once enough of the pack head has been received.
+    void onHead(const QS3Result &result);
+    void onRange(const QS3Result &result);
+
+    /// Emits received or failed for member from data starting at dataOffset in the pack.
+    void deliver(const QS3PackMember &member, const QByteArray &data, qint64 dataOffset);
+
+    /// Fails the index and all requested members.
+    void failOpen(const QString &message);
+
+    /// Members of one ranged get.
+    struct Range
+    {
+        qint64 offset;
+        qint64 length;
+        QList<QS3PackMember> members;
+    };
+
+    enum RequestTag
+    {
+        HeadRequest = 1,
+        RangeRequest
+    };
+
+    QPointer<QS3Client> client_;
+    QString key_;
+    int maxGap_;
+    int maxRangeSize_;
+
+    /// Beginning of the pack, kept to serve members that were read with the index.
+    QByteArray head_;
+    QString eTag_;
+    QS3RequestId headRequest_;
+    QHash<QString, QS3PackMember> index_;
+    bool open_;
+    bool openFailed_;
+    QString openError_;
+
+    QStringList requested_;
+    bool flushScheduled_;
+    QHash<QS3RequestId, Range> ongoing_;
+    int rangeRequests_;
+};
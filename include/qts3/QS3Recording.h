@@ -0,0 +1,83 @@
+
+#pragma once
+
+#include "QS3API.h"
+#include "QS3Fwd.h"
+#include "QS3Defines.h"
+
+#include <QString>
+#include <QList>
+
+/// QS3RecordedRequest
+
+/** A request of a recorded workload, see QS3Client::startRecording. */
+class QTS3SHARED_EXPORT QS3RecordedRequest
+{
+public:
+    QS3RecordedRequest();
+
+    /// Type of the request.
+    QS3::RequestType type;
+
+    /// Object key, or the prefix of a QS3::ListObjects request.
+    QString key;
+
+    /// Requested byte range of a get, length negative for the rest of the object.
+    qint64 rangeOffset;
+    qint64 rangeLength;
+
+    /// Request and response body sizes.
+    qint64 bytesSent;
+    qint64 bytesReceived;
+
+    /// HTTP response status code, 0 if the request failed without a response.
+    int httpStatusCode;
+
+    /// Microseconds from the start of the recording until the request was issued.
+    qint64 scheduled;
+
+    /// Microseconds from issuing until the request was finished.
+    qint64 duration;
+
+    /// Number of requests in the network when the request was issued.
+    int inflight;
+};
+
+/// QS3Recording
+
+/** Recorded request workload file. QS3Client writes one while recording,
+    the qts3tester replay command reads it to drive the same requests again.
+
+    The file is text: a header line followed by a line per finished request
+    with its times, type, status, concurrency, sizes and the percent encoded key. */
+class QTS3SHARED_EXPORT QS3Recording
+{
+public:
+    QS3Recording();
+    ~QS3Recording();
+
+    /// Creates or truncates fileName and writes the header.
+    /** @return bool true if the file was opened. */
+    bool open(const QString &fileName);
+
+    /// Returns true if the recording file is open.
+    bool isOpen() const;
+
+    /// Appends request to the file.
+    void write(const QS3RecordedRequest &request);
+
+    /// Flushes and closes the file.
+    void close();
+
+    /// Reads all requests of a recording in the order they finished.
+    /** @param QString recording file name.
+        @param QList<QS3RecordedRequest> destination list.
+        @param QString error message if reading fails.
+        @return bool true if the file was read. */
+    static bool read(const QString &fileName, QList<QS3RecordedRequest> &requests, QString &errorMessage);
+
+private:
+    Q_DISABLE_COPY(QS3Recording)
+
+    QFile *file_;
+};
@@ -0,0 +1,144 @@
+
+#pragma once
+
+#include "QS3API.h"
+#include "QS3Fwd.h"
+#include "QS3Defines.h"
+
+#include <QObject>
+#include <QString>
+#include <QByteArray>
+#include <QMap>
+#include <QPointer>
+#include <QIODevice>
+
+/// QS3StreamUpload
+
+/** Uploads data of unknown length from a QIODevice.
+
+    The source is read up to one part. If it ends before that the data is
+    uploaded with a single put, otherwise the upload switches to a multipart
+    upload and each part is sent as soon as it is full. The source is not
+    read while a part is uploading, so at most one part is held in memory.
+    Parts grow so that the 10000 part limit of S3 is not reached.
+
+    Sequential sources such as QProcess or sockets must emit
+    readChannelFinished or be closed when they end, non-sequential sources
+    end at atEnd. If the upload fails after switching to multipart the
+    upload is aborted so that no parts are left behind.
+
+    Create with QS3Client::putStream. Options must be set before control
+    returns to the event loop, the job starts there. */
+class QTS3SHARED_EXPORT QS3StreamUpload : public QObject, public QS3ResultHandler
+{
+Q_OBJECT
+
+friend class QS3Client;
+
+public:
+    ~QS3StreamUpload();
+
+    /// Sets the initial part size in bytes, also the size after which the upload switches to multipart.
+    /** Default 8 MB, minimum 5 MB. The part size is doubled after every 1000 parts. */
+    void setPartSize(qint64 partSize);
+
+    /// Object key.
+    QString key() const;
+
+    /// Bytes read from the source so far.
+    qint64 readBytes() const;
+
+    /// Bytes uploaded in completed puts and parts.
+    qint64 uploadedBytes() const;
+
+    /// Returns true if the upload switched to multipart.
+    bool isMultipart() const;
+
+    /// Returns true when the job has finished.
+    bool isFinished() const;
+
+    /// Returns true if the object was uploaded.
+    bool succeeded() const;
+
+    /// Error if the job failed.
+    QS3Error error() const;
+
+    /// ETag of the uploaded object.
+    QString eTag() const;
+
+public slots:
+    /// Stops the job. Ongoing requests are canceled, a multipart upload is aborted and finished is emitted.
+    void cancel();
+
+signals:
+    /// Emitted after each uploaded part.
+    void progress(QS3StreamUpload *job, qint64 uploadedBytes);
+
+    /// Emitted once when the job has completed, failed or was canceled.
+    void finished(QS3StreamUpload *job);
+
+private slots:
+    void start();
+    void onReadyRead();
+    void onReadChannelFinished();
+
+private:
+    QS3StreamUpload(QS3Client *client, const QString &key, QIODevice *source, const QS3FileMetadata &metadata, QS3::CannedAcl cannedAcl);
+
+    /// QS3ResultHandler
+    void handleResult(const QS3Result &result);
+
+    /// Reads the source into the current part and sends it when full or at the end.
+    void readSource();
+    bool sourceEnded() const;
+
+    /// Size of the part being read.
+    qint64 currentPartSize() const;
+
+    void initiate();
+    void sendPart();
+    void complete();
+    void onInitiated(const QS3Result &result);
+    void onPartUploaded(const QS3Result &result);
+    void onCompleted(const QS3Result &result);
+    void onAborted(const QS3Result &result);
+
+    /// Aborts the multipart upload if there is one and finishes with message.
+    void fail(const QString &message, const QS3Error &error = QS3Error());
+    void finish();
+
+    enum RequestTag
+    {
+        PutRequest = 1,
+        InitiateRequest,
+        PartRequest,
+        CompleteRequest,
+        AbortRequest
+    };
+
+    QPointer<QS3Client> client_;
+    QPointer<QIODevice> source_;
+    QString key_;
+    QS3FileMetadata metadata_;
+    QS3::CannedAcl cannedAcl_;
+    qint64 partSize_;
+
+    /// Data read for the next part, and the part being uploaded.
+    QByteArray buffer_;
+    QByteArray partData_;
+    int partNumber_;
+    int partAttempts_;
+
+    QString uploadId_;
+    QMap<int, QString> completedParts_;
+    QS3RequestId ongoing_;
+
+    bool sourceFinished_;
+    qint64 readBytes_;
+    qint64 uploadedBytes_;
+
+    bool finished_;
+    bool succeeded_;
+    QS3Error error_;
+    QString eTag_;
+};
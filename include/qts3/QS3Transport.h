@@ -0,0 +1,42 @@
+
+#pragma once
+
+#include "QS3API.h"
+#include "QS3Fwd.h"
+
+#include <QObject>
+#include <QByteArray>
+
+/// QS3Transport
+
+/** Sends the HTTP requests of QS3Client.
+
+    QS3Client signs a QNetworkRequest and hands it to its transport, the
+    response is read from the returned QNetworkReply. The built-in
+    transports are selected with QS3Config::transport, a custom one can be
+    set with QS3Client::setTransport.
+
+    Replies must behave like QNetworkAccessManager replies: metaDataChanged
+    when the headers have arrived, readyRead and downloadProgress as the body
+    arrives, uploadProgress, error before finished and finished once, also
+    when aborted. The transport emits finished for each reply it created. */
+class QTS3SHARED_EXPORT QS3Transport : public QObject
+{
+Q_OBJECT
+
+public:
+    QS3Transport(QObject *parent = 0);
+    virtual ~QS3Transport();
+
+    /// Sends request with verb.
+    /** @param QByteArray HTTP verb.
+        @param QNetworkRequest signed request.
+        @param QByteArray body, ignored if device is given.
+        @param QIODevice device to read the body from or null. Must stay valid until the reply finishes.
+        @return QNetworkReply reply or null if the request cannot be sent. */
+    virtual QNetworkReply *send(const QByteArray &verb, const QNetworkRequest &request, const QByteArray &body, QIODevice *device) = 0;
+
+signals:
+    /// Emitted when reply has finished.
+    void finished(QNetworkReply *reply);
+};
@@ -0,0 +1,86 @@
+
+#include "QS3BloomFilter.h"
+
+#include <cmath>
+
+namespace
+{
+    static const double LN2 = 0.69314718055994530942;
+
+    static inline quint64 mix(quint64 x)
+    {
+        // splitmix64 finalizer.
+        x ^= x >> 30;
+        x *= Q_UINT64_C(0xbf58476d1ce4e5b9);
+        x ^= x >> 27;
+        x *= Q_UINT64_C(0x94d049bb133111eb);
+        x ^= x >> 31;
+        return x;
+    }
+}
+
+QS3BloomFilter::QS3BloomFilter(qint64 expectedItems, double falsePositiveRate) :
+    bitCount_(64),
+    hashCount_(1),
+    count_(0)
+{
+    // m = -n ln p / ln2^2 bits and k = m / n ln2 hashes.
+    const double n = qMax<qint64>(1, expectedItems);
+    const double p = qBound(1e-9, falsePositiveRate, 0.5);
+    const double bits = -n * std::log(p) / (LN2 * LN2);
+    bitCount_ = qMax<quint64>(64, static_cast<quint64>(std::ceil(bits / 64.0)) * 64);
+    hashCount_ = qBound(1, static_cast<int>(std::floor(bitCount_ / n * LN2 + 0.5)), 30);
+    bits_.fill(0, static_cast<int>(bitCount_ / 64));
+}
+
+quint64 QS3BloomFilter::hash(const QByteArray &key)
+{
+    // FNV-1a, mixed so that nearby keys spread over the whole range.
+    quint64 h = Q_UINT64_C(0xcbf29ce484222325);
+    const uchar *data = reinterpret_cast<const uchar*>(key.constData());
+    for (int i=0; i<key.size(); ++i)
+    {
+        h ^= data[i];
+        h *= Q_UINT64_C(0x100000001b3);
+    }
+    return mix(h);
+}
+
+void QS3BloomFilter::insert(quint64 hash)
+{
+    const quint64 step = mix(hash ^ Q_UINT64_C(0x9e3779b97f4a7c15)) | 1;
+    for (int i=0; i<hashCount_; ++i)
+    {
+        const quint64 bit = (hash + i * step) % bitCount_;
+        bits_[static_cast<int>(bit >> 6)] |= (Q_UINT64_C(1) << (bit & 63));
+    }
+    count_++;
+}
+
+bool QS3BloomFilter::mayContain(quint64 hash) const
+{
+    const quint64 step = mix(hash ^ Q_UINT64_C(0x9e3779b97f4a7c15)) | 1;
+    for (int i=0; i<hashCount_; ++i)
+    {
+        const quint64 bit = (hash + i * step) % bitCount_;
+        if (!(bits_[static_cast<int>(bit >> 6)] & (Q_UINT64_C(1) << (bit & 63))))
+            return false;
+    }
+    return true;
+}
+
+qint64 QS3BloomFilter::count() const
+{
+    return count_;
+}
+
+qint64 QS3BloomFilter::sizeBytes() const
+{
+    return static_cast<qint64>(bitCount_ / 8);
+}
+
+double QS3BloomFilter::falsePositiveRate() const
+{
+    // (1 - e^(-kn/m))^k
+    return std::pow(1.0 - std::exp(-hashCount_ * static_cast<double>(count_) / bitCount_), hashCount_);
+}
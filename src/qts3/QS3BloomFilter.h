@@ -0,0 +1,38 @@
+
+#pragma once
+
+#include <QtGlobal>
+#include <QByteArray>
+#include <QVector>
+
+/// QS3BloomFilter
+
+/** Bloom filter over 64 bit key hashes. Never reports a false negative,
+    the false positive rate is set by the expected number of items. The
+    bit positions are derived from the one hash with double hashing. */
+class QS3BloomFilter
+{
+public:
+    QS3BloomFilter(qint64 expectedItems, double falsePositiveRate);
+
+    /// Returns the 64 bit hash of key.
+    static quint64 hash(const QByteArray &key);
+
+    void insert(quint64 hash);
+    bool mayContain(quint64 hash) const;
+
+    /// Number of inserted items.
+    qint64 count() const;
+
+    /// Size of the bit array in bytes.
+    qint64 sizeBytes() const;
+
+    /// Estimated false positive rate with the current number of items.
+    double falsePositiveRate() const;
+
+private:
+    QVector<quint64> bits_;
+    quint64 bitCount_;
+    int hashCount_;
+    qint64 count_;
+};
@@ -0,0 +1,133 @@
+
+#include "QS3BufferPool.h"
+
+namespace
+{
+    // 4 KB to 8 MB.
+    static const int MIN_CLASS_SHIFT = 12;
+    static const int MAX_CLASS_SHIFT = 23;
+}
+
+QS3BufferPool::Statistics::Statistics() :
+    hits(0),
+    misses(0),
+    returned(0),
+    discarded(0),
+    pooledBytes(0)
+{
+}
+
+QS3BufferPool::QS3BufferPool(qint64 maxPooledBytes, QObject *parent) :
+    QObject(parent),
+    free_(MAX_CLASS_SHIFT - MIN_CLASS_SHIFT + 1),
+    maxPooledBytes_(qMax<qint64>(0, maxPooledBytes))
+{
+}
+
+QS3BufferPool::~QS3BufferPool()
+{
+}
+
+int QS3BufferPool::sizeClass(int size)
+{
+    int shift = MIN_CLASS_SHIFT;
+    while (shift <= MAX_CLASS_SHIFT && (1 << shift) < size)
+        shift++;
+    return shift <= MAX_CLASS_SHIFT ? shift - MIN_CLASS_SHIFT : -1;
+}
+
+int QS3BufferPool::classCapacity(int sizeClass)
+{
+    return 1 << (sizeClass + MIN_CLASS_SHIFT);
+}
+
+QByteArray QS3BufferPool::acquire(int size)
+{
+    size = qMax(0, size);
+    const int index = sizeClass(size);
+    if (index < 0)
+    {
+        stats_.misses++;
+        QByteArray buffer;
+        buffer.resize(size);
+        return buffer;
+    }
+
+    QByteArray buffer;
+    if (!free_[index].isEmpty())
+    {
+        buffer = free_[index].takeLast();
+        stats_.pooledBytes -= classCapacity(index);
+        stats_.hits++;
+    }
+    else
+    {
+        // Reserved arrays keep their allocation when resized within the capacity.
+        buffer.reserve(classCapacity(index));
+        stats_.misses++;
+    }
+    if (size > 0)
+        buffer.resize(size);
+    return buffer;
+}
+
+void QS3BufferPool::release(QByteArray &buffer)
+{
+    // Another holder returns the buffer when it is done with it.
+    if (!buffer.isDetached())
+    {
+        buffer = QByteArray();
+        return;
+    }
+
+    // Pooled buffers are kept non-empty, resizing to zero would free the allocation.
+    const int index = (buffer.size() > 0 ? sizeClass(buffer.capacity()) : -1);
+    if (index < 0 || buffer.capacity() != classCapacity(index) || stats_.pooledBytes + classCapacity(index) > maxPooledBytes_)
+    {
+        if (!buffer.isNull())
+            stats_.discarded++;
+        buffer = QByteArray();
+        return;
+    }
+
+    free_[index].append(buffer);
+    stats_.pooledBytes += classCapacity(index);
+    stats_.returned++;
+    buffer = QByteArray();
+}
+
+void QS3BufferPool::setMaxPooledBytes(qint64 maxPooledBytes)
+{
+    maxPooledBytes_ = qMax<qint64>(0, maxPooledBytes);
+    trim();
+}
+
+qint64 QS3BufferPool::maxPooledBytes() const
+{
+    return maxPooledBytes_;
+}
+
+QS3BufferPool::Statistics QS3BufferPool::statistics() const
+{
+    return stats_;
+}
+
+void QS3BufferPool::clear()
+{
+    for (int i = 0; i < free_.size(); ++i)
+        free_[i].clear();
+    stats_.pooledBytes = 0;
+}
+
+void QS3BufferPool::trim()
+{
+    // Largest buffers go first.
+    for (int i = free_.size() - 1; i >= 0 && stats_.pooledBytes > maxPooledBytes_; --i)
+    {
+        while (!free_[i].isEmpty() && stats_.pooledBytes > maxPooledBytes_)
+        {
+            free_[i].removeLast();
+            stats_.pooledBytes -= classCapacity(i);
+        }
+    }
+}
@@ -0,0 +1,266 @@
+
+#include "QS3BulkAclJob.h"
+#include "QS3Client.h"
+
+#include <QTimer>
+#include <QDebug>
+
+#include <cstdlib>
+
+namespace
+{
+    static const uint MIN_PAGE_SIZE = 100;
+    static const uint MAX_PAGE_SIZE = 1000;
+}
+
+QS3BulkAclJob::QS3BulkAclJob(QS3Client *client, const QString &prefix, QS3::CannedAcl cannedAcl) :
+    QObject(client),
+    client_(client),
+    prefix_(prefix),
+    cannedAcl_(cannedAcl),
+    maxConcurrent_(16),
+    maxQueued_(5000),
+    verifySampleRate_(0.0),
+    listing_(0),
+    pageSize_(MIN_PAGE_SIZE),
+    listingDone_(false),
+    finished_(false),
+    listed_(0),
+    updated_(0),
+    skipped_(0)
+{
+    QTimer::singleShot(0, this, SLOT(start()));
+}
+
+QS3BulkAclJob::~QS3BulkAclJob()
+{
+    if (client_)
+    {
+        foreach(QS3RequestId id, ongoing_.keys())
+            client_->cancel(id);
+        if (listing_)
+        {
+            disconnect(listing_, 0, this, 0);
+            listing_->cancel();
+        }
+    }
+}
+
+void QS3BulkAclJob::setMaxConcurrent(int maxConcurrent)
+{
+    maxConcurrent_ = qMax(1, maxConcurrent);
+}
+
+void QS3BulkAclJob::setMaxQueued(int maxQueued)
+{
+    maxQueued_ = qMax(1, maxQueued);
+}
+
+void QS3BulkAclJob::setVerifySampleRate(qreal rate)
+{
+    verifySampleRate_ = qBound<qreal>(0.0, rate, 1.0);
+}
+
+QString QS3BulkAclJob::prefix() const
+{
+    return prefix_;
+}
+
+QS3::CannedAcl QS3BulkAclJob::cannedAcl() const
+{
+    return cannedAcl_;
+}
+
+int QS3BulkAclJob::listed() const
+{
+    return listed_;
+}
+
+int QS3BulkAclJob::updated() const
+{
+    return updated_;
+}
+
+int QS3BulkAclJob::skipped() const
+{
+    return skipped_;
+}
+
+int QS3BulkAclJob::processed() const
+{
+    return updated_ + skipped_ + failures_.size();
+}
+
+QHash<QString, QS3Error> QS3BulkAclJob::failures() const
+{
+    return failures_;
+}
+
+bool QS3BulkAclJob::isFinished() const
+{
+    return finished_;
+}
+
+void QS3BulkAclJob::start()
+{
+    if (finished_)
+        return;
+    if (!client_)
+    {
+        QS3Error error;
+        error.error = "QS3Client was destroyed before the job started.";
+        failures_[prefix_] = error;
+        finish();
+        return;
+    }
+    runTimer_.start();
+    listNextPage();
+}
+
+void QS3BulkAclJob::cancel()
+{
+    if (finished_)
+        return;
+
+    if (client_)
+    {
+        foreach(QS3RequestId id, ongoing_.keys())
+            client_->cancel(id);
+    }
+    ongoing_.clear();
+    queue_.clear();
+
+    // The listing response is destroyed with the client.
+    if (client_ && listing_)
+    {
+        disconnect(listing_, 0, this, 0);
+        listing_->cancel();
+    }
+    listing_ = 0;
+    listingDone_ = true;
+    finish();
+}
+
+void QS3BulkAclJob::listNextPage()
+{
+    if (listing_ || listingDone_ || !client_)
+        return;
+
+    listing_ = client_->listObjectsPage(prefix_, marker_, "", qMin<uint>(pageSize_, maxQueued_));
+    if (!listing_)
+    {
+        listingDone_ = true;
+        return;
+    }
+    connect(listing_, SIGNAL(finished(QS3ListObjectsResponse*)), SLOT(onListObjects(QS3ListObjectsResponse*)));
+    listTimer_.start();
+}
+
+void QS3BulkAclJob::tunePageSize(qint64 listMsecs)
+{
+    // Keys processed while the next page is listed, doubled for headroom. Slow consumers
+    // get small pages that keep memory low, fast ones full pages that need fewer requests.
+    qint64 elapsed = runTimer_.elapsed();
+    if (elapsed <= 0 || processed() == 0)
+        return;
+    qint64 wanted = 2 * listMsecs * processed() / elapsed;
+    pageSize_ = static_cast<uint>(qBound<qint64>(MIN_PAGE_SIZE, wanted, MAX_PAGE_SIZE));
+}
+
+void QS3BulkAclJob::onListObjects(QS3ListObjectsResponse *response)
+{
+    if (response != listing_)
+        return;
+    listing_ = 0;
+    tunePageSize(listTimer_.elapsed());
+
+    if (!response->succeeded)
+    {
+        failures_[prefix_] = response->error;
+        listingDone_ = true;
+    }
+    else
+    {
+        foreach(const QS3Object &object, response->objects)
+            queue_.enqueue(object.key);
+        listed_ += response->objects.size();
+
+        if (response->isTruncated && !response->objects.isEmpty())
+            marker_ = response->lastKey();
+        else
+            listingDone_ = true;
+    }
+    pump();
+}
+
+void QS3BulkAclJob::pump()
+{
+    if (finished_)
+        return;
+
+    while (client_ && ongoing_.size() < maxConcurrent_ && !queue_.isEmpty())
+    {
+        QString key = queue_.dequeue();
+        bool verify = verifySampleRate_ > 0.0 && (static_cast<qreal>(qrand()) / RAND_MAX) < verifySampleRate_;
+
+        QS3RequestId id = verify ? client_->getAcl(key, this, VerifyRequest) : client_->setCannedAcl(key, cannedAcl_, this, SetRequest);
+        if (id == 0)
+        {
+            QS3Error error;
+            error.error = "Invalid key or canned ACL.";
+            failures_[key] = error;
+            continue;
+        }
+        ongoing_[id] = key;
+    }
+
+    // Keep the queue filled while it drains, but bounded.
+    if (queue_.size() < maxQueued_ / 2 && !listingDone_)
+        listNextPage();
+
+    if (listingDone_ && !listing_ && queue_.isEmpty() && ongoing_.isEmpty())
+        finish();
+}
+
+void QS3BulkAclJob::handleResult(const QS3Result &result)
+{
+    if (!ongoing_.contains(result.id))
+        return;
+    QString key = ongoing_.take(result.id);
+
+    if (result.tag == VerifyRequest)
+    {
+        QS3Acl acl;
+        QString errorMessage;
+        if (result.succeeded && result.parseAcl(acl, errorMessage) && acl.matchesCannedAcl(cannedAcl_))
+            skipped_++;
+        else
+        {
+            // Could not verify or does not match, set it.
+            QS3RequestId id = client_ ? client_->setCannedAcl(key, cannedAcl_, this, SetRequest) : 0;
+            if (id != 0)
+            {
+                ongoing_[id] = key;
+                return;
+            }
+            QS3Error error;
+            error.error = (client_ ? "Invalid key or canned ACL." : "QS3Client was destroyed before the job finished.");
+            failures_[key] = error;
+        }
+    }
+    else if (result.succeeded)
+        updated_++;
+    else
+        failures_[key] = result.error;
+
+    emit progress(this, processed(), listed_);
+    pump();
+}
+
+void QS3BulkAclJob::finish()
+{
+    if (finished_)
+        return;
+    finished_ = true;
+    emit finished(this);
+}
@@ -2,30 +2,100 @@
 #include "QS3Client.h"
 #include "QS3Internal.h"
 #include "QS3Xml.h"
+#include "QS3Request.h"
+#include "QS3BulkAclJob.h"
+#include "QS3ExistenceIndex.h"
+#include "QS3GetManyJob.h"
+#include "QS3Pack.h"
+#include "QS3MultipartUpload.h"
+#include "QS3StreamUpload.h"
+#include "QS3Crypto.h"
+#include "QS3SignerV4.h"
+#include "QS3RateLimiter.h"
+#include "QS3ConcurrencyLimiter.h"
+#include "QS3LatencyTracker.h"
+#include "QS3BufferPool.h"
+#include "QS3Tracer.h"
+#include "QS3Recording.h"
+#include "QS3NetworkTransport.h"
+#include "QS3HttpEngine.h"
 
 #include <QUrl>
 #include <QString>
 #include <QStringList>
-#include <QNetworkAccessManager>
 #include <QNetworkRequest>
 #include <QNetworkReply>
 #include <QFile>
+#include <QDateTime>
 #include <QDebug>
+#include <QDir>
+#include <QFileInfo>
 #include <QMimeData>
+#include <QTimer>
+
+#include <climits>
+#include <cstring>
+#include <ctime>
+
+#ifdef Q_OS_UNIX
+#include <sys/mman.h>
+#endif
  
 QS3Client::QS3Client(const QS3Config &config, QObject *parent) :
     QObject(parent),
     config_(config),
-    network_(new QNetworkAccessManager(this))
+    transport_(0),
+    signer_(new QS3HmacSha1(config.secredKey.toUtf8())),
+    signerV4_(0),
+    dateTime_(0),
+    nextRequestId_(1),
+    concurrency_(0),
+    priority_(QS3::NormalPriority),
+    bufferPool_(new QS3BufferPool(config.bufferPoolBytes, this)),
+    latencies_(new QS3LatencyTracker()),
+    hedgeTimer_(new QTimer(this)),
+    hedgeCredit_(0.0),
+    requestTimeout_(config.requestTimeout),
+    stallTimeout_(config.stallTimeout),
+    timeoutTimer_(new QTimer(this)),
+    throttleTimer_(new QTimer(this)),
+    tracer_(0),
+    recording_(0),
+    recordingStart_(0)
 {
     QS3::initStaticData();
+    updateRequestTemplate();
+
+    if (config_.signatureVersion == QS3Config::SignatureV4)
+        signerV4_ = new QS3SignerV4(config_.accessKey.toUtf8(), config_.secredKey.toUtf8(), config_.region.toUtf8());
+
+    for (int direction=0; direction<2; ++direction)
+        for (int i=0; i<4; ++i)
+            limiters_[direction][i] = new QS3RateLimiter();
+
+    if (config_.adaptiveConcurrency)
+        concurrency_ = new QS3ConcurrencyLimiter(config_.initialConcurrency, config_.maxConcurrency);
+
+    clock_.start();
+    timeoutTimer_->setInterval(250);
+    connect(timeoutTimer_, SIGNAL(timeout()), this, SLOT(onTimeoutTimer()));
+
+    hedgeTimer_->setInterval(5);
+    connect(hedgeTimer_, SIGNAL(timeout()), this, SLOT(onHedgeTimer()));
+
+    throttleTimer_->setInterval(20);
+    connect(throttleTimer_, SIGNAL(timeout()), this, SLOT(onThrottleTimer()));
 
-    connect(network_, SIGNAL(finished(QNetworkReply*)), this, SLOT(onReply(QNetworkReply*)));
+    if (config_.transport == QS3Config::NativeTransport)
+        transport_ = new QS3HttpEngine(config_, this);
+    else
+        transport_ = new QS3NetworkTransport(this);
+    connect(transport_, SIGNAL(finished(QNetworkReply*)), this, SLOT(onReply(QNetworkReply*)));
 }
 
 QS3Client::~QS3Client()
 {
-    disconnect(network_, SIGNAL(finished(QNetworkReply*)), this, SLOT(onReply(QNetworkReply*)));
+    disconnect(transport_, SIGNAL(finished(QNetworkReply*)), this, SLOT(onReply(QNetworkReply*)));
     
     foreach(QNetworkReply *ongoingReply, requests_.keys())
     {
@@ -33,16 +103,64 @@ QS3Client::~QS3Client()
             continue;
         ongoingReply->abort();
         ongoingReply->deleteLater();
-        QS3Response *ongoingResponse = requests_[ongoingReply];
-        if (ongoingResponse)
-            delete ongoingResponse;
+        QList<QS3Request*> ongoingRequests = followers_.values(ongoingReply);
+        ongoingRequests << requests_[ongoingReply];
+        foreach(QS3Request *ongoingRequest, ongoingRequests)
+        {
+            if (!ongoingRequest)
+                continue;
+            if (ongoingRequest->response)
+                delete ongoingRequest->response;
+            delete ongoingRequest;
+        }
+    }
+    // Hedges that are not the mapped reply of their request.
+    foreach(QNetworkReply *hedgeReply, hedges_.keys())
+    {
+        if (requests_.contains(hedgeReply))
+            continue;
+        hedgeReply->abort();
+        hedgeReply->deleteLater();
+    }
+    foreach(QS3Request *unsentRequest, unsent_)
+    {
+        if (unsentRequest->response)
+            delete unsentRequest->response;
+        delete unsentRequest;
     }
+    unsent_.clear();
     requests_.clear();
+    followers_.clear();
+    inflight_.clear();
+    throttled_.clear();
+    hedges_.clear();
+    hedgeCandidates_.clear();
+    delete latencies_;
+
+    if (concurrency_)
+    {
+        foreach(QS3Request *queuedRequest, concurrency_->takeAll())
+        {
+            if (queuedRequest->response)
+                delete queuedRequest->response;
+            delete queuedRequest;
+        }
+        delete concurrency_;
+    }
+
+    delete signer_;
+    delete signerV4_;
+    delete tracer_;
+    delete recording_;
+    for (int direction=0; direction<2; ++direction)
+        for (int i=0; i<4; ++i)
+            delete limiters_[direction][i];
 }
 
 void QS3Client::setBucket(const QString &bucket)
 {
     config_.bucket = bucket;
+    updateRequestTemplate();
 }
 
 QString QS3Client::bucket() const
@@ -51,35 +169,125 @@ QString QS3Client::bucket() const
 }
 
 QS3ListObjectsResponse *QS3Client::listObjects(const QString &prefix, const QString &delimiter, uint maxObjects)
+{
+    return startListObjects(prefix, delimiter, maxObjects, false, "", true);
+}
+
+QS3ListObjectsResponse *QS3Client::listObjectsCompact(const QString &prefix, const QString &delimiter, uint maxObjects)
+{
+    return startListObjects(prefix, delimiter, maxObjects, true, "", true);
+}
+
+QS3ListObjectsResponse *QS3Client::listObjectsPage(const QString &prefix, const QString &marker, const QString &delimiter, uint maxObjects)
+{
+    return startListObjects(prefix, delimiter, maxObjects, false, marker, false);
+}
+
+QS3ListObjectsResponse *QS3Client::browse(const QString &folder, uint maxObjects)
+{
+    // Keys have no leading slash, the root is listed with an empty prefix.
+    QString prefix = folder;
+    while (prefix.startsWith(QS3::ROOT_PATH))
+        prefix.remove(0, 1);
+    if (!prefix.isEmpty() && !prefix.endsWith(QS3::ROOT_PATH))
+        prefix += QS3::ROOT_PATH;
+    return startListObjects(prefix, QS3::ROOT_PATH, maxObjects, false, "", true);
+}
+
+QS3ExistenceIndex *QS3Client::buildExistenceIndex(const QString &prefix, double falsePositiveRate)
+{
+    if (falsePositiveRate <= 0.0 || falsePositiveRate >= 1.0)
+    {
+        qDebug() << "QS3Client::buildExistenceIndex() Error: False positive rate must be between 0 and 1:" << falsePositiveRate;
+        return 0;
+    }
+    QS3ExistenceIndex *index = new QS3ExistenceIndex(this, prefix, falsePositiveRate);
+    existenceIndexes_ << index;
+    return index;
+}
+
+QS3::Existence QS3Client::exists(const QString &key) const
+{
+    // Any index that rules the key out is enough, indexes only miss keys as false positives.
+    QS3::Existence existence = QS3::ExistenceUnknown;
+    foreach(const QPointer<QS3ExistenceIndex> &index, existenceIndexes_)
+    {
+        if (!index)
+            continue;
+        QS3::Existence indexed = index->exists(key);
+        if (indexed == QS3::DoesNotExist)
+            return indexed;
+        if (indexed == QS3::MayExist)
+            existence = indexed;
+    }
+    return existence;
+}
+
+QS3ListObjectsResponse *QS3Client::startListObjects(const QString &prefix, const QString &delimiter, uint maxObjects, bool compact, const QString &marker, bool autoContinue)
 {
     Q3SQueryParams params;
-    if (!prefix.isEmpty()) params["prefix"] = prefix;
-    if (!delimiter.isEmpty()) params["delimiter"] = delimiter;
     if (maxObjects > 0) params["max-keys"] = QString::number(maxObjects);
+    if (config_.listObjectsV2)
+    {
+        params["list-type"] = "2";
+        params["fetch-owner"] = "false";
+        params["encoding-type"] = "url";
+    }
 
     QS3UrlPair info = generateUrl(QS3::ROOT_PATH, params);
-    QNetworkRequest request(info.second);
-    prepareRequest(&request, "GET");
-    QNetworkReply *reply = network_->get(request);
-
-    QS3ListObjectsResponse *response = new QS3ListObjectsResponse(info.first, request.url(), prefix);
-    requests_[reply] = response;
+    QUrl url = info.second;
+    if (!prefix.isEmpty())
+        QS3::setEncodedQuery(&url, "prefix", prefix);
+    if (!delimiter.isEmpty())
+        QS3::setEncodedQuery(&url, "delimiter", delimiter);
+    if (!marker.isEmpty())
+        QS3::setEncodedQuery(&url, config_.listObjectsV2 ? "start-after" : "marker", marker);
+
+    QS3Request *request = new QS3Request(QS3::ListObjects, info.first, "GET", QNetworkRequest(url));
+    QS3ListObjectsResponse *response = new QS3ListObjectsResponse(info.first, url, prefix, compact);
+    response->autoContinue = autoContinue;
+    response->v2 = config_.listObjectsV2;
+    request->response = response;
+    send(request);
 
     return response;
 }
 
-void QS3Client::listObjectsContinue(QS3ListObjectsResponse *response)
+void QS3Client::listObjectsContinue(QS3Request *request)
 {
-    QS3::addOrReplaceQuery(&response->url, "marker", response->objects.last().key);
+    QS3ListObjectsResponse *response = qobject_cast<QS3ListObjectsResponse*>(request->response);
+    if (response->v2)
+    {
+        // The token replaces start-after, S3 ignores start-after when a token is given.
+        response->url.removeAllQueryItems("start-after");
+        QS3::setEncodedQuery(&response->url, "continuation-token", response->nextContinuationToken);
+    }
+    else
+        QS3::setEncodedQuery(&response->url, "marker", response->lastKey());
+    request->request = QNetworkRequest(request->response->url);
+    discardReceived(request);
+    send(request);
+}
+
+QS3RemoveObjectResponse *QS3Client::remove(const QString &key)
+{
+    QS3Request *request = createRemoveRequest(key);
+    if (!request)
+        return 0;
+
+    QS3RemoveObjectResponse *response = new QS3RemoveObjectResponse(request->key, request->request.url());
+    request->response = response;
+    send(request);
 
-    QNetworkRequest request(response->url);
-    prepareRequest(&request, "GET");
-    QNetworkReply *reply = network_->get(request);
+    return response;
+}
 
-    requests_[reply] = response;
+QS3RequestId QS3Client::remove(const QString &key, QS3ResultHandler *handler, quint64 tag)
+{
+    return send(createRemoveRequest(key), handler, tag);
 }
 
-QS3RemoveObjectResponse *QS3Client::remove(const QString &key)
+QS3Request *QS3Client::createRemoveRequest(const QString &key)
 {
     if (key.trimmed().isEmpty() || key.trimmed() == QS3::ROOT_PATH)
     {
@@ -88,14 +296,7 @@ QS3RemoveObjectResponse *QS3Client::remove(const QString &key)
     }
 
     QS3UrlPair info = generateUrl(key);
-    QNetworkRequest request(info.second);
-    prepareRequest(&request, "DELETE");
-    QNetworkReply *reply = network_->deleteResource(request);
-
-    QS3RemoveObjectResponse *response = new QS3RemoveObjectResponse(info.first, request.url());
-    requests_[reply] = response;
-
-    return response;
+    return new QS3Request(QS3::RemoveObject, info.first, "DELETE", QNetworkRequest(info.second));
 }
 
 QS3CopyObjectResponse *QS3Client::copy(const QString &sourceKey, const QString &destinationKey, QS3::CannedAcl cannedAcl)
@@ -104,6 +305,24 @@ QS3CopyObjectResponse *QS3Client::copy(const QString &sourceKey, const QString &
 }
 
 QS3CopyObjectResponse *QS3Client::copy(const QString &sourceBucket, const QString &sourceKey, const QString &destinationKey, QS3::CannedAcl cannedAcl)
+{
+    QS3Request *request = createCopyRequest(sourceBucket, sourceKey, destinationKey, cannedAcl);
+    if (!request)
+        return 0;
+
+    QS3CopyObjectResponse *response = new QS3CopyObjectResponse(request->key, request->request.url());
+    request->response = response;
+    send(request);
+
+    return response;
+}
+
+QS3RequestId QS3Client::copy(const QString &sourceKey, const QString &destinationKey, QS3::CannedAcl cannedAcl, QS3ResultHandler *handler, quint64 tag)
+{
+    return send(createCopyRequest(config_.bucket, sourceKey, destinationKey, cannedAcl), handler, tag);
+}
+
+QS3Request *QS3Client::createCopyRequest(const QString &sourceBucket, const QString &sourceKey, const QString &destinationKey, QS3::CannedAcl cannedAcl)
 {
     if (sourceKey.trimmed().isEmpty() || sourceKey.trimmed() == QS3::ROOT_PATH)
     {
@@ -143,16 +362,38 @@ QS3CopyObjectResponse *QS3Client::copy(const QString &sourceBucket, const QStrin
         request.setRawHeader(QS3::AMAZON_HEADER_ACL, aclHeader);
     request.setRawHeader(QS3::AMAZON_HEADER_COPY_SOURCE, source.toUtf8());
 
-    prepareRequest(&request, "PUT");
-    QNetworkReply *reply = network_->put(request, "");
+    return new QS3Request(QS3::CopyObject, info.first, "PUT", request);
+}
+
+QS3GetObjectResponse *QS3Client::get(const QString &key)
+{
+    return get(key, 0, -1);
+}
 
-    QS3CopyObjectResponse *response = new QS3CopyObjectResponse(info.first, request.url());
-    requests_[reply] = response;
+QS3GetObjectResponse *QS3Client::get(const QString &key, qint64 offset, qint64 length)
+{
+    QS3Request *request = createGetRequest(key, offset, length);
+    if (!request)
+        return 0;
 
+    QS3GetObjectResponse *response = new QS3GetObjectResponse(request->key, request->request.url());
+    request->response = response;
+    send(request);
+    
     return response;
 }
 
-QS3GetObjectResponse *QS3Client::get(const QString &key)
+QS3RequestId QS3Client::get(const QString &key, QS3ResultHandler *handler, quint64 tag)
+{
+    return send(createGetRequest(key), handler, tag);
+}
+
+QS3RequestId QS3Client::get(const QString &key, qint64 offset, qint64 length, QS3ResultHandler *handler, quint64 tag)
+{
+    return send(createGetRequest(key, offset, length), handler, tag);
+}
+
+QS3Request *QS3Client::createGetRequest(const QString &key, qint64 offset, qint64 length)
 {
     if (key.trimmed().isEmpty() || key.trimmed() == QS3::ROOT_PATH)
     {
@@ -164,17 +405,21 @@ QS3GetObjectResponse *QS3Client::get(const QString &key)
         qDebug() << "QS3Client::get() Error: Key cannot end with \"/\". Cannot get folders.";
         return 0;
     }
+    if (offset < 0 || length == 0)
+    {
+        qDebug() << "QS3Client::get() Error: Invalid byte range offset" << offset << "length" << length;
+        return 0;
+    }
 
     QS3UrlPair info = generateUrl(key);
     QNetworkRequest request(info.second);
-    prepareRequest(&request, "GET");
-    QNetworkReply *reply = network_->get(request);
+    if (offset > 0 || length > 0)
+        request.setRawHeader(QS3::STANDARD_HEADER_RANGE, QS3::generateRangeHeader(offset, length));
 
-    QS3GetObjectResponse *response = new QS3GetObjectResponse(info.first, request.url());
-    connect(reply, SIGNAL(downloadProgress(qint64, qint64)), response, SLOT(downloadProgress(qint64, qint64)));
-    requests_[reply] = response;
-    
-    return response;
+    QS3Request *s3request = new QS3Request(QS3::GetObject, info.first, "GET", request);
+    s3request->rangeOffset = offset;
+    s3request->rangeLength = length;
+    return s3request;
 }
 
 QS3PutObjectResponse *QS3Client::put(const QString &key, QFile *file, const QS3FileMetadata &metadata, QS3::CannedAcl cannedAcl)
@@ -200,6 +445,19 @@ QS3PutObjectResponse *QS3Client::put(const QString &key, QFile *file, const QS3F
         qDebug() << "QS3Client::put() Error: Input QFile does not exist on disk:" << file->fileName();
         return 0;
     }
+    if (config_.memoryMapUploads && file->size() > 0)
+    {
+        QS3Request *request = createMappedPutRequest(key, file->fileName(), metadata, cannedAcl);
+        if (request)
+        {
+            QS3PutObjectResponse *response = new QS3PutObjectResponse(request->key, request->request.url());
+            request->response = response;
+            send(request);
+            return response;
+        }
+        qDebug() << "QS3Client::put() Warning: Failed to memory map" << file->fileName() << "reading it to memory instead.";
+    }
+
     if (!file->open(QIODevice::ReadOnly))
     {
         qDebug() << "QS3Client::put() Error: Input QFile could not be opened in read only mode.";
@@ -211,7 +469,59 @@ QS3PutObjectResponse *QS3Client::put(const QString &key, QFile *file, const QS3F
     return put(key, data, metadata, cannedAcl);
 }
 
+QS3Request *QS3Client::createMappedPutRequest(const QString &key, const QString &fileName, const QS3FileMetadata &metadata, QS3::CannedAcl cannedAcl)
+{
+    // Map with a separate file handle that the request owns, the callers QFile may go away during the upload.
+    QFile *mappedFile = new QFile(fileName);
+    if (!mappedFile->open(QIODevice::ReadOnly))
+    {
+        delete mappedFile;
+        return 0;
+    }
+    const qint64 size = mappedFile->size();
+    uchar *mappedData = (size > 0 && size <= INT_MAX ? mappedFile->map(0, size) : 0);
+    if (!mappedData)
+    {
+        delete mappedFile;
+        return 0;
+    }
+#ifdef Q_OS_UNIX
+    posix_madvise(mappedData, static_cast<size_t>(size), POSIX_MADV_SEQUENTIAL);
+#endif
+
+    // The network layer reads straight from the mapping, no copy of the file contents is made.
+    QByteArray data = QByteArray::fromRawData(reinterpret_cast<const char*>(mappedData), static_cast<int>(size));
+    QS3Request *request = createPutRequest(key, data, metadata, cannedAcl);
+    if (!request)
+    {
+        data.clear();
+        mappedFile->unmap(mappedData);
+        delete mappedFile;
+        return 0;
+    }
+    request->mapping = new QS3FileMapping(mappedFile, mappedData);
+    return request;
+}
+
 QS3PutObjectResponse *QS3Client::put(const QString &key, const QByteArray &data, const QS3FileMetadata &metadata, QS3::CannedAcl cannedAcl)
+{
+    QS3Request *request = createPutRequest(key, data, metadata, cannedAcl);
+    if (!request)
+        return 0;
+
+    QS3PutObjectResponse *response = new QS3PutObjectResponse(request->key, request->request.url());
+    request->response = response;
+    send(request);
+
+    return response;
+}
+
+QS3RequestId QS3Client::put(const QString &key, const QByteArray &data, const QS3FileMetadata &metadata, QS3::CannedAcl cannedAcl, QS3ResultHandler *handler, quint64 tag)
+{
+    return send(createPutRequest(key, data, metadata, cannedAcl), handler, tag);
+}
+
+QS3Request *QS3Client::createPutRequest(const QString &key, const QByteArray &data, const QS3FileMetadata &metadata, QS3::CannedAcl cannedAcl)
 {
     if (key.trimmed().isEmpty() || key.trimmed() == QS3::ROOT_PATH)
     {
@@ -248,14 +558,9 @@ QS3PutObjectResponse *QS3Client::put(const QString &key, const QByteArray &data,
     if (!aclHeader.isEmpty())
         request.setRawHeader(QS3::AMAZON_HEADER_ACL, aclHeader);
 
-    prepareRequest(&request, "PUT");
-    QNetworkReply *reply = network_->put(request, data);
-
-    QS3PutObjectResponse *response = new QS3PutObjectResponse(info.first, request.url());
-    connect(reply, SIGNAL(uploadProgress(qint64, qint64)), response, SLOT(uploadProgress(qint64, qint64)));
-    requests_[reply] = response;
-
-    return response;
+    QS3Request *s3request = new QS3Request(QS3::PutObject, info.first, "PUT", request);
+    s3request->body = data;
+    return s3request;
 }
 
 QS3PutObjectResponse *QS3Client::createFolder(const QString &key, QS3::CannedAcl cannedAcl)
@@ -286,33 +591,58 @@ QS3PutObjectResponse *QS3Client::createFolder(const QString &key, QS3::CannedAcl
     if (!aclHeader.isEmpty())
         request.setRawHeader(QS3::AMAZON_HEADER_ACL, aclHeader);
 
-    prepareRequest(&request, "PUT");
-    QNetworkReply *reply = network_->put(request, "");
-
     QS3PutObjectResponse *response = new QS3PutObjectResponse(info.first, request.url());
-    connect(reply, SIGNAL(uploadProgress(qint64, qint64)), response, SLOT(uploadProgress(qint64, qint64)));
-    requests_[reply] = response;
+    QS3Request *s3request = new QS3Request(QS3::PutObject, info.first, "PUT", request);
+    s3request->response = response;
+    send(s3request);
 
     return response;
 }
 
 QS3GetAclResponse *QS3Client::getAcl(const QString &key)
+{
+    QS3Request *request = createGetAclRequest(key);
+
+    QS3GetAclResponse *response = new QS3GetAclResponse(request->key, request->request.url());
+    request->response = response;
+    send(request);
+    
+    return response;
+}
+
+QS3RequestId QS3Client::getAcl(const QString &key, QS3ResultHandler *handler, quint64 tag)
+{
+    return send(createGetAclRequest(key), handler, tag);
+}
+
+QS3Request *QS3Client::createGetAclRequest(const QString &key)
 {
     Q3SQueryParams params;
     params["acl"] = "";
     
     QS3UrlPair info = generateUrl(key, params);
-    QNetworkRequest request(info.second);
-    prepareRequest(&request, "GET");
-    QNetworkReply *reply = network_->get(request);
+    return new QS3Request(QS3::GetAcl, info.first, "GET", QNetworkRequest(info.second));
+}
+
+QS3SetAclResponse *QS3Client::setCannedAcl(const QString &key, QS3::CannedAcl cannedAcl)
+{
+    QS3Request *request = createSetCannedAclRequest(key, cannedAcl);
+    if (!request)
+        return 0;
+
+    QS3SetAclResponse *response = new QS3SetAclResponse(request->key, request->request.url());
+    request->response = response;
+    send(request);
 
-    QS3GetAclResponse *response = new QS3GetAclResponse(info.first, request.url());
-    requests_[reply] = response;
-    
     return response;
 }
 
-QS3SetAclResponse *QS3Client::setCannedAcl(const QString &key, QS3::CannedAcl cannedAcl)
+QS3RequestId QS3Client::setCannedAcl(const QString &key, QS3::CannedAcl cannedAcl, QS3ResultHandler *handler, quint64 tag)
+{
+    return send(createSetCannedAclRequest(key, cannedAcl), handler, tag);
+}
+
+QS3Request *QS3Client::createSetCannedAclRequest(const QString &key, QS3::CannedAcl cannedAcl)
 {
     if (key.trimmed().isEmpty() || key.trimmed() == QS3::ROOT_PATH)
     {
@@ -333,80 +663,1307 @@ QS3SetAclResponse *QS3Client::setCannedAcl(const QString &key, QS3::CannedAcl ca
     QS3UrlPair info = generateUrl(key, params);
     QNetworkRequest request(info.second);
     request.setRawHeader(QS3::AMAZON_HEADER_ACL, aclHeader);
-    prepareRequest(&request, "PUT");
-    QNetworkReply *reply = network_->put(request, "");
 
-    QS3SetAclResponse *response = new QS3SetAclResponse(info.first, request.url());
-    requests_[reply] = response;
+    return new QS3Request(QS3::SetAcl, info.first, "PUT", request);
+}
 
-    return response;
+QS3BulkAclJob *QS3Client::setCannedAclForPrefix(const QString &prefix, QS3::CannedAcl cannedAcl)
+{
+    if (QS3::cannedAclToHeader(cannedAcl).isEmpty())
+    {
+        qDebug() << "QS3Client::setCannedAclForPrefix() Error: Input QS3::CannedAcl is invalid:" << cannedAcl;
+        return 0;
+    }
+    return new QS3BulkAclJob(this, prefix, cannedAcl);
 }
 
-void QS3Client::onReply(QNetworkReply *reply)
+QS3GetManyJob *QS3Client::getMany(const QStringList &keys)
 {
-    if (!reply)
-        return;
-    reply->deleteLater();
+    return new QS3GetManyJob(this, keys);
+}
+
+QS3PackReader *QS3Client::openPack(const QString &key)
+{
+    return new QS3PackReader(this, key);
+}
+
+void QS3Client::setBandwidthLimit(QS3::TransferDirection direction, qint64 bytesPerSecond)
+{
+    limiters_[direction][0]->setRate(bytesPerSecond);
+}
+
+void QS3Client::setBandwidthLimit(QS3::TransferDirection direction, QS3::Priority priority, qint64 bytesPerSecond)
+{
+    limiters_[direction][1 + priority]->setRate(bytesPerSecond);
+}
+
+qint64 QS3Client::bandwidthLimit(QS3::TransferDirection direction) const
+{
+    return limiters_[direction][0]->rate();
+}
+
+void QS3Client::setPriority(QS3::Priority priority)
+{
+    priority_ = priority;
+}
+
+QS3::Priority QS3Client::priority() const
+{
+    return priority_;
+}
+
+QList<QS3RateLimiter*> QS3Client::limiters(QS3::TransferDirection direction, QS3::Priority priority) const
+{
+    return QList<QS3RateLimiter*>() << limiters_[direction][0] << limiters_[direction][1 + priority];
+}
+
+bool QS3Client::isThrottled(QS3::TransferDirection direction, QS3::Priority priority) const
+{
+    return limiters_[direction][0]->isLimited() || limiters_[direction][1 + priority]->isLimited();
+}
+
+int QS3Client::concurrencyLimit(const QString &key) const
+{
+    return (concurrency_ ? concurrency_->limit(concurrencyPrefix(key)) : 0);
+}
+
+QS3BufferPool *QS3Client::bufferPool() const
+{
+    return bufferPool_;
+}
+
+void QS3Client::startTrace(int maxSpans, double sampleRate)
+{
+    // Ongoing traced requests are recorded to the new buffer.
+    delete tracer_;
+    tracer_ = new QS3Tracer(maxSpans, sampleRate);
+}
+
+void QS3Client::stopTrace()
+{
+    if (tracer_)
+        tracer_->setSampleRate(0.0);
+}
+
+QByteArray QS3Client::traceJson() const
+{
+    return (tracer_ ? tracer_->toJson() : QByteArray());
+}
 
-    QString cleanUrl = reply->url().toString(QUrl::RemoveQuery);
-    if (!requests_.contains(reply))
+bool QS3Client::writeTrace(const QString &fileName) const
+{
+    QFile file(fileName);
+    if (!file.open(QIODevice::WriteOnly | QIODevice::Truncate))
     {
-        emit errorMessage("Could not map reply to S3 response object with " + cleanUrl);
-        return;
+        qDebug() << "QS3Client: Error: Could not open" << fileName << "for writing trace:" << file.errorString();
+        return false;
+    }
+    const QByteArray json = traceJson();
+    if (file.write(json) != json.size())
+    {
+        qDebug() << "QS3Client: Error: Could not write trace to" << fileName << ":" << file.errorString();
+        return false;
     }
+    return true;
+}
+
+bool QS3Client::startRecording(const QString &fileName)
+{
+    stopRecording();
 
-    // Remove request from internal map
-    QS3Response *responseBase = requests_.take(reply);
-    if (!responseBase)
+    QS3Recording *recording = new QS3Recording();
+    if (!recording->open(fileName))
     {
-        emit errorMessage("Base response is null for " + cleanUrl);
-        return;
+        delete recording;
+        return false;
     }
-    responseBase->httpStatusCode = reply->attribute(QNetworkRequest::HttpStatusCodeAttribute).toInt();
-    if (reply->error() != QNetworkReply::NoError)
+    recording_ = recording;
+    recordingStart_ = traceClock();
+    return true;
+}
+
+void QS3Client::stopRecording()
+{
+    delete recording_;
+    recording_ = 0;
+}
+
+bool QS3Client::setTransport(QS3Transport *transport)
+{
+    if (!transport)
     {
-        QString errorParseError;
-        if (!QS3Xml::parseError(responseBase->error, reply->readAll(), errorParseError))
-            qDebug() << "Failed to parse error response to QS3Error:" << errorParseError;
+        qDebug() << "QS3Client::setTransport() Error: Transport is null.";
+        return false;
+    }
+    if (!requests_.isEmpty() || !hedges_.isEmpty())
+    {
+        qDebug() << "QS3Client::setTransport() Error: Cannot change the transport while requests are in flight.";
+        return false;
+    }
+    if (transport == transport_)
+        return true;
+
+    disconnect(transport_, SIGNAL(finished(QNetworkReply*)), this, SLOT(onReply(QNetworkReply*)));
+    transport_->deleteLater();
+    transport_ = transport;
+    transport_->setParent(this);
+    connect(transport_, SIGNAL(finished(QNetworkReply*)), this, SLOT(onReply(QNetworkReply*)));
+    return true;
+}
 
-        responseBase->succeeded = false;
-        responseBase->error.error = reply->errorString();
-        emit failed(responseBase, responseBase->error.error);
-        responseBase->emitFinished();
-        responseBase->deleteLater();
-        return;
+QS3Transport *QS3Client::transport() const
+{
+    return transport_;
+}
+
+QS3RecordedRequest QS3Client::recordedRequest(QS3Request *request, QNetworkReply *reply, qint64 bytesReceived) const
+{
+    QS3RecordedRequest recorded;
+    recorded.type = request->type;
+    recorded.key = request->key;
+    if (request->type == QS3::ListObjects)
+    {
+        QS3ListObjectsResponse *response = qobject_cast<QS3ListObjectsResponse*>(request->response);
+        recorded.key = (response ? response->prefix : QString());
     }
+    recorded.rangeOffset = request->rangeOffset;
+    recorded.rangeLength = request->rangeLength;
+    recorded.bytesSent = request->body.size();
+    recorded.bytesReceived = bytesReceived;
+    recorded.httpStatusCode = reply->attribute(QNetworkRequest::HttpStatusCodeAttribute).toInt();
+    recorded.scheduled = request->traceScheduled - recordingStart_;
+    recorded.inflight = request->inflight;
+    return recorded;
+}
 
-    bool errors = false;
-    bool castError = false;
-    QString errorMessage = "";
+qint64 QS3Client::traceClock() const
+{
+    // Microsecond precision needs Qt 4.8, earlier versions trace in whole milliseconds.
+#if QT_VERSION >= 0x040800
+    return clock_.nsecsElapsed() / 1000;
+#else
+    return clock_.elapsed() * 1000;
+#endif
+}
 
-    responseBase->succeeded = true;
-    switch (responseBase->type)
+QString QS3Client::concurrencyPrefix(const QString &key) const
+{
+    // "/a/b/c.txt" with depth 1 is "/a/", the object itself does not count as a segment.
+    // Never empty, objects at the bucket root share the "/" prefix.
+    int end = (key.startsWith(QS3::ROOT_PATH) ? 1 : 0);
+    for (int depth=0; depth<config_.concurrencyPrefixDepth; ++depth)
     {
-        case QS3::ListObjects:
-        {
-            QS3ListObjectsResponse *response = qobject_cast<QS3ListObjectsResponse*>(responseBase);
-            if (response)
-            {
-                if (QS3Xml::parseListObjects(response, reply->readAll(), errorMessage))
-                {
-                    if (response->isTruncated && !response->objects.isEmpty())
-                    {
-                        listObjectsContinue(response);
-                        return;
-                    }
-                    emit finished(response);
-                }
-                else
-                    errors = true;
-            }
-            else
-                castError = true;
+        int slash = key.indexOf('/', end);
+        if (slash < 0)
             break;
-        }
-        case QS3::RemoveObject:
-        {
+        end = slash + 1;
+    }
+    return (end > 0 ? key.left(end) : QS3::ROOT_PATH);
+}
+
+QS3MultipartUpload *QS3Client::putMultipart(const QString &key, const QString &fileName, const QString &journalFileName, const QS3FileMetadata &metadata, QS3::CannedAcl cannedAcl)
+{
+    if (key.trimmed().isEmpty() || key.trimmed() == QS3::ROOT_PATH || key.trimmed().endsWith("/"))
+    {
+        qDebug() << "QS3Client::putMultipart() Error: Cannot be called with empty, \"/\" or folder key.";
+        return 0;
+    }
+    if (!QFileInfo(fileName).isFile())
+    {
+        qDebug() << "QS3Client::putMultipart() Error: Input file does not exist on disk:" << fileName;
+        return 0;
+    }
+    if (journalFileName.isEmpty())
+    {
+        qDebug() << "QS3Client::putMultipart() Error: Journal file name is empty.";
+        return 0;
+    }
+    return new QS3MultipartUpload(this, key, fileName, journalFileName, metadata, cannedAcl);
+}
+
+QS3StreamUpload *QS3Client::putStream(const QString &key, QIODevice *source, const QS3FileMetadata &metadata, QS3::CannedAcl cannedAcl)
+{
+    if (key.trimmed().isEmpty() || key.trimmed() == QS3::ROOT_PATH || key.trimmed().endsWith("/"))
+    {
+        qDebug() << "QS3Client::putStream() Error: Cannot be called with empty, \"/\" or folder key.";
+        return 0;
+    }
+    if (!source || !source->isReadable())
+    {
+        qDebug() << "QS3Client::putStream() Error: Source device is null or not open for reading.";
+        return 0;
+    }
+    return new QS3StreamUpload(this, key, source, metadata, cannedAcl);
+}
+
+QS3MultipartUpload *QS3Client::resumeMultipart(const QString &journalFileName)
+{
+    if (!QFileInfo(journalFileName).isFile())
+    {
+        qDebug() << "QS3Client::resumeMultipart() Error: Journal does not exist on disk:" << journalFileName;
+        return 0;
+    }
+    return new QS3MultipartUpload(this, journalFileName, QS3MultipartUpload::Resume);
+}
+
+QList<QS3MultipartUpload*> QS3Client::abortStaleMultipart(const QString &journalDirectory, int maxAgeSecs)
+{
+    QList<QS3MultipartUpload*> jobs;
+    QDateTime staleTime = QDateTime::currentDateTime().addSecs(-maxAgeSecs);
+    QFileInfoList journals = QDir(journalDirectory).entryInfoList(QStringList() << "*" + QS3MultipartUpload::JournalSuffix, QDir::Files);
+    foreach(const QFileInfo &journal, journals)
+    {
+        if (journal.lastModified() < staleTime)
+            jobs << new QS3MultipartUpload(this, journal.absoluteFilePath(), QS3MultipartUpload::Abort);
+    }
+    return jobs;
+}
+
+QS3RequestId QS3Client::initiateMultipartUpload(const QString &key, const QS3FileMetadata &metadata, QS3::CannedAcl cannedAcl, QS3ResultHandler *handler, quint64 tag)
+{
+    Q3SQueryParams params;
+    params["uploads"] = "";
+    QS3Request *request = createMultipartRequest(QS3::InitiateMultipartUpload, key, "POST", params);
+    if (!request)
+        return 0;
+
+    // Set explicitly, the network layer would add a default type for POST after signing.
+    request->request.setHeader(QNetworkRequest::ContentTypeHeader, !metadata.contentType.isEmpty() ? metadata.contentType : QString("binary/octet-stream"));
+    if (!metadata.contentEncoding.isEmpty())
+        request->request.setRawHeader("Content-Encoding", metadata.contentEncoding.toUtf8());
+    if (cannedAcl != QS3::NoCannedAcl)
+    {
+        QByteArray aclHeader = QS3::cannedAclToHeader(cannedAcl);
+        if (!aclHeader.isEmpty())
+            request->request.setRawHeader(QS3::AMAZON_HEADER_ACL, aclHeader);
+        else
+            qDebug() << "QS3Client::initiateMultipartUpload() Warning: Input QS3::CannedAcl is invalid:" << cannedAcl;
+    }
+    return send(request, handler, tag);
+}
+
+QS3RequestId QS3Client::uploadPart(const QString &key, const QString &uploadId, int partNumber, const QByteArray &data, QS3ResultHandler *handler, quint64 tag)
+{
+    if (partNumber < 1 || partNumber > 10000 || data.isEmpty())
+    {
+        qDebug() << "QS3Client::uploadPart() Error: Invalid part number" << partNumber << "or empty data.";
+        return 0;
+    }
+    Q3SQueryParams params;
+    params["partNumber"] = QString::number(partNumber);
+    params["uploadId"] = uploadId;
+    return send(createMultipartRequest(QS3::UploadPart, key, "PUT", params, data), handler, tag);
+}
+
+QS3RequestId QS3Client::listParts(const QString &key, const QString &uploadId, int partNumberMarker, QS3ResultHandler *handler, quint64 tag)
+{
+    Q3SQueryParams params;
+    params["uploadId"] = uploadId;
+    if (partNumberMarker > 0)
+        params["part-number-marker"] = QString::number(partNumberMarker);
+    return send(createMultipartRequest(QS3::ListParts, key, "GET", params), handler, tag);
+}
+
+QS3RequestId QS3Client::completeMultipartUpload(const QString &key, const QString &uploadId, const QMap<int, QString> &partETags, QS3ResultHandler *handler, quint64 tag)
+{
+    if (partETags.isEmpty())
+    {
+        qDebug() << "QS3Client::completeMultipartUpload() Error: No parts given.";
+        return 0;
+    }
+    Q3SQueryParams params;
+    params["uploadId"] = uploadId;
+    QS3Request *request = createMultipartRequest(QS3::CompleteMultipartUpload, key, "POST", params, QS3Xml::generateCompleteMultipartUpload(partETags));
+    if (!request)
+        return 0;
+    request->request.setHeader(QNetworkRequest::ContentTypeHeader, QString("application/xml"));
+    return send(request, handler, tag);
+}
+
+QS3RequestId QS3Client::abortMultipartUpload(const QString &key, const QString &uploadId, QS3ResultHandler *handler, quint64 tag)
+{
+    Q3SQueryParams params;
+    params["uploadId"] = uploadId;
+    return send(createMultipartRequest(QS3::AbortMultipartUpload, key, "DELETE", params), handler, tag);
+}
+
+QS3Request *QS3Client::createMultipartRequest(QS3::RequestType type, const QString &key, const QString &verb, const Q3SQueryParams &params, const QByteArray &body)
+{
+    if (key.trimmed().isEmpty() || key.trimmed() == QS3::ROOT_PATH || key.trimmed().endsWith("/"))
+    {
+        qDebug() << "QS3Client: Error: Multipart upload cannot be called with empty, \"/\" or folder key.";
+        return 0;
+    }
+    if (type != QS3::InitiateMultipartUpload && params.value("uploadId").isEmpty())
+    {
+        qDebug() << "QS3Client: Error: Multipart upload request without upload id for" << key;
+        return 0;
+    }
+
+    QS3UrlPair info = generateUrl(key, params);
+    QNetworkRequest request(info.second);
+    if (verb == "PUT" || verb == "POST")
+        request.setHeader(QNetworkRequest::ContentLengthHeader, body.size());
+
+    QS3Request *s3request = new QS3Request(type, info.first, verb, request);
+    s3request->body = body;
+    return s3request;
+}
+
+bool QS3Client::cancel(QS3RequestId id)
+{
+    return cancelRequest(id, 0);
+}
+
+void QS3Client::onCancelRequested(QS3Response *response)
+{
+    if (response && response->requestId_ != 0)
+        cancelRequest(response->requestId_, response);
+}
+
+bool QS3Client::cancelRequest(QS3RequestId id, QS3Response *response)
+{
+    // Requests waiting for a concurrency slot.
+    if (concurrency_)
+    {
+        QS3Request *queuedRequest = concurrency_->take(id);
+        if (queuedRequest)
+        {
+            finishCanceled(queuedRequest);
+            return true;
+        }
+    }
+
+    // Requests waiting to be failed after the transport could not send them.
+    for (int i=0; i<unsent_.size(); ++i)
+    {
+        QS3Request *request = unsent_[i];
+        if (request->id != id || (response ? request->response != response : !request->handler))
+            continue;
+        unsent_.removeAt(i);
+        finishCanceled(request);
+        return true;
+    }
+
+    // Coalesced requests waiting for another request to finish.
+    QMultiHash<QNetworkReply*, QS3Request*>::iterator followerIter = followers_.begin();
+    for (; followerIter != followers_.end(); ++followerIter)
+    {
+        QS3Request *request = followerIter.value();
+        if (!request || request->id != id || (response ? request->response != response : !request->handler))
+            continue;
+        followers_.erase(followerIter);
+        finishCanceled(request);
+        return true;
+    }
+
+    QHash<QNetworkReply*, QS3Request*>::iterator iter = requests_.begin();
+    for (; iter != requests_.end(); ++iter)
+    {
+        QS3Request *request = iter.value();
+        if (!request || request->id != id || (response ? request->response != response : !request->handler))
+            continue;
+
+        QNetworkReply *reply = iter.key();
+
+        // Other requests are waiting for this reply, the first of them takes over. The request
+        // stays in place with all of its transfer and resume state, only its identity is swapped.
+        if (followers_.contains(reply))
+        {
+            QList<QS3Request*> waiting = followers_.values(reply);
+            QS3Request *follower = waiting.last();
+            followers_.remove(reply, follower);
+            if (request->response)
+                disconnect(reply, 0, request->response, 0);
+            qSwap(request->id, follower->id);
+            qSwap(request->tag, follower->tag);
+            qSwap(request->handler, follower->handler);
+            qSwap(request->response, follower->response);
+            finishCanceled(follower);
+            return true;
+        }
+
+        requests_.erase(iter);
+        throttled_.remove(reply);
+        hedgeCandidates_.remove(reply);
+        if (hedges_.contains(reply))
+        {
+            QNetworkReply *hedgeReply = hedges_.take(reply);
+            hedges_.remove(hedgeReply);
+            hedgeReply->abort();
+            hedgeReply->deleteLater();
+            releaseHedgeSlot(request);
+        }
+        if (!request->coalesceKey.isEmpty() && inflight_.value(request->coalesceKey) == reply)
+            inflight_.remove(request->coalesceKey);
+        QString prefix = request->concurrencyPrefix;
+
+        // Removed from the internal map above, the request will not be finished by onReply.
+        reply->abort();
+        reply->deleteLater();
+        finishCanceled(request);
+
+        if (concurrency_ && !prefix.isEmpty())
+        {
+            concurrency_->release(prefix);
+            dispatchQueued(prefix);
+        }
+        return true;
+    }
+    return false;
+}
+
+void QS3Client::finishCanceled(QS3Request *request)
+{
+    // Handlers are not called for canceled requests.
+    QS3Response *response = request->response;
+    delete request;
+    if (!response)
+        return;
+
+    response->succeeded = false;
+    response->error.error = "Operation canceled";
+    emit failed(response, response->error.error);
+    response->emitFinished();
+    response->deleteLater();
+}
+
+void QS3Client::finishFailed(QS3Request *request, const QString &error)
+{
+    QS3ResultHandler *handler = request->handler;
+    QS3Response *response = request->response;
+    if (handler)
+    {
+        QS3Result result;
+        result.id = request->id;
+        result.tag = request->tag;
+        result.type = request->type;
+        result.key = request->key;
+        result.succeeded = false;
+        result.error.error = error;
+        delete request;
+        handler->handleResult(result);
+        return;
+    }
+    delete request;
+    if (!response)
+        return;
+
+    response->succeeded = false;
+    response->error.error = error;
+    emit failed(response, response->error.error);
+    response->emitFinished();
+    response->deleteLater();
+}
+
+void QS3Client::failUnsent(QS3Request *request, const QString &error)
+{
+    request->abortReason = error;
+    unsent_ << request;
+    if (unsent_.size() == 1)
+        QMetaObject::invokeMethod(this, "onUnsentRequests", Qt::QueuedConnection);
+}
+
+void QS3Client::onUnsentRequests()
+{
+    QList<QS3Request*> unsent = unsent_;
+    unsent_.clear();
+    foreach(QS3Request *request, unsent)
+        finishFailed(request, request->abortReason);
+}
+
+void QS3Client::setTimeouts(int requestTimeout, int stallTimeout)
+{
+    requestTimeout_ = qMax(0, requestTimeout);
+    stallTimeout_ = qMax(0, stallTimeout);
+}
+
+void QS3Client::onTimeoutTimer()
+{
+    const qint64 now = clock_.elapsed();
+
+    QList<QPair<QNetworkReply*, QString> > expired;
+    QList<QPair<QNetworkReply*, QString> > stalled;
+    QHash<QNetworkReply*, QS3Request*>::const_iterator iter = requests_.constBegin();
+    for (; iter != requests_.constEnd(); ++iter)
+    {
+        const QS3Request *request = iter.value();
+        if (request->deadline >= 0 && now >= request->deadline)
+            expired << qMakePair(iter.key(), QString("Request timed out after %1 ms").arg(request->timeout));
+        else if (request->stallTimeout > 0 && now - request->lastActivity >= request->stallTimeout)
+            stalled << qMakePair(iter.key(), QString("Request stalled, no data transferred in %1 ms").arg(request->stallTimeout));
+    }
+    for (int i=0; i<expired.size(); ++i)
+        abortRequest(expired[i].first, expired[i].second);
+
+    // A stalled get may continue on a new connection, see QS3Config::resumeAttempts.
+    for (int i=0; i<stalled.size(); ++i)
+        abortRequest(stalled[i].first, stalled[i].second, true);
+
+    if (requests_.isEmpty())
+        timeoutTimer_->stop();
+}
+
+void QS3Client::onTransferProgress()
+{
+    QNetworkReply *reply = qobject_cast<QNetworkReply*>(sender());
+    QS3Request *request = (reply ? requests_.value(reply, 0) : 0);
+    if (request)
+        request->lastActivity = clock_.elapsed();
+}
+
+void QS3Client::abortRequest(QNetworkReply *reply, const QString &reason, bool retryable)
+{
+    QS3Request *request = requests_.value(reply, 0);
+    if (!request)
+        return;
+
+    if (hedges_.contains(reply))
+    {
+        QNetworkReply *hedgeReply = hedges_.take(reply);
+        hedges_.remove(hedgeReply);
+        hedgeReply->abort();
+        hedgeReply->deleteLater();
+        releaseHedgeSlot(request);
+    }
+
+    request->abortReason = reason;
+    request->abortRetryable = retryable;
+    foreach(QS3Request *follower, followers_.values(reply))
+        follower->abortReason = reason;
+
+    // The aborted reply is finished through onReply, if Qt did not do it already.
+    reply->abort();
+    if (requests_.contains(reply))
+        onReply(reply);
+}
+
+QS3RequestId QS3Client::send(QS3Request *request, QS3ResultHandler *handler, quint64 tag)
+{
+    if (!request)
+        return 0;
+    if (!handler)
+    {
+        qDebug() << "QS3Client: Error: Null QS3ResultHandler given for" << request->key;
+        delete request;
+        return 0;
+    }
+
+    request->handler = handler;
+    request->tag = tag;
+    return send(request);
+}
+
+QS3RequestId QS3Client::send(QS3Request *request)
+{
+    if (request->id == 0)
+    {
+        request->id = nextRequestId_++;
+        request->priority = priority_;
+        request->timeout = requestTimeout_;
+        request->stallTimeout = stallTimeout_;
+        request->traced = (tracer_ && tracer_->sample());
+        if (request->traced || recording_)
+            request->traceScheduled = traceClock();
+        if (recording_)
+            request->inflight = requests_.size() + followers_.size();
+
+        // Added when sent rather than when succeeded, a failed write only leaves a false positive.
+        if (!existenceIndexes_.isEmpty() && (request->type == QS3::PutObject || request->type == QS3::CopyObject || request->type == QS3::InitiateMultipartUpload))
+        {
+            for (int i=existenceIndexes_.size()-1; i>=0; --i)
+            {
+                if (existenceIndexes_[i])
+                    existenceIndexes_[i]->add(request->key);
+                else
+                    existenceIndexes_.removeAt(i);
+            }
+        }
+        if (request->response)
+        {
+            request->response->requestId_ = request->id;
+            connect(request->response, SIGNAL(cancelRequested(QS3Response*)), this, SLOT(onCancelRequested(QS3Response*)));
+        }
+    }
+    // Taken before dispatch, the request is owned by the client from here on.
+    const QS3RequestId id = request->id;
+
+    // Gets of the key sent before a write may return the old object or ACL,
+    // later gets must not attach to them.
+    if (!inflight_.isEmpty() && (request->type == QS3::PutObject || request->type == QS3::CopyObject || request->type == QS3::RemoveObject ||
+        request->type == QS3::SetAcl || request->type == QS3::CompleteMultipartUpload))
+    {
+        QHash<QByteArray, QNetworkReply*>::iterator inflightIter = inflight_.begin();
+        while (inflightIter != inflight_.end())
+        {
+            QS3Request *ongoing = requests_.value(inflightIter.value(), 0);
+            if (ongoing && ongoing->key == request->key)
+            {
+                ongoing->coalesceKey.clear();
+                inflightIter = inflight_.erase(inflightIter);
+            }
+            else
+                ++inflightIter;
+        }
+    }
+
+    // Attach to an identical ongoing request instead of sending a new one.
+    if (config_.coalesceRequests && request->verb == "GET" && (request->type == QS3::GetObject || request->type == QS3::GetAcl))
+    {
+        request->coalesceKey = QByteArray::number((int)request->type) + " " + request->request.url().toEncoded() + " " + request->request.rawHeader(QS3::STANDARD_HEADER_RANGE);
+        QNetworkReply *ongoingReply = inflight_.value(request->coalesceKey, 0);
+        if (ongoingReply)
+        {
+            if (request->response && request->type == QS3::GetObject)
+                connect(ongoingReply, SIGNAL(downloadProgress(qint64, qint64)), request->response, SLOT(downloadProgress(qint64, qint64)));
+            followers_.insert(ongoingReply, request);
+            return id;
+        }
+    }
+
+    // Wait for a slot, queued requests are signed when they are finally sent.
+    if (concurrency_)
+    {
+        request->concurrencyPrefix = concurrencyPrefix(request->key);
+        if (!concurrency_->tryAcquire(request->concurrencyPrefix))
+        {
+            concurrency_->enqueue(request->concurrencyPrefix, request);
+            return id;
+        }
+    }
+    dispatch(request);
+    return id;
+}
+
+QNetworkReply *QS3Client::dispatch(QS3Request *request)
+{
+    switch (request->priority)
+    {
+        case QS3::HighPriority: request->request.setPriority(QNetworkRequest::HighPriority); break;
+        case QS3::LowPriority: request->request.setPriority(QNetworkRequest::LowPriority); break;
+        default: request->request.setPriority(QNetworkRequest::NormalPriority); break;
+    }
+
+    // Resumed gets keep the times of their first attempt.
+    const bool traceFirstSend = (request->traced && request->traceDispatched < 0);
+    if (traceFirstSend)
+        request->traceDispatched = traceClock();
+    prepareRequest(&request->request, request->verb, payloadHash(request));
+    if (traceFirstSend)
+        request->traceSigned = traceClock();
+
+    // Paced uploads read the body through a device that waits for upload bandwidth.
+    if (request->uploadDevice)
+    {
+        request->uploadDevice->deleteLater();
+        request->uploadDevice = 0;
+    }
+    if (!request->body.isEmpty() && isThrottled(QS3::Upload, request->priority))
+        request->uploadDevice = new QS3ThrottledDevice(request->body, limiters(QS3::Upload, request->priority));
+
+    QNetworkReply *reply = transport_->send(request->verb.toLatin1(), request->request, request->body, request->uploadDevice);
+    if (!reply)
+    {
+        // The slot is free again, the caller sends queued requests of the prefix.
+        const QString error = "Transport could not send " + request->verb + " for " + request->key;
+        emit errorMessage(error);
+        if (concurrency_ && !request->concurrencyPrefix.isEmpty())
+            concurrency_->release(request->concurrencyPrefix);
+        request->concurrencyPrefix.clear();
+        failUnsent(request, error);
+        return 0;
+    }
+
+    request->deadline = (request->timeout > 0 ? clock_.elapsed() + request->timeout : -1);
+    request->lastActivity = clock_.elapsed();
+    if (request->stallTimeout > 0)
+    {
+        connect(reply, SIGNAL(metaDataChanged()), this, SLOT(onTransferProgress()));
+        connect(reply, SIGNAL(downloadProgress(qint64, qint64)), this, SLOT(onTransferProgress()));
+        connect(reply, SIGNAL(uploadProgress(qint64, qint64)), this, SLOT(onTransferProgress()));
+    }
+    if ((request->timeout > 0 || request->stallTimeout > 0) && !timeoutTimer_->isActive())
+        timeoutTimer_->start();
+
+    if (concurrency_ || config_.hedgeRequests || request->traced)
+    {
+        request->sentTime.start();
+        request->headersMsecs = -1;
+        connect(reply, SIGNAL(metaDataChanged()), this, SLOT(onMetaDataChanged()));
+    }
+    if (config_.hedgeRequests && request->type == QS3::GetObject)
+    {
+        hedgeCredit_ = qMin(10.0, hedgeCredit_ + config_.hedgeBudget);
+        hedgeCandidates_.insert(reply);
+        if (!hedgeTimer_->isActive())
+            hedgeTimer_->start();
+    }
+
+    if (request->response)
+    {
+        if (request->type == QS3::GetObject)
+            connect(reply, SIGNAL(downloadProgress(qint64, qint64)), request->response, SLOT(downloadProgress(qint64, qint64)));
+        else if (request->type == QS3::PutObject)
+            connect(reply, SIGNAL(uploadProgress(qint64, qint64)), request->response, SLOT(uploadProgress(qint64, qint64)));
+    }
+
+    // Paced downloads are read as bandwidth allows, the reply stops reading
+    // from the socket when its read buffer is full.
+    if (isThrottled(QS3::Download, request->priority))
+    {
+        reply->setReadBufferSize(64 * 1024);
+        connect(reply, SIGNAL(readyRead()), this, SLOT(onReadyRead()));
+    }
+    if (request->mapping)
+        request->mappingReply = reply;
+    requests_[reply] = request;
+    // A get queued before a write of its key must not replace a newer one.
+    if (!request->coalesceKey.isEmpty() && !requests_.contains(inflight_.value(request->coalesceKey, 0)))
+        inflight_[request->coalesceKey] = reply;
+    return reply;
+}
+
+bool QS3Client::canResume(QS3Request *request, QNetworkReply *reply) const
+{
+    if (request->type != QS3::GetObject || request->resumeAttempts >= config_.resumeAttempts)
+        return false;
+
+    // Only the object data itself can be continued, not S3 error responses.
+    const int httpStatusCode = reply->attribute(QNetworkRequest::HttpStatusCodeAttribute).toInt();
+    if (httpStatusCode != 0 && httpStatusCode != 200 && httpStatusCode != 206)
+        return false;
+
+    switch (reply->error())
+    {
+        case QNetworkReply::RemoteHostClosedError:
+        case QNetworkReply::TimeoutError:
+        case QNetworkReply::TemporaryNetworkFailureError:
+        case QNetworkReply::NetworkSessionFailedError:
+        case QNetworkReply::ProxyConnectionClosedError:
+        case QNetworkReply::ProxyTimeoutError:
+        case QNetworkReply::UnknownNetworkError:
+            return true;
+        case QNetworkReply::OperationCanceledError:
+            return request->abortRetryable;
+        default:
+            return false;
+    }
+}
+
+void QS3Client::resume(QS3Request *request, QNetworkReply *reply, const QByteArray &data)
+{
+    request->resumeAttempts++;
+
+    const int httpStatusCode = reply->attribute(QNetworkRequest::HttpStatusCodeAttribute).toInt();
+    if (httpStatusCode == 200 || httpStatusCode == 206)
+    {
+        request->resumeData.append(data);
+        if (request->resumeETag.isEmpty())
+            request->resumeETag = reply->rawHeader(QS3::STANDARD_HEADER_ETAG);
+    }
+    request->abortReason.clear();
+    request->abortRetryable = false;
+
+    // Continue from the first missing byte. If the object has changed S3 fails the get with 412 Precondition Failed.
+    const qint64 received = request->resumeData.size();
+    const qint64 length = (request->rangeLength < 0 ? -1 : request->rangeLength - received);
+    request->request.setRawHeader(QS3::STANDARD_HEADER_RANGE, QS3::generateRangeHeader(request->rangeOffset + received, length));
+    if (!request->resumeETag.isEmpty())
+        request->request.setRawHeader(QS3::STANDARD_HEADER_IF_MATCH, request->resumeETag);
+
+    // The request keeps its concurrency slot, deadline and coalesced followers.
+    QList<QS3Request*> waiting = followers_.values(reply);
+    followers_.remove(reply);
+    const qint64 deadline = request->deadline;
+    const QString prefix = request->concurrencyPrefix;
+
+    QNetworkReply *resumed = dispatch(request);
+    if (!resumed)
+    {
+        // Later gets of the key must not attach to the finished reply.
+        if (!request->coalesceKey.isEmpty() && inflight_.value(request->coalesceKey) == reply)
+            inflight_.remove(request->coalesceKey);
+        foreach(QS3Request *follower, waiting)
+            failUnsent(follower, request->abortReason);
+        if (concurrency_ && !prefix.isEmpty())
+            dispatchQueued(prefix);
+        return;
+    }
+    request->deadline = deadline;
+    foreach(QS3Request *follower, waiting)
+        followers_.insert(resumed, follower);
+}
+
+void QS3Client::onReply(QNetworkReply *reply)
+{
+    if (!reply)
+        return;
+    reply->deleteLater();
+    const qint64 replied = (tracer_ || recording_ ? traceClock() : -1);
+
+    // One of a hedged pair failed, the other one may still succeed.
+    if (hedges_.contains(reply))
+    {
+        if (reply->error() != QNetworkReply::NoError)
+        {
+            QNetworkReply *other = hedges_.take(reply);
+            hedges_.remove(other);
+            if (requests_.contains(reply))
+                moveRequest(reply, other);
+            hedgeCandidates_.remove(reply);
+            releaseHedgeSlot(requests_.value(other, 0));
+            return;
+        }
+        resolveHedge(reply);
+    }
+    hedgeCandidates_.remove(reply);
+
+    QS3Request *request = requests_.take(reply);
+    if (!request && reply->error() == QNetworkReply::OperationCanceledError)
+        return; // Canceled request or aborted hedge.
+    if (!request)
+    {
+        emit errorMessage("Could not map reply to S3 request with " + reply->url().toString(QUrl::RemoveQuery));
+        return;
+    }
+
+    // The tail of a throttled reply is read at once, the limiters go in debt for it.
+    throttled_.remove(reply);
+    QS3RateLimiter::consume(limiters(QS3::Download, request->priority), readReceived(reply, request, reply->bytesAvailable()));
+    QByteArray data = takeReceived(request);
+
+    // Interrupted gets continue from what was received instead of failing. A ranged get
+    // that was interrupted after its last byte has nothing left to ask for and succeeds.
+    const int httpStatusCode = reply->attribute(QNetworkRequest::HttpStatusCodeAttribute).toInt();
+    bool failed = (reply->error() != QNetworkReply::NoError);
+    if (failed && canResume(request, reply))
+    {
+        if ((httpStatusCode == 200 || httpStatusCode == 206) && request->rangeLength >= 0 && request->resumeData.size() + data.size() >= request->rangeLength)
+            failed = false;
+        else
+        {
+            resume(request, reply, data);
+            return;
+        }
+    }
+    if (!request->resumeData.isEmpty() && !failed)
+    {
+        // The continuation must start at the first missing byte. A server that ignores Range
+        // answers 200 with the whole object, which then replaces what was received before.
+        if (httpStatusCode == 206 && QS3::parseRangeStart(reply->rawHeader(QS3::STANDARD_HEADER_CONTENT_RANGE)) == request->rangeOffset + request->resumeData.size())
+            data.prepend(request->resumeData);
+        request->resumeData.clear();
+    }
+
+    // Coalesced requests receive the same reply data.
+    QList<QS3Request*> completed;
+    completed << request;
+    if (!request->coalesceKey.isEmpty() && inflight_.value(request->coalesceKey) == reply)
+        inflight_.remove(request->coalesceKey);
+    completed << followers_.values(reply);
+    followers_.remove(reply);
+
+    if (concurrency_ && !request->concurrencyPrefix.isEmpty())
+        releaseConcurrency(request, reply, data);
+
+    foreach(QS3Request *completedRequest, completed)
+    {
+        // Finishing destroys the request, its span and record are taken before.
+        const bool traced = (tracer_ && completedRequest->traced);
+        const bool recorded = (recording_ && completedRequest->traceScheduled >= recordingStart_);
+        QS3TraceSpan span;
+        QS3RecordedRequest record;
+        if (recorded)
+            record = recordedRequest(completedRequest, reply, data.size());
+        if (traced)
+        {
+            span.id = completedRequest->id;
+            span.type = completedRequest->type;
+            span.key = completedRequest->key;
+            span.verb = completedRequest->verb;
+            span.httpStatusCode = reply->attribute(QNetworkRequest::HttpStatusCodeAttribute).toInt();
+            span.bytesSent = completedRequest->body.size();
+            span.bytesReceived = data.size();
+            span.scheduled = completedRequest->traceScheduled;
+            span.dispatched = completedRequest->traceDispatched;
+            span.signedTime = completedRequest->traceSigned;
+            span.headers = completedRequest->traceHeaders;
+            span.replied = replied;
+        }
+
+        if (completedRequest->handler)
+            finishResult(completedRequest, reply, data, failed);
+        else if (completedRequest->response)
+            finishResponse(completedRequest, reply, data, failed);
+        else
+        {
+            emit errorMessage("Base response is null for " + reply->url().toString(QUrl::RemoveQuery));
+            delete completedRequest;
+        }
+
+        // The handler may have stopped or restarted tracing and recording.
+        const qint64 finished = (traced || recorded ? traceClock() : -1);
+        if (traced && tracer_)
+        {
+            span.finished = finished;
+            tracer_->record(span);
+        }
+        if (recorded && recording_)
+        {
+            record.duration = finished - recordingStart_ - record.scheduled;
+            recording_->write(record);
+        }
+    }
+
+    // Pooled now unless a response still holds the body, it returns it when destroyed.
+    bufferPool_->release(data);
+}
+
+void QS3Client::onMetaDataChanged()
+{
+    QNetworkReply *reply = qobject_cast<QNetworkReply*>(sender());
+    if (!reply)
+        return;
+    if (hedges_.contains(reply))
+        resolveHedge(reply);
+    hedgeCandidates_.remove(reply);
+
+    QS3Request *request = requests_.value(reply, 0);
+    if (request && request->headersMsecs < 0)
+    {
+        request->headersMsecs = request->sentTime.elapsed();
+        if (request->traced && request->traceHeaders < 0)
+            request->traceHeaders = traceClock();
+        if (config_.hedgeRequests && request->type == QS3::GetObject)
+            latencies_->addSample(request->headersMsecs);
+    }
+
+    // Read the body to a buffer of its final size instead of growing one.
+    if (request && request->type == QS3::GetObject && request->receivedSize == 0 &&
+        reply->attribute(QNetworkRequest::HttpStatusCodeAttribute).toInt() / 100 == 2)
+    {
+        bool ok = false;
+        qint64 length = reply->header(QNetworkRequest::ContentLengthHeader).toLongLong(&ok);
+        if (ok && length > request->received.capacity() && length <= INT_MAX)
+        {
+            bufferPool_->release(request->received);
+            request->received = bufferPool_->acquire(static_cast<int>(length));
+        }
+    }
+}
+
+void QS3Client::onHedgeTimer()
+{
+    // Hedging starts once there are enough samples for a meaningful percentile.
+    const qint64 delay = (latencies_->sampleCount() >= 32 ? latencies_->percentile(config_.hedgePercentile) : -1);
+
+    foreach(QNetworkReply *reply, hedgeCandidates_.toList())
+    {
+        QS3Request *request = requests_.value(reply, 0);
+        if (!request || request->headersMsecs >= 0)
+        {
+            hedgeCandidates_.remove(reply);
+            continue;
+        }
+        if (delay < 0 || request->sentTime.elapsed() < delay)
+            continue;
+
+        hedgeCandidates_.remove(reply);
+        if (hedgeCredit_ >= 1.0 && sendHedge(reply, request))
+            hedgeCredit_ -= 1.0;
+    }
+    if (hedgeCandidates_.isEmpty())
+        hedgeTimer_->stop();
+}
+
+bool QS3Client::sendHedge(QNetworkReply *reply, QS3Request *request)
+{
+    // The hedge counts in the window of the prefix, a prefix that is already slow
+    // or throttled is not sent more than its window allows.
+    const QString prefix = request->concurrencyPrefix;
+    if (concurrency_ && !prefix.isEmpty() && !concurrency_->tryAcquire(prefix))
+        return false;
+
+    // The request is already signed and its date is still valid.
+    QNetworkReply *hedgeReply = transport_->send("GET", request->request, QByteArray(), 0);
+    if (!hedgeReply)
+    {
+        if (concurrency_ && !prefix.isEmpty())
+            concurrency_->release(prefix);
+        return false;
+    }
+
+    connect(hedgeReply, SIGNAL(metaDataChanged()), this, SLOT(onMetaDataChanged()));
+    if (request->stallTimeout > 0)
+    {
+        connect(hedgeReply, SIGNAL(metaDataChanged()), this, SLOT(onTransferProgress()));
+        connect(hedgeReply, SIGNAL(downloadProgress(qint64, qint64)), this, SLOT(onTransferProgress()));
+    }
+    if (isThrottled(QS3::Download, request->priority))
+    {
+        hedgeReply->setReadBufferSize(64 * 1024);
+        connect(hedgeReply, SIGNAL(readyRead()), this, SLOT(onReadyRead()));
+    }
+    hedges_.insert(reply, hedgeReply);
+    hedges_.insert(hedgeReply, reply);
+    return true;
+}
+
+void QS3Client::releaseHedgeSlot(QS3Request *request)
+{
+    if (!concurrency_ || !request || request->concurrencyPrefix.isEmpty())
+        return;
+    const QString prefix = request->concurrencyPrefix;
+    concurrency_->release(prefix);
+    dispatchQueued(prefix);
+}
+
+void QS3Client::resolveHedge(QNetworkReply *winner)
+{
+    QNetworkReply *loser = hedges_.take(winner);
+    hedges_.remove(loser);
+    hedgeCandidates_.remove(loser);
+
+    if (!requests_.contains(winner))
+        moveRequest(loser, winner);
+
+    // Not in requests_ anymore, onReply ignores it.
+    loser->abort();
+    loser->deleteLater();
+    releaseHedgeSlot(requests_.value(winner, 0));
+}
+
+void QS3Client::moveRequest(QNetworkReply *from, QNetworkReply *to)
+{
+    QS3Request *request = requests_.take(from);
+    if (!request)
+        return;
+    requests_[to] = request;
+    discardReceived(request);
+
+    QList<QS3Request*> waiting = followers_.values(from);
+    followers_.remove(from);
+    foreach(QS3Request *follower, waiting)
+        followers_.insert(to, follower);
+    if (!request->coalesceKey.isEmpty() && inflight_.value(request->coalesceKey) == from)
+        inflight_[request->coalesceKey] = to;
+
+    if (throttled_.remove(from))
+        throttled_.insert(to);
+    if (request->response && request->type == QS3::GetObject)
+        connect(to, SIGNAL(downloadProgress(qint64, qint64)), request->response, SLOT(downloadProgress(qint64, qint64)));
+}
+
+void QS3Client::releaseConcurrency(QS3Request *request, QNetworkReply *reply, const QByteArray &data)
+{
+    const int httpStatusCode = reply->attribute(QNetworkRequest::HttpStatusCodeAttribute).toInt();
+
+    bool throttled = (httpStatusCode == 503);
+    if (!throttled && reply->error() != QNetworkReply::NoError && !data.isEmpty())
+    {
+        QS3Error error;
+        QString errorParseError;
+        if (QS3Xml::parseError(error, data, errorParseError))
+            throttled = (error.code == "SlowDown" || error.code == "RequestLimitExceeded");
+    }
+
+    // Only answers from S3 tell about its load, connection errors and server errors do not.
+    qint64 latency = -1;
+    if (httpStatusCode >= 200 && httpStatusCode < 500)
+        latency = (request->headersMsecs >= 0 ? request->headersMsecs : request->sentTime.elapsed());
+
+    QString prefix = request->concurrencyPrefix;
+    request->concurrencyPrefix.clear();
+    concurrency_->release(prefix, latency, throttled);
+    dispatchQueued(prefix);
+}
+
+void QS3Client::dispatchQueued(const QString &prefix)
+{
+    while (QS3Request *queuedRequest = concurrency_->dequeue(prefix))
+        dispatch(queuedRequest);
+}
+
+void QS3Client::onReadyRead()
+{
+    QNetworkReply *reply = qobject_cast<QNetworkReply*>(sender());
+    QS3Request *request = (reply ? requests_.value(reply, 0) : 0);
+    if (request)
+        readThrottled(reply, request);
+}
+
+void QS3Client::onThrottleTimer()
+{
+    foreach(QNetworkReply *reply, throttled_.toList())
+    {
+        QS3Request *request = requests_.value(reply, 0);
+        if (request)
+            readThrottled(reply, request);
+        else
+            throttled_.remove(reply);
+    }
+    if (throttled_.isEmpty())
+        throttleTimer_->stop();
+}
+
+void QS3Client::readThrottled(QNetworkReply *reply, QS3Request *request)
+{
+    QList<QS3RateLimiter*> downloadLimiters = limiters(QS3::Download, request->priority);
+    const qint64 pending = reply->bytesAvailable();
+    const qint64 allowed = qMin(pending, QS3RateLimiter::available(downloadLimiters));
+    if (allowed > 0)
+        QS3RateLimiter::consume(downloadLimiters, readReceived(reply, request, allowed));
+
+    if (allowed < pending)
+    {
+        throttled_.insert(reply);
+        if (!throttleTimer_->isActive())
+            throttleTimer_->start();
+    }
+    else
+        throttled_.remove(reply);
+}
+
+qint64 QS3Client::readReceived(QNetworkReply *reply, QS3Request *request, qint64 maxBytes)
+{
+    if (maxBytes <= 0)
+        return 0;
+
+    const qint64 needed = request->receivedSize + maxBytes;
+    if (needed > INT_MAX)
+        return 0;
+    if (needed > request->received.capacity())
+    {
+        // Unknown or wrong Content-Length. Grow geometrically, pooled buffers are size classed.
+        QByteArray larger = bufferPool_->acquire(static_cast<int>(qMin<qint64>(INT_MAX, qMax(needed, 2 * static_cast<qint64>(request->received.capacity())))));
+        if (request->receivedSize > 0)
+            memcpy(larger.data(), request->received.constData(), request->receivedSize);
+        bufferPool_->release(request->received);
+        request->received = larger;
+    }
+    if (needed > request->received.size())
+        request->received.resize(static_cast<int>(needed));
+
+    qint64 read = reply->read(request->received.data() + request->receivedSize, maxBytes);
+    if (read <= 0)
+        return 0;
+    request->receivedSize += static_cast<int>(read);
+    return read;
+}
+
+QByteArray QS3Client::takeReceived(QS3Request *request)
+{
+    QByteArray data = request->received;
+    const int size = request->receivedSize;
+    request->received = QByteArray();
+    request->receivedSize = 0;
+
+    if (size == 0)
+    {
+        bufferPool_->release(data);
+        return QByteArray();
+    }
+    // Within the reserved capacity, does not reallocate.
+    data.resize(size);
+    return data;
+}
+
+void QS3Client::discardReceived(QS3Request *request)
+{
+    bufferPool_->release(request->received);
+    request->receivedSize = 0;
+}
+
+void QS3Client::finishResult(QS3Request *request, QNetworkReply *reply, const QByteArray &data, bool failed)
+{
+    QS3Result result;
+    result.id = request->id;
+    result.tag = request->tag;
+    result.type = request->type;
+    result.key = request->key;
+    result.httpStatusCode = reply->attribute(QNetworkRequest::HttpStatusCodeAttribute).toInt();
+
+    if (failed)
+    {
+        QString errorParseError;
+        if (!QS3Xml::parseError(result.error, data, errorParseError))
+            qDebug() << "Failed to parse error response to QS3Error:" << errorParseError;
+
+        result.succeeded = false;
+        result.error.error = (request->abortReason.isEmpty() ? reply->errorString() : request->abortReason);
+    }
+    else
+    {
+        result.succeeded = true;
+        if (request->type == QS3::GetObject || request->type == QS3::GetAcl || request->type == QS3::InitiateMultipartUpload ||
+            request->type == QS3::ListParts || request->type == QS3::CompleteMultipartUpload)
+            result.data = data;
+        if (request->type == QS3::UploadPart)
+            result.eTag = QString::fromUtf8(reply->rawHeader(QS3::STANDARD_HEADER_ETAG));
+        if (request->type == QS3::GetObject)
+        {
+            result.eTag = QString::fromUtf8(reply->rawHeader(QS3::STANDARD_HEADER_ETAG));
+            result.totalSize = QS3::parseTotalSize(reply->rawHeader(QS3::STANDARD_HEADER_CONTENT_RANGE), reply->header(QNetworkRequest::ContentLengthHeader));
+            result.dataOffset = QS3::parseDataOffset(reply->rawHeader(QS3::STANDARD_HEADER_CONTENT_RANGE), result.httpStatusCode, data.size());
+        }
+    }
+
+    QS3ResultHandler *handler = request->handler;
+    delete request;
+    handler->handleResult(result);
+}
+
+void QS3Client::finishResponse(QS3Request *request, QNetworkReply *reply, const QByteArray &data, bool failed)
+{
+    QS3Response *responseBase = request->response;
+    responseBase->httpStatusCode = reply->attribute(QNetworkRequest::HttpStatusCodeAttribute).toInt();
+    if (failed)
+    {
+        QString errorParseError;
+        if (!QS3Xml::parseError(responseBase->error, data, errorParseError))
+            qDebug() << "Failed to parse error response to QS3Error:" << errorParseError;
+
+        responseBase->succeeded = false;
+        responseBase->error.error = (request->abortReason.isEmpty() ? reply->errorString() : request->abortReason);
+        delete request;
+        emit failed(responseBase, responseBase->error.error);
+        responseBase->emitFinished();
+        responseBase->deleteLater();
+        return;
+    }
+
+    bool errors = false;
+    bool castError = false;
+    QString errorMessage = "";
+
+    responseBase->succeeded = true;
+    switch (responseBase->type)
+    {
+        case QS3::ListObjects:
+        {
+            QS3ListObjectsResponse *response = qobject_cast<QS3ListObjectsResponse*>(responseBase);
+            if (response)
+            {
+                bool parsed = response->v2 ? QS3Xml::parseListObjectsV2(response, data, errorMessage) : QS3Xml::parseListObjects(response, data, errorMessage);
+                if (parsed)
+                {
+                    bool canContinue = response->v2 ? !response->nextContinuationToken.isEmpty() : response->objectCount() > 0;
+                    if (response->isTruncated && response->autoContinue && canContinue)
+                    {
+                        listObjectsContinue(request);
+                        return;
+                    }
+                    emit finished(response);
+                }
+                else
+                    errors = true;
+            }
+            else
+                castError = true;
+            break;
+        }
+        case QS3::RemoveObject:
+        {
             QS3RemoveObjectResponse *response = qobject_cast<QS3RemoveObjectResponse*>(responseBase);
             if (response)
                 emit finished(response);
@@ -428,7 +1985,11 @@ void QS3Client::onReply(QNetworkReply *reply)
             QS3GetObjectResponse *response = qobject_cast<QS3GetObjectResponse*>(responseBase);
             if (response)
             {
-                response->data = reply->readAll();
+                response->data = data;
+                response->bufferPool_ = bufferPool_;
+                response->eTag = QString::fromUtf8(reply->rawHeader(QS3::STANDARD_HEADER_ETAG));
+                response->totalSize = QS3::parseTotalSize(reply->rawHeader(QS3::STANDARD_HEADER_CONTENT_RANGE), reply->header(QNetworkRequest::ContentLengthHeader));
+                response->dataOffset = QS3::parseDataOffset(reply->rawHeader(QS3::STANDARD_HEADER_CONTENT_RANGE), reply->attribute(QNetworkRequest::HttpStatusCodeAttribute).toInt(), data.size());
                 emit finished(response);
             }
             else
@@ -449,7 +2010,7 @@ void QS3Client::onReply(QNetworkReply *reply)
             QS3GetAclResponse *response = qobject_cast<QS3GetAclResponse*>(responseBase);
             if (response)
             {
-                if (QS3Xml::parseAclObjects(response, reply->readAll(), errorMessage))
+                if (QS3Xml::parseAclObjects(response, data, errorMessage))
                     emit finished(response);
                 else
                     errors = true;
@@ -470,10 +2031,11 @@ void QS3Client::onReply(QNetworkReply *reply)
         default:
         {
             errors = true;
-            errorMessage = "Unknown response type " + QString::number((int)responseBase->type) + " from " + cleanUrl;
+            errorMessage = "Unknown response type " + QString::number((int)responseBase->type) + " from " + reply->url().toString(QUrl::RemoveQuery);
             break;
         }
     }
+    delete request;
     
     if (castError)
     {
@@ -491,51 +2053,187 @@ void QS3Client::onReply(QNetworkReply *reply)
     responseBase->deleteLater();
 }
 
-void QS3Client::prepareRequest(QNetworkRequest *request, QString httpVerb)
+QByteArray QS3Client::payloadHash(QS3Request *request)
+{
+    if (!signerV4_)
+        return QByteArray();
+    if (!config_.signPayload)
+        return QS3SignerV4::UnsignedPayload;
+
+    // Retries, resumes and hedges are signed again but the body does not change.
+    if (request->payloadHash.isEmpty())
+        request->payloadHash = QS3SignerV4::payloadHash(request->body);
+    return request->payloadHash;
+}
+
+void QS3Client::prepareRequest(QNetworkRequest *request, QString httpVerb, const QByteArray &payloadHash)
 {   
+    if (signerV4_)
+    {
+        signerV4_->signRequest(request, httpVerb.toLatin1(), payloadHash, QDateTime::currentDateTimeUtc());
+        return;
+    }
+
     // See more from spec http://docs.amazonwebservices.com/AmazonS3/latest/dev/RESTAuthentication.html
 
-    // Timestamp
-    QString timestamp = QS3::generateTimestamp();
-    request->setRawHeader(QS3::STANDARD_HEADER_DATE, timestamp.toUtf8());
+    // Timestamp, formatted once per second.
+    const uint now = static_cast<uint>(time(0));
+    if (now != dateTime_ || date_.isEmpty())
+    {
+        date_ = QS3::generateTimestamp().toLatin1();
+        dateTime_ = now;
+    }
+    request->setRawHeader(QS3::STANDARD_HEADER_DATE, date_);
+
+    // Amazon headers lowercased and sorted for signing. Usually there are none or one.
+    QList<QByteArray> amazonHeaders;
+    foreach(const QByteArray &header, request->rawHeaderList())
+    {
+        if (qstrnicmp(header.constData(), QS3::AMAZON_HEADER_PREFIX.constData(), QS3::AMAZON_HEADER_PREFIX.size()) == 0)
+            amazonHeaders << header.toLower() + ':' + request->rawHeader(header) + '\n';
+    }
+    if (amazonHeaders.size() > 1)
+        qSort(amazonHeaders);
+
+    const QByteArray contentType = request->rawHeader("Content-Type");
+
+    // Sign string, built in a single buffer.
+    QByteArray data;
+    data.reserve(256);
+    data += httpVerb.toLatin1();  // HTTP-Verb
+    data += "\n\n";               // Content-MD5
+    data += contentType;          // Content-Type
+    data += '\n';
+    data += date_;                // Date
+    data += '\n';
+    foreach(const QByteArray &header, amazonHeaders)
+        data += header;           // CanonicalizedAmzHeaders
+    appendCanonicalResource(data, request->url());
+
+    // Returns Base64(HMAC-SHA1(UTF-8-Encoding-Of(StringToSign, YourSecretAccessKeyID))
+    request->setRawHeader(QS3::STANDARD_HEADER_AUTHORIZATION, authPrefix_ + signer_->sign(data).toBase64());
+}
 
+void QS3Client::appendCanonicalResource(QByteArray &data, const QUrl &url) const
+{
     // Resource path with bucket and url path.
-    QString resource = QS3::ROOT_PATH + config_.bucket + request->url().path();
+    data += bucketResource_;
+    data += url.path().toUtf8();
 
     // Keep special amazon header keys and their values. These and only these need to be taken into account in the signing.
-    QString query = QS3::generateOrderedQuery(request->url().queryItems(), QS3::AMAZON_QUERY_KEYS);
-    if (!query.isEmpty())
-        resource += query;
-
-    // Combine amazon headers for signing.
-    QString headers;
-    foreach (QByteArray hdr, request->rawHeaderList())
-        if (hdr.toLower().startsWith(QS3::AMAZON_HEADER_PREFIX))
-            headers.append(hdr.toLower() + ":" + request->rawHeader(hdr) + QS3::NEWLINE);
-            
-    QVariant contentType = request->header(QNetworkRequest::ContentTypeHeader);
-
-    // Sign string.
-    QString data = httpVerb + QS3::NEWLINE       // HTTP-Verb
-                 + QS3::NEWLINE                  // Content-MD5
-                 + (!contentType.isNull() ? contentType.toString() : "") + QS3::NEWLINE  // Content-Type
-                 + timestamp + QS3::NEWLINE      // Date
-                 + headers + resource;                  // CanonicalizedAmzHeaders + CanonicalizedResource
+    if (url.hasQuery())
+        data += QS3::canonicalSubresources(url);
+}
 
-    // Returns Base64(HMAC-SHA1(UTF-8-Encoding-Of(StringToSign, YourSecretAccessKeyID))
-    QString signature = QS3::hmacSha1(data, config_.secredKey);
+QUrl QS3Client::presign(const QString &httpVerb, const QString &key, const QDateTime &expires)
+{
+    QList<QByteArray> urls = presign(httpVerb, QStringList() << key, expires);
+    return !urls.isEmpty() ? QUrl::fromEncoded(urls.first()) : QUrl();
+}
 
-    // Add the main authorization header to the request.
-    QString authHeader = "AWS " + config_.accessKey + ":" + signature;
-    request->setRawHeader(QS3::STANDARD_HEADER_AUTHORIZATION, authHeader.toUtf8());
+QList<QByteArray> QS3Client::presign(const QString &httpVerb, const QStringList &keys, const QDateTime &expires)
+{
+    // See more from spec http://docs.aws.amazon.com/AmazonS3/latest/dev/RESTAuthentication.html#RESTAuthenticationQueryStringAuth
+    QList<QByteArray> urls;
+    if (httpVerb != "GET" && httpVerb != "HEAD" && httpVerb != "PUT" && httpVerb != "DELETE")
+    {
+        qDebug() << "QS3Client::presign() Error: Unsupported HTTP verb" << httpVerb;
+        return urls;
+    }
+    if (!expires.isValid())
+    {
+        qDebug() << "QS3Client::presign() Error: Invalid expiration time.";
+        return urls;
+    }
+
+    // SignatureV4 urls carry the signing time and their validity in seconds.
+    const QDateTime now = QDateTime::currentDateTimeUtc();
+    const int expiresSecs = now.secsTo(expires.toUTC());
+    if (signerV4_ && (expiresSecs <= 0 || expiresSecs > 7 * 24 * 3600))
+    {
+        qDebug() << "QS3Client::presign() Error: SignatureV4 expiration time must be in the future and at most a week from now.";
+        return urls;
+    }
+
+    // Everything but the resource path is shared by all urls, the string to sign
+    // and url are built in place with only the key part changing per url.
+    const QByteArray expiresStr = QByteArray::number(static_cast<qint64>(expires.toTime_t()));
+    QByteArray data = httpVerb.toLatin1() + "\n"    // HTTP-Verb
+                    + "\n"                           // Content-MD5
+                    + "\n"                           // Content-Type
+                    + expiresStr + "\n"              // Expires
+                    + QS3::ROOT_PATH.toUtf8() + config_.bucket.toUtf8();  // CanonicalizedResource
+    const int dataPrefixSize = data.size();
+
+    const QByteArray base = baseUrl();
+    const QByteArray host = QS3SignerV4::hostHeader(QUrl::fromEncoded(base));
+    const QByteArray query = "?AWSAccessKeyId=" + QUrl::toPercentEncoding(config_.accessKey) + "&Expires=" + expiresStr + "&Signature=";
+
+    urls.reserve(keys.size());
+    foreach(const QString &key, keys)
+    {
+        if (key.trimmed().isEmpty() || key.trimmed() == QS3::ROOT_PATH)
+        {
+            qDebug() << "QS3Client::presign() Error: Cannot be called with empty or \"/\" key.";
+            urls << QByteArray();
+            continue;
+        }
+
+        QByteArray path = key.toUtf8();
+        if (!path.startsWith('/'))
+            path.prepend('/');
+
+        if (signerV4_)
+        {
+            const QByteArray encodedPath = QUrl::toPercentEncoding(QString::fromUtf8(path), "/");
+            urls << base + encodedPath + '?' + signerV4_->presignQuery(httpVerb.toLatin1(), encodedPath, host, expiresSecs, now);
+            continue;
+        }
+
+        data.resize(dataPrefixSize);
+        data.append(path);
+
+        // Base64(HMAC-SHA1(UTF-8-Encoding-Of(StringToSign, YourSecretAccessKeyID))
+        QByteArray signature = signer_->sign(data).toBase64();
+
+        QByteArray url;
+        url.reserve(base.size() + path.size() * 3 + query.size() + signature.size() * 3);
+        url.append(base);
+        url.append(QUrl::toPercentEncoding(path, "/"));
+        url.append(query);
+        url.append(QUrl::toPercentEncoding(signature));
+        urls << url;
+    }
+    return urls;
 }
 
-QS3UrlPair QS3Client::generateUrl(QString key, const Q3SQueryParams &queryParams)
+QByteArray QS3Client::baseUrl() const
+{
+    return baseUrl_;
+}
+
+void QS3Client::updateRequestTemplate()
 {
     QString urlStr = "http://" + config_.bucket;
     urlStr += (config_.host.startsWith(".") ? config_.host : "." + config_.host);
+    baseUrl_ = urlStr.toUtf8();
+
+    bucketResource_ = (QS3::ROOT_PATH + config_.bucket).toUtf8();
+    authPrefix_ = "AWS " + config_.accessKey.toUtf8() + ":";
+}
+
+QS3UrlPair QS3Client::generateUrl(QString key, const Q3SQueryParams &queryParams)
+{
     if (!key.startsWith(QS3::ROOT_PATH))
-        key = QS3::ROOT_PATH + key;
-    urlStr = QUrl(urlStr + key).toString() + QS3::generateOrderedQuery(queryParams);
-    return QS3UrlPair(key, QUrl(urlStr));
+        key.prepend(QS3::ROOT_PATH);
+
+    // Built encoded and parsed once.
+    const QByteArray path = QUrl::toPercentEncoding(key, "/");
+    QByteArray urlBytes;
+    urlBytes.reserve(baseUrl_.size() + path.size() + 64);
+    urlBytes += baseUrl_;
+    urlBytes += path;
+    if (!queryParams.isEmpty())
+        urlBytes += QS3::generateOrderedQuery(queryParams).toUtf8();
+    return QS3UrlPair(key, QUrl::fromEncoded(urlBytes));
 }
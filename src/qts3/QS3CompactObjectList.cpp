@@ -0,0 +1,316 @@
+
+#include "QS3CompactObjectList.h"
+#include "QS3Defines.h"
+
+#include <QDebug>
+
+#include <climits>
+
+namespace
+{
+    static const int ETAG_DIGEST_SIZE = 16;
+
+    int parseDigits(const QChar *str, int count)
+    {
+        int value = 0;
+        for (int i=0; i<count; ++i)
+        {
+            int digit = str[i].digitValue();
+            if (digit < 0)
+                return -1;
+            value = value * 10 + digit;
+        }
+        return value;
+    }
+
+    // Parses S3 timestamps "2009-10-12T17:50:30.000Z" without going through
+    // the generic QDateTime string parsing.
+    qint64 parseTimestamp(const QString &timestamp)
+    {
+        if (timestamp.isEmpty())
+            return 0;
+
+        const QChar *s = timestamp.constData();
+        if (timestamp.length() >= 19 && s[4] == '-' && s[7] == '-' && s[10] == 'T' && s[13] == ':' && s[16] == ':')
+        {
+            int year = parseDigits(s, 4);
+            int month = parseDigits(s + 5, 2);
+            int day = parseDigits(s + 8, 2);
+            int hour = parseDigits(s + 11, 2);
+            int minute = parseDigits(s + 14, 2);
+            int second = parseDigits(s + 17, 2);
+            int msec = 0;
+            if (timestamp.length() >= 23 && s[19] == '.')
+                msec = parseDigits(s + 20, 3);
+            if (year >= 0 && month >= 0 && day >= 0 && hour >= 0 && minute >= 0 && second >= 0 && msec >= 0)
+            {
+                QDateTime dt(QDate(year, month, day), QTime(hour, minute, second, msec), Qt::UTC);
+                if (dt.isValid())
+                    return dt.toMSecsSinceEpoch();
+            }
+        }
+
+        QDateTime dt = QDateTime::fromString(timestamp, Qt::ISODate);
+        if (!dt.isValid())
+        {
+            qDebug() << "QS3CompactObjectList: Failed to parse timestamp" << timestamp;
+            return 0;
+        }
+        dt.setTimeSpec(Qt::UTC);
+        return dt.toMSecsSinceEpoch();
+    }
+}
+
+// QS3ObjectView
+
+QS3ObjectView::QS3ObjectView(const QS3CompactObjectList *list, int index) :
+    list_(list),
+    index_(index)
+{
+}
+
+QString QS3ObjectView::key() const
+{
+    return list_->key(index_);
+}
+
+QByteArray QS3ObjectView::keyUtf8() const
+{
+    return list_->keyUtf8(index_);
+}
+
+QString QS3ObjectView::eTag() const
+{
+    if (list_->irregularETags_.contains(index_))
+        return list_->irregularETags_.value(index_);
+    return "\"" + QString::fromLatin1(eTagDigest().toHex()) + "\"";
+}
+
+QByteArray QS3ObjectView::eTagDigest() const
+{
+    if (list_->irregularETags_.contains(index_))
+        return QByteArray();
+    return list_->eTags_.mid(index_ * ETAG_DIGEST_SIZE, ETAG_DIGEST_SIZE);
+}
+
+qint64 QS3ObjectView::lastModifiedMSecs() const
+{
+    return list_->lastModified_[index_];
+}
+
+QDateTime QS3ObjectView::lastModified() const
+{
+    return QDateTime::fromMSecsSinceEpoch(lastModifiedMSecs()).toUTC();
+}
+
+qint64 QS3ObjectView::size() const
+{
+    return list_->sizes_[index_];
+}
+
+bool QS3ObjectView::isDir() const
+{
+    return list_->dirs_.testBit(index_);
+}
+
+int QS3ObjectView::index() const
+{
+    return index_;
+}
+
+QS3Object QS3ObjectView::toObject() const
+{
+    QS3Object object;
+    object.key = key();
+    object.lastModified = lastModified().toString("yyyy-MM-ddThh:mm:ss.zzzZ");
+    object.eTag = eTag();
+    object.size = static_cast<uint>(qBound<qint64>(0, size(), UINT_MAX));
+    object.isDir = isDir();
+    return object;
+}
+
+// QS3CompactObjectList
+
+QS3CompactObjectList::QS3CompactObjectList()
+{
+}
+
+QS3CompactObjectList::QS3CompactObjectList(const QS3CompactObjectList &other)
+{
+    keyArena_ = other.keyArena_;
+    keyOffsets_ = other.keyOffsets_;
+    sharedLengths_ = other.sharedLengths_;
+    eTags_ = other.eTags_;
+    lastModified_ = other.lastModified_;
+    sizes_ = other.sizes_;
+    dirs_ = other.dirs_;
+    irregularETags_ = other.irregularETags_;
+    lastKey_ = other.lastKey_;
+}
+
+QS3CompactObjectList::~QS3CompactObjectList()
+{
+}
+
+void QS3CompactObjectList::append(const QS3Object &object)
+{
+    append(object.key, object.lastModified, object.eTag, object.size, object.isDir);
+}
+
+void QS3CompactObjectList::append(const QString &key, const QString &lastModified, const QString &eTag, qint64 size, bool isDir)
+{
+    const int index = keyOffsets_.size();
+    QByteArray keyBytes = key.toUtf8();
+
+    // Key: shared prefix length with the previous key + the remaining suffix.
+    int shared = 0;
+    if (index % RestartInterval != 0)
+    {
+        const int maxShared = qMin(qMin(keyBytes.size(), lastKey_.size()), 0xFFFF);
+        const char *a = keyBytes.constData();
+        const char *b = lastKey_.constData();
+        while (shared < maxShared && a[shared] == b[shared])
+            ++shared;
+    }
+    keyOffsets_.append(static_cast<quint32>(keyArena_.size()));
+    sharedLengths_.append(static_cast<quint16>(shared));
+    keyArena_.append(keyBytes.constData() + shared, keyBytes.size() - shared);
+    lastKey_ = keyBytes;
+
+    // ETag: 16 byte MD5 digest, keep anything else as is.
+    QString hex = eTag;
+    if (hex.startsWith('"'))
+        hex = hex.mid(1);
+    if (hex.endsWith('"'))
+        hex.chop(1);
+    QByteArray digest = QByteArray::fromHex(hex.toLatin1());
+    if (hex.length() == ETAG_DIGEST_SIZE * 2 && digest.size() == ETAG_DIGEST_SIZE)
+        eTags_.append(digest);
+    else
+    {
+        eTags_.append(QByteArray(ETAG_DIGEST_SIZE, '\0'));
+        if (!eTag.isEmpty())
+            irregularETags_[index] = eTag;
+    }
+
+    lastModified_.append(parseTimestamp(lastModified));
+    sizes_.append(size);
+    dirs_.resize(index + 1);
+    if (isDir)
+        dirs_.setBit(index);
+}
+
+int QS3CompactObjectList::size() const
+{
+    return keyOffsets_.size();
+}
+
+bool QS3CompactObjectList::isEmpty() const
+{
+    return keyOffsets_.isEmpty();
+}
+
+QS3ObjectView QS3CompactObjectList::at(int index) const
+{
+    Q_ASSERT(index >= 0 && index < size());
+    return QS3ObjectView(this, index);
+}
+
+QS3ObjectView QS3CompactObjectList::last() const
+{
+    Q_ASSERT(!isEmpty());
+    return QS3ObjectView(this, size() - 1);
+}
+
+QString QS3CompactObjectList::key(int index) const
+{
+    return QString::fromUtf8(keyUtf8(index));
+}
+
+QByteArray QS3CompactObjectList::keyUtf8(int index) const
+{
+    if (index == size() - 1)
+        return lastKey_;
+    QByteArray key;
+    decodeKey(index, key);
+    return key;
+}
+
+void QS3CompactObjectList::decodeKey(int index, QByteArray &dest) const
+{
+    const int last = size() - 1;
+    for (int i = index - (index % RestartInterval); i <= index; ++i)
+    {
+        const quint32 start = keyOffsets_[i];
+        const quint32 end = (i < last ? keyOffsets_[i+1] : static_cast<quint32>(keyArena_.size()));
+        const int shared = sharedLengths_[i];
+        if (shared == 0)
+            dest = QByteArray(keyArena_.constData() + start, end - start);
+        else
+        {
+            dest.resize(shared);
+            dest.append(keyArena_.constData() + start, end - start);
+        }
+    }
+}
+
+void QS3CompactObjectList::reserve(int entries, int averageSuffixLength)
+{
+    if (entries <= keyOffsets_.capacity())
+        return;
+    entries = qMax(entries, 2 * keyOffsets_.capacity());
+    keyArena_.reserve(entries * averageSuffixLength);
+    keyOffsets_.reserve(entries);
+    sharedLengths_.reserve(entries);
+    eTags_.reserve(entries * ETAG_DIGEST_SIZE);
+    lastModified_.reserve(entries);
+    sizes_.reserve(entries);
+}
+
+void QS3CompactObjectList::squeeze()
+{
+    keyArena_.squeeze();
+    keyOffsets_.squeeze();
+    sharedLengths_.squeeze();
+    eTags_.squeeze();
+    lastModified_.squeeze();
+    sizes_.squeeze();
+    irregularETags_.squeeze();
+}
+
+void QS3CompactObjectList::clear()
+{
+    keyArena_.clear();
+    keyOffsets_.clear();
+    sharedLengths_.clear();
+    eTags_.clear();
+    lastModified_.clear();
+    sizes_.clear();
+    dirs_.clear();
+    irregularETags_.clear();
+    lastKey_.clear();
+}
+
+qint64 QS3CompactObjectList::memoryUsage() const
+{
+    qint64 bytes = keyArena_.capacity();
+    bytes += keyOffsets_.capacity() * sizeof(quint32);
+    bytes += sharedLengths_.capacity() * sizeof(quint16);
+    bytes += eTags_.capacity();
+    bytes += lastModified_.capacity() * sizeof(qint64);
+    bytes += sizes_.capacity() * sizeof(qint64);
+    bytes += dirs_.size() / 8;
+    bytes += lastKey_.capacity();
+    foreach(const QString &eTag, irregularETags_)
+        bytes += eTag.capacity() * sizeof(QChar) + sizeof(int) * 2;
+    return bytes;
+}
+
+QList<QS3Object> QS3CompactObjectList::toObjectList() const
+{
+    QList<QS3Object> objects;
+    objects.reserve(size());
+    for (const_iterator iter = begin(); iter != end(); ++iter)
+        objects << (*iter).toObject();
+    return objects;
+}
@@ -0,0 +1,201 @@
+
+#include "QS3ConcurrencyLimiter.h"
+#include "QS3Request.h"
+
+namespace
+{
+    /// Latency over this multiple of the baseline counts as queueing in Amazon S3.
+    static const double LATENCY_TOLERANCE = 2.0;
+    static const double LATENCY_DECREASE = 0.9;
+    static const double THROTTLE_DECREASE = 0.5;
+
+    /// Weight of a new sample in the smoothed latency and the upward drift of the baseline.
+    static const double SMOOTHING = 0.125;
+    static const double BASELINE_DRIFT = 0.01;
+
+    /// Milliseconds an idle window is remembered.
+    static const qint64 IDLE_EXPIRY = 60000;
+}
+
+QS3ConcurrencyLimiter::Window::Window(int initialLimit) :
+    limit(initialLimit),
+    inFlight(0),
+    baselineLatency(-1.0),
+    smoothedLatency(-1.0),
+    lastDecrease(-1),
+    idleSince(-1)
+{
+}
+
+QS3ConcurrencyLimiter::QS3ConcurrencyLimiter(int initialLimit, int maxLimit) :
+    maxLimit_(qMax(1, maxLimit)),
+    lastExpiry_(0)
+{
+    initialLimit_ = qBound(1, initialLimit, maxLimit_);
+    clock_.start();
+}
+
+bool QS3ConcurrencyLimiter::tryAcquire(const QString &prefix)
+{
+    expireIdle();
+    QHash<QString, Window>::iterator iter = windows_.find(prefix);
+    if (iter == windows_.end())
+        iter = windows_.insert(prefix, Window(initialLimit_));
+
+    // Queued requests go first.
+    Window &window = iter.value();
+    if (!window.queue.isEmpty() || window.inFlight >= static_cast<int>(window.limit))
+        return false;
+    window.inFlight++;
+    window.idleSince = -1;
+    return true;
+}
+
+void QS3ConcurrencyLimiter::release(const QString &prefix)
+{
+    QHash<QString, Window>::iterator iter = windows_.find(prefix);
+    if (iter == windows_.end())
+        return;
+    iter.value().inFlight = qMax(0, iter.value().inFlight - 1);
+    removeIfIdle(prefix);
+}
+
+void QS3ConcurrencyLimiter::release(const QString &prefix, qint64 latencyMsecs, bool throttled)
+{
+    QHash<QString, Window>::iterator iter = windows_.find(prefix);
+    if (iter == windows_.end())
+        return;
+
+    Window &window = iter.value();
+    window.inFlight = qMax(0, window.inFlight - 1);
+
+    if (throttled)
+        decrease(window, THROTTLE_DECREASE);
+    else if (latencyMsecs >= 0)
+    {
+        const double latency = static_cast<double>(latencyMsecs);
+        if (window.baselineLatency < 0.0 || latency < window.baselineLatency)
+            window.baselineLatency = latency;
+        else
+            window.baselineLatency += (latency - window.baselineLatency) * BASELINE_DRIFT;
+        window.smoothedLatency = (window.smoothedLatency < 0.0 ? latency : window.smoothedLatency + (latency - window.smoothedLatency) * SMOOTHING);
+
+        if (window.smoothedLatency > window.baselineLatency * LATENCY_TOLERANCE + 1.0)
+            decrease(window, LATENCY_DECREASE);
+        else if (window.inFlight + 1 >= static_cast<int>(window.limit))
+        {
+            // Grow by about one per round trip, only when the window is actually used.
+            window.limit = qMin<double>(maxLimit_, window.limit + 1.0 / window.limit);
+        }
+    }
+    removeIfIdle(prefix);
+}
+
+void QS3ConcurrencyLimiter::decrease(Window &window, double factor)
+{
+    // Responses to requests sent before the last decrease do not shrink the window again.
+    const qint64 now = clock_.elapsed();
+    const qint64 holdOff = (window.smoothedLatency > 0.0 ? static_cast<qint64>(window.smoothedLatency) : 100);
+    if (window.lastDecrease >= 0 && now - window.lastDecrease < holdOff)
+        return;
+
+    window.limit = qMax(1.0, window.limit * factor);
+    window.lastDecrease = now;
+}
+
+void QS3ConcurrencyLimiter::removeIfIdle(const QString &prefix)
+{
+    QHash<QString, Window>::iterator iter = windows_.find(prefix);
+    if (iter == windows_.end() || iter.value().inFlight > 0 || !iter.value().queue.isEmpty())
+        return;
+
+    // A window at the initial limit is what a new one would be. Grown and shrunk
+    // windows are kept for the next burst to the prefix until they expire.
+    if (iter.value().limit == static_cast<double>(initialLimit_))
+        windows_.erase(iter);
+    else if (iter.value().idleSince < 0)
+        iter.value().idleSince = clock_.elapsed();
+}
+
+void QS3ConcurrencyLimiter::expireIdle()
+{
+    // Swept at most once per expiry time, tryAcquire is called for every request.
+    const qint64 now = clock_.elapsed();
+    if (now - lastExpiry_ < IDLE_EXPIRY)
+        return;
+    lastExpiry_ = now;
+
+    QHash<QString, Window>::iterator iter = windows_.begin();
+    while (iter != windows_.end())
+    {
+        if (iter.value().idleSince >= 0 && now - iter.value().idleSince >= IDLE_EXPIRY)
+            iter = windows_.erase(iter);
+        else
+            ++iter;
+    }
+}
+
+void QS3ConcurrencyLimiter::enqueue(const QString &prefix, QS3Request *request)
+{
+    QHash<QString, Window>::iterator iter = windows_.find(prefix);
+    if (iter == windows_.end())
+        iter = windows_.insert(prefix, Window(initialLimit_));
+    iter.value().idleSince = -1;
+    iter.value().queue.enqueue(request);
+}
+
+QS3Request *QS3ConcurrencyLimiter::dequeue(const QString &prefix)
+{
+    QHash<QString, Window>::iterator iter = windows_.find(prefix);
+    if (iter == windows_.end())
+        return 0;
+
+    Window &window = iter.value();
+    if (window.queue.isEmpty() || window.inFlight >= static_cast<int>(window.limit))
+        return 0;
+    window.inFlight++;
+    window.idleSince = -1;
+    return window.queue.dequeue();
+}
+
+QS3Request *QS3ConcurrencyLimiter::take(QS3RequestId id)
+{
+    QHash<QString, Window>::iterator iter = windows_.begin();
+    for (; iter != windows_.end(); ++iter)
+    {
+        QQueue<QS3Request*> &queue = iter.value().queue;
+        for (int i=0; i<queue.size(); ++i)
+        {
+            if (queue[i]->id != id)
+                continue;
+            QS3Request *request = queue.takeAt(i);
+            removeIfIdle(iter.key());
+            return request;
+        }
+    }
+    return 0;
+}
+
+QList<QS3Request*> QS3ConcurrencyLimiter::takeAll()
+{
+    QList<QS3Request*> requests;
+    QHash<QString, Window>::iterator iter = windows_.begin();
+    for (; iter != windows_.end(); ++iter)
+    {
+        requests << iter.value().queue;
+        iter.value().queue.clear();
+    }
+    return requests;
+}
+
+int QS3ConcurrencyLimiter::limit(const QString &prefix) const
+{
+    QHash<QString, Window>::const_iterator iter = windows_.find(prefix);
+    return (iter != windows_.end() ? static_cast<int>(iter.value().limit) : initialLimit_);
+}
+
+int QS3ConcurrencyLimiter::inFlight(const QString &prefix) const
+{
+    QHash<QString, Window>::const_iterator iter = windows_.find(prefix);
+    return (iter != windows_.end() ? iter.value().inFlight : 0);
+}
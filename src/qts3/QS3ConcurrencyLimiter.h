@@ -0,0 +1,80 @@
+
+#pragma once
+
+#include "QS3Fwd.h"
+#include "QS3Defines.h"
+
+#include <QString>
+#include <QHash>
+#include <QQueue>
+#include <QList>
+#include <QElapsedTimer>
+
+/// QS3ConcurrencyLimiter
+
+/** Adaptive limit of concurrent requests per key prefix. Amazon S3 throttles
+    per prefix partition, so each prefix has its own window that grows
+    additively while latency is stable and shrinks multiplicatively on
+    SlowDown responses or inflated latency (AIMD). Requests that do not
+    fit their window wait in a per prefix queue. Idle windows that differ
+    from the initial limit are forgotten after a minute without requests. */
+class QS3ConcurrencyLimiter
+{
+public:
+    QS3ConcurrencyLimiter(int initialLimit, int maxLimit);
+
+    /// Takes a slot for prefix if the window allows.
+    bool tryAcquire(const QString &prefix);
+
+    /// Releases a slot without a latency sample, eg. for a canceled request.
+    void release(const QString &prefix);
+
+    /// Releases a slot and adapts the window.
+    /** @param qint64 latency until the response headers in milliseconds, negative if unknown.
+        @param bool true if the request was throttled by Amazon S3. */
+    void release(const QString &prefix, qint64 latencyMsecs, bool throttled);
+
+    /// Queues a request that did not get a slot.
+    void enqueue(const QString &prefix, QS3Request *request);
+
+    /// Takes a slot and returns the next queued request for prefix, null if there is none or no slot.
+    QS3Request *dequeue(const QString &prefix);
+
+    /// Removes a queued request by id, null if not found.
+    QS3Request *take(QS3RequestId id);
+
+    /// Removes and returns all queued requests.
+    QList<QS3Request*> takeAll();
+
+    /// Returns the current window size for prefix.
+    int limit(const QString &prefix) const;
+
+    /// Returns the number of requests in flight for prefix.
+    int inFlight(const QString &prefix) const;
+
+private:
+    struct Window
+    {
+        Window(int initialLimit);
+
+        double limit;
+        int inFlight;
+        double baselineLatency;
+        double smoothedLatency;
+        qint64 lastDecrease;
+        qint64 idleSince;
+        QQueue<QS3Request*> queue;
+    };
+
+    void decrease(Window &window, double factor);
+    void removeIfIdle(const QString &prefix);
+
+    /// Removes windows that have been idle longer than the expiry time.
+    void expireIdle();
+
+    int initialLimit_;
+    int maxLimit_;
+    QHash<QString, Window> windows_;
+    QElapsedTimer clock_;
+    qint64 lastExpiry_;
+};
@@ -0,0 +1,403 @@
+
+#include "QS3Crypto.h"
+
+#include <string.h>
+
+namespace
+{
+    inline quint32 rotateLeft(quint32 value, int bits)
+    {
+        return (value << bits) | (value >> (32 - bits));
+    }
+
+    inline quint32 rotateRight(quint32 value, int bits)
+    {
+        return (value >> bits) | (value << (32 - bits));
+    }
+
+    // http://csrc.nist.gov/publications/fips/fips180-4/fips-180-4.pdf 4.2.2
+    static const quint32 SHA256_K[64] =
+    {
+        0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+        0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+        0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+        0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+        0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+        0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+        0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+        0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2
+    };
+}
+
+// QS3Sha1
+
+QS3Sha1::QS3Sha1()
+{
+    reset();
+}
+
+void QS3Sha1::reset()
+{
+    // http://tools.ietf.org/html/rfc3174 6.1
+    h_[0] = 0x67452301;
+    h_[1] = 0xEFCDAB89;
+    h_[2] = 0x98BADCFE;
+    h_[3] = 0x10325476;
+    h_[4] = 0xC3D2E1F0;
+    length_ = 0;
+    bufferSize_ = 0;
+}
+
+void QS3Sha1::addData(const QByteArray &data)
+{
+    addData(data.constData(), data.size());
+}
+
+void QS3Sha1::addData(const char *data, int length)
+{
+    const uchar *input = reinterpret_cast<const uchar*>(data);
+    length_ += length;
+
+    if (bufferSize_ > 0)
+    {
+        int count = qMin(length, BlockSize - bufferSize_);
+        memcpy(buffer_ + bufferSize_, input, count);
+        bufferSize_ += count;
+        input += count;
+        length -= count;
+        if (bufferSize_ < BlockSize)
+            return;
+        processBlock(buffer_);
+        bufferSize_ = 0;
+    }
+    while (length >= BlockSize)
+    {
+        processBlock(input);
+        input += BlockSize;
+        length -= BlockSize;
+    }
+    if (length > 0)
+    {
+        memcpy(buffer_, input, length);
+        bufferSize_ = length;
+    }
+}
+
+void QS3Sha1::result(uchar *digest) const
+{
+    QS3Sha1 final(*this);
+
+    // Padding: 0x80, zeros and the message length in bits as 64-bit big endian.
+    const quint64 bits = length_ * 8;
+    uchar padding[BlockSize * 2];
+    memset(padding, 0, sizeof(padding));
+    padding[0] = 0x80;
+    int padLength = (bufferSize_ < 56 ? 56 - bufferSize_ : 120 - bufferSize_);
+    for (int i=0; i<8; ++i)
+        padding[padLength + i] = static_cast<uchar>(bits >> (56 - i * 8));
+    final.addData(reinterpret_cast<const char*>(padding), padLength + 8);
+
+    for (int i=0; i<5; ++i)
+    {
+        digest[i*4]     = static_cast<uchar>(final.h_[i] >> 24);
+        digest[i*4 + 1] = static_cast<uchar>(final.h_[i] >> 16);
+        digest[i*4 + 2] = static_cast<uchar>(final.h_[i] >> 8);
+        digest[i*4 + 3] = static_cast<uchar>(final.h_[i]);
+    }
+}
+
+QByteArray QS3Sha1::result() const
+{
+    QByteArray digest(DigestSize, '\0');
+    result(reinterpret_cast<uchar*>(digest.data()));
+    return digest;
+}
+
+void QS3Sha1::processBlock(const uchar *block)
+{
+    // http://tools.ietf.org/html/rfc3174 6.1
+    quint32 w[80];
+    for (int i=0; i<16; ++i)
+        w[i] = (quint32(block[i*4]) << 24) | (quint32(block[i*4 + 1]) << 16) | (quint32(block[i*4 + 2]) << 8) | quint32(block[i*4 + 3]);
+    for (int i=16; i<80; ++i)
+        w[i] = rotateLeft(w[i-3] ^ w[i-8] ^ w[i-14] ^ w[i-16], 1);
+
+    quint32 a = h_[0], b = h_[1], c = h_[2], d = h_[3], e = h_[4];
+    for (int i=0; i<80; ++i)
+    {
+        quint32 f, k;
+        if (i < 20)
+        {
+            f = (b & c) | (~b & d);
+            k = 0x5A827999;
+        }
+        else if (i < 40)
+        {
+            f = b ^ c ^ d;
+            k = 0x6ED9EBA1;
+        }
+        else if (i < 60)
+        {
+            f = (b & c) | (b & d) | (c & d);
+            k = 0x8F1BBCDC;
+        }
+        else
+        {
+            f = b ^ c ^ d;
+            k = 0xCA62C1D6;
+        }
+        quint32 temp = rotateLeft(a, 5) + f + e + k + w[i];
+        e = d;
+        d = c;
+        c = rotateLeft(b, 30);
+        b = a;
+        a = temp;
+    }
+
+    h_[0] += a;
+    h_[1] += b;
+    h_[2] += c;
+    h_[3] += d;
+    h_[4] += e;
+}
+
+// QS3HmacSha1
+
+QS3HmacSha1::QS3HmacSha1(const QByteArray &key)
+{
+    setKey(key);
+}
+
+void QS3HmacSha1::setKey(const QByteArray &key)
+{
+    /* http://tools.ietf.org/html/rfc2104 - (1) */
+    QByteArray keyBytes = key;
+    if (keyBytes.size() > QS3Sha1::BlockSize)
+    {
+        QS3Sha1 hash;
+        hash.addData(keyBytes);
+        keyBytes = hash.result();
+    }
+
+    /* http://tools.ietf.org/html/rfc2104 - (2) & (5) */
+    char ipad[QS3Sha1::BlockSize];
+    char opad[QS3Sha1::BlockSize];
+    memset(ipad, 0x36, sizeof(ipad));
+    memset(opad, 0x5c, sizeof(opad));
+    for (int i=0; i<keyBytes.size(); ++i)
+    {
+        ipad[i] ^= keyBytes[i];
+        opad[i] ^= keyBytes[i];
+    }
+
+    // Absorb the pads once, signing continues from these states.
+    inner_.reset();
+    inner_.addData(ipad, sizeof(ipad));
+    outer_.reset();
+    outer_.addData(opad, sizeof(opad));
+}
+
+QByteArray QS3HmacSha1::sign(const QByteArray &message) const
+{
+    return sign(message.constData(), message.size());
+}
+
+QByteArray QS3HmacSha1::sign(const char *message, int length) const
+{
+    /* http://tools.ietf.org/html/rfc2104 - (3) & (4) */
+    uchar innerDigest[QS3Sha1::DigestSize];
+    QS3Sha1 inner(inner_);
+    inner.addData(message, length);
+    inner.result(innerDigest);
+
+    /* http://tools.ietf.org/html/rfc2104 - (6) & (7) */
+    QS3Sha1 outer(outer_);
+    outer.addData(reinterpret_cast<const char*>(innerDigest), QS3Sha1::DigestSize);
+    return outer.result();
+}
+
+// QS3Sha256
+
+QS3Sha256::QS3Sha256()
+{
+    reset();
+}
+
+void QS3Sha256::reset()
+{
+    // http://csrc.nist.gov/publications/fips/fips180-4/fips-180-4.pdf 5.3.3
+    h_[0] = 0x6a09e667;
+    h_[1] = 0xbb67ae85;
+    h_[2] = 0x3c6ef372;
+    h_[3] = 0xa54ff53a;
+    h_[4] = 0x510e527f;
+    h_[5] = 0x9b05688c;
+    h_[6] = 0x1f83d9ab;
+    h_[7] = 0x5be0cd19;
+    length_ = 0;
+    bufferSize_ = 0;
+}
+
+void QS3Sha256::addData(const QByteArray &data)
+{
+    addData(data.constData(), data.size());
+}
+
+void QS3Sha256::addData(const char *data, int length)
+{
+    const uchar *input = reinterpret_cast<const uchar*>(data);
+    length_ += length;
+
+    if (bufferSize_ > 0)
+    {
+        int count = qMin(length, BlockSize - bufferSize_);
+        memcpy(buffer_ + bufferSize_, input, count);
+        bufferSize_ += count;
+        input += count;
+        length -= count;
+        if (bufferSize_ < BlockSize)
+            return;
+        processBlock(buffer_);
+        bufferSize_ = 0;
+    }
+    while (length >= BlockSize)
+    {
+        processBlock(input);
+        input += BlockSize;
+        length -= BlockSize;
+    }
+    if (length > 0)
+    {
+        memcpy(buffer_, input, length);
+        bufferSize_ = length;
+    }
+}
+
+void QS3Sha256::result(uchar *digest) const
+{
+    QS3Sha256 final(*this);
+
+    // Same padding as SHA-1.
+    const quint64 bits = length_ * 8;
+    uchar padding[BlockSize * 2];
+    memset(padding, 0, sizeof(padding));
+    padding[0] = 0x80;
+    int padLength = (bufferSize_ < 56 ? 56 - bufferSize_ : 120 - bufferSize_);
+    for (int i=0; i<8; ++i)
+        padding[padLength + i] = static_cast<uchar>(bits >> (56 - i * 8));
+    final.addData(reinterpret_cast<const char*>(padding), padLength + 8);
+
+    for (int i=0; i<8; ++i)
+    {
+        digest[i*4]     = static_cast<uchar>(final.h_[i] >> 24);
+        digest[i*4 + 1] = static_cast<uchar>(final.h_[i] >> 16);
+        digest[i*4 + 2] = static_cast<uchar>(final.h_[i] >> 8);
+        digest[i*4 + 3] = static_cast<uchar>(final.h_[i]);
+    }
+}
+
+QByteArray QS3Sha256::result() const
+{
+    QByteArray digest(DigestSize, '\0');
+    result(reinterpret_cast<uchar*>(digest.data()));
+    return digest;
+}
+
+QByteArray QS3Sha256::hash(const QByteArray &data)
+{
+    QS3Sha256 sha;
+    sha.addData(data);
+    return sha.result();
+}
+
+void QS3Sha256::processBlock(const uchar *block)
+{
+    // http://csrc.nist.gov/publications/fips/fips180-4/fips-180-4.pdf 6.2.2
+    quint32 w[64];
+    for (int i=0; i<16; ++i)
+        w[i] = (quint32(block[i*4]) << 24) | (quint32(block[i*4 + 1]) << 16) | (quint32(block[i*4 + 2]) << 8) | quint32(block[i*4 + 3]);
+    for (int i=16; i<64; ++i)
+    {
+        quint32 s0 = rotateRight(w[i-15], 7) ^ rotateRight(w[i-15], 18) ^ (w[i-15] >> 3);
+        quint32 s1 = rotateRight(w[i-2], 17) ^ rotateRight(w[i-2], 19) ^ (w[i-2] >> 10);
+        w[i] = w[i-16] + s0 + w[i-7] + s1;
+    }
+
+    quint32 a = h_[0], b = h_[1], c = h_[2], d = h_[3], e = h_[4], f = h_[5], g = h_[6], h = h_[7];
+    for (int i=0; i<64; ++i)
+    {
+        quint32 s1 = rotateRight(e, 6) ^ rotateRight(e, 11) ^ rotateRight(e, 25);
+        quint32 ch = (e & f) ^ (~e & g);
+        quint32 temp1 = h + s1 + ch + SHA256_K[i] + w[i];
+        quint32 s0 = rotateRight(a, 2) ^ rotateRight(a, 13) ^ rotateRight(a, 22);
+        quint32 maj = (a & b) ^ (a & c) ^ (b & c);
+        quint32 temp2 = s0 + maj;
+        h = g;
+        g = f;
+        f = e;
+        e = d + temp1;
+        d = c;
+        c = b;
+        b = a;
+        a = temp1 + temp2;
+    }
+
+    h_[0] += a;
+    h_[1] += b;
+    h_[2] += c;
+    h_[3] += d;
+    h_[4] += e;
+    h_[5] += f;
+    h_[6] += g;
+    h_[7] += h;
+}
+
+// QS3HmacSha256
+
+QS3HmacSha256::QS3HmacSha256(const QByteArray &key)
+{
+    setKey(key);
+}
+
+void QS3HmacSha256::setKey(const QByteArray &key)
+{
+    /* http://tools.ietf.org/html/rfc2104 - (1) */
+    QByteArray keyBytes = key;
+    if (keyBytes.size() > QS3Sha256::BlockSize)
+        keyBytes = QS3Sha256::hash(keyBytes);
+
+    /* http://tools.ietf.org/html/rfc2104 - (2) & (5) */
+    char ipad[QS3Sha256::BlockSize];
+    char opad[QS3Sha256::BlockSize];
+    memset(ipad, 0x36, sizeof(ipad));
+    memset(opad, 0x5c, sizeof(opad));
+    for (int i=0; i<keyBytes.size(); ++i)
+    {
+        ipad[i] ^= keyBytes[i];
+        opad[i] ^= keyBytes[i];
+    }
+
+    inner_.reset();
+    inner_.addData(ipad, sizeof(ipad));
+    outer_.reset();
+    outer_.addData(opad, sizeof(opad));
+}
+
+QByteArray QS3HmacSha256::sign(const QByteArray &message) const
+{
+    return sign(message.constData(), message.size());
+}
+
+QByteArray QS3HmacSha256::sign(const char *message, int length) const
+{
+    /* http://tools.ietf.org/html/rfc2104 - (3) & (4) */
+    uchar innerDigest[QS3Sha256::DigestSize];
+    QS3Sha256 inner(inner_);
+    inner.addData(message, length);
+    inner.result(innerDigest);
+
+    /* http://tools.ietf.org/html/rfc2104 - (6) & (7) */
+    QS3Sha256 outer(outer_);
+    outer.addData(reinterpret_cast<const char*>(innerDigest), QS3Sha256::DigestSize);
+    return outer.result();
+}
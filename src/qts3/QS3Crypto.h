@@ -0,0 +1,104 @@
+
+#pragma once
+
+#include <QtGlobal>
+#include <QByteArray>
+
+/// QS3Sha1
+
+/** Incremental SHA-1. Unlike QCryptographicHash the state can be copied,
+    which allows precomputing the HMAC inner and outer key blocks once. */
+class QS3Sha1
+{
+public:
+    QS3Sha1();
+
+    void reset();
+    void addData(const char *data, int length);
+    void addData(const QByteArray &data);
+
+    /// Writes the 20 byte digest to digest. Does not modify the state.
+    void result(uchar *digest) const;
+    QByteArray result() const;
+
+    static const int DigestSize = 20;
+    static const int BlockSize = 64;
+
+private:
+    void processBlock(const uchar *block);
+
+    quint32 h_[5];
+    quint64 length_;
+    uchar buffer_[BlockSize];
+    int bufferSize_;
+};
+
+/// QS3HmacSha1
+
+/** HMAC-SHA1 with the key dependent inner and outer states computed once.
+    http://tools.ietf.org/html/rfc2104 */
+class QS3HmacSha1
+{
+public:
+    explicit QS3HmacSha1(const QByteArray &key = QByteArray());
+
+    void setKey(const QByteArray &key);
+
+    /// Returns the raw 20 byte MAC of message.
+    QByteArray sign(const char *message, int length) const;
+    QByteArray sign(const QByteArray &message) const;
+
+private:
+    QS3Sha1 inner_;
+    QS3Sha1 outer_;
+};
+
+/// QS3Sha256
+
+/** Incremental SHA-256 with a copyable state, see QS3Sha1. Qt 4 has no SHA-256. */
+class QS3Sha256
+{
+public:
+    QS3Sha256();
+
+    void reset();
+    void addData(const char *data, int length);
+    void addData(const QByteArray &data);
+
+    /// Writes the 32 byte digest to digest. Does not modify the state.
+    void result(uchar *digest) const;
+    QByteArray result() const;
+
+    /// Returns the SHA-256 of data.
+    static QByteArray hash(const QByteArray &data);
+
+    static const int DigestSize = 32;
+    static const int BlockSize = 64;
+
+private:
+    void processBlock(const uchar *block);
+
+    quint32 h_[8];
+    quint64 length_;
+    uchar buffer_[BlockSize];
+    int bufferSize_;
+};
+
+/// QS3HmacSha256
+
+/** HMAC-SHA256 with the key dependent inner and outer states computed once. */
+class QS3HmacSha256
+{
+public:
+    explicit QS3HmacSha256(const QByteArray &key = QByteArray());
+
+    void setKey(const QByteArray &key);
+
+    /// Returns the raw 32 byte MAC of message.
+    QByteArray sign(const char *message, int length) const;
+    QByteArray sign(const QByteArray &message) const;
+
+private:
+    QS3Sha256 inner_;
+    QS3Sha256 outer_;
+};
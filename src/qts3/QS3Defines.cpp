@@ -1,5 +1,7 @@
 
 #include "QS3Defines.h"
+#include "QS3BufferPool.h"
+#include "QS3Xml.h"
 #include <QDebug>
 
 // QS3Config
@@ -9,22 +11,65 @@ QS3Config::QS3Config(const QString &accessKey_, const QString &secredKey_, const
     secredKey(secredKey_),
     bucket(bucket_),
     endpoint(endpoint_),
-    host("s3.amazonaws.com")
+    host("s3.amazonaws.com"),
+    coalesceRequests(false),
+    memoryMapUploads(false),
+    adaptiveConcurrency(false),
+    initialConcurrency(8),
+    maxConcurrency(128),
+    concurrencyPrefixDepth(1),
+    hedgeRequests(false),
+    hedgePercentile(0.95),
+    hedgeBudget(0.05),
+    requestTimeout(0),
+    stallTimeout(0),
+    resumeAttempts(3),
+    listObjectsV2(false),
+    bufferPoolBytes(32 * 1024 * 1024),
+    signatureVersion(SignatureV2),
+    region("us-east-1"),
+    signPayload(false),
+    transport(QtNetworkTransport),
+    connectionsPerHost(16),
+    idleConnectionTimeout(30000),
+    tcpNoDelay(true),
+    socketBufferSize(0)
 {
     if (endpoint == US_WEST_1)
+    {
         host = "s3-us-west-1.amazonaws.com";
+        region = "us-west-1";
+    }
     else if (endpoint == US_WEST_2)
+    {
         host = "s3-us-west-2.amazonaws.com";
+        region = "us-west-2";
+    }
     else if (endpoint == SA_EAST_1)
+    {
         host = "s3.sa-east-1.amazonaws.com";
+        region = "sa-east-1";
+    }
     else if (endpoint == EU_WEST_1)
+    {
         host = "s3-eu-west-1.amazonaws.com";
+        region = "eu-west-1";
+    }
     else if (endpoint == AP_SOUTHEAST_1)
+    {
         host = "s3-ap-southeast-1.amazonaws.com";
+        region = "ap-southeast-1";
+    }
     else if (endpoint == AP_SOUTHEAST_2)
+    {
         host = "s3-ap-southeast-2.amazonaws.com";
+        region = "ap-southeast-2";
+    }
     else if (endpoint == AP_NORTHEAST_1)
+    {
         host = "s3-ap-northeast-1.amazonaws.com";
+        region = "ap-northeast-1";
+    }
 
     if (bucket.startsWith("/"))
         bucket = bucket.right(bucket.length()-1);
@@ -41,6 +86,28 @@ QS3Config::QS3Config(const QS3Config &other)
     host = other.host;
     bucket = other.bucket;
     endpoint = other.endpoint;
+    coalesceRequests = other.coalesceRequests;
+    memoryMapUploads = other.memoryMapUploads;
+    adaptiveConcurrency = other.adaptiveConcurrency;
+    initialConcurrency = other.initialConcurrency;
+    maxConcurrency = other.maxConcurrency;
+    concurrencyPrefixDepth = other.concurrencyPrefixDepth;
+    hedgeRequests = other.hedgeRequests;
+    hedgePercentile = other.hedgePercentile;
+    hedgeBudget = other.hedgeBudget;
+    requestTimeout = other.requestTimeout;
+    stallTimeout = other.stallTimeout;
+    resumeAttempts = other.resumeAttempts;
+    listObjectsV2 = other.listObjectsV2;
+    bufferPoolBytes = other.bufferPoolBytes;
+    signatureVersion = other.signatureVersion;
+    region = other.region;
+    signPayload = other.signPayload;
+    transport = other.transport;
+    connectionsPerHost = other.connectionsPerHost;
+    idleConnectionTimeout = other.idleConnectionTimeout;
+    tcpNoDelay = other.tcpNoDelay;
+    socketBufferSize = other.socketBufferSize;
 }
 
 // QS3FileMetaData
@@ -133,6 +200,7 @@ QS3Acl::QS3Acl(const QS3Acl &other)
     key = other.key;
     ownerName = other.ownerName;
     ownerId = other.ownerId;
+    ownerUser = other.ownerUser;
     authenticatedUsers = other.authenticatedUsers;
     allUsers = other.allUsers;
     userPermissions = other.userPermissions;
@@ -175,6 +243,35 @@ QS3AclPermissions *QS3Acl::getPermissionByUsername(const QString &username)
     return 0;
 }
 
+bool QS3Acl::matchesCannedAcl(QS3::CannedAcl cannedAcl) const
+{
+    // Owner always has full control and no individual users are granted anything with canned ACLs.
+    if (!ownerUser.fullControl || !userPermissions.isEmpty())
+        return false;
+
+    bool allRead = allUsers.read, allWrite = allUsers.write;
+    bool allOther = allUsers.fullControl || allUsers.readACP || allUsers.writeACP;
+    bool authRead = authenticatedUsers.read;
+    bool authOther = authenticatedUsers.fullControl || authenticatedUsers.write || authenticatedUsers.readACP || authenticatedUsers.writeACP;
+    if (allOther || authOther)
+        return false;
+
+    switch(cannedAcl)
+    {
+        case QS3::Private:
+            return !allRead && !allWrite && !authRead;
+        case QS3::PublicRead:
+            return allRead && !allWrite && !authRead;
+        case QS3::PublicReadWrite:
+            return allRead && allWrite && !authRead;
+        case QS3::AuthenticatedRead:
+            return !allRead && !allWrite && authRead;
+        default:
+            return false;
+    }
+    return false;
+}
+
 QString QS3Acl::toString() const
 {
     return QString("key=%1 ownerName=%2 ownerId[0:7]=%3").arg(key).arg(ownerName).arg(ownerId.left(7));
@@ -194,6 +291,29 @@ QString QS3Error::toString() const
     return QString("%1. Message: %2 Error code: %3").arg(error).arg(message).arg(code);
 }
 
+// QS3Result
+
+QS3Result::QS3Result() :
+    id(0),
+    tag(0),
+    type(QS3::GetObject),
+    succeeded(false),
+    httpStatusCode(0),
+    totalSize(-1),
+    dataOffset(0)
+{
+}
+
+bool QS3Result::parseAcl(QS3Acl &acl, QString &errorMessage) const
+{
+    if (type != QS3::GetAcl)
+    {
+        errorMessage = "Result is not of type QS3::GetAcl.";
+        return false;
+    }
+    return QS3Xml::parseAcl(acl, key, data, errorMessage);
+}
+
 // QS3Response
 
 QS3Response::QS3Response(const QString &key_, const QUrl &url_, QS3::RequestType type_) :
@@ -201,7 +321,8 @@ QS3Response::QS3Response(const QString &key_, const QUrl &url_, QS3::RequestType
     httpStatusCode(0),
     key(key_),
     url(url_),
-    type(type_)
+    type(type_),
+    requestId_(0)
 {
 }
 
@@ -209,13 +330,33 @@ QS3Response::~QS3Response()
 {
 }
 
+void QS3Response::cancel()
+{
+    emit cancelRequested(this);
+}
+
 // QS3ListObjectsResponse
 
-QS3ListObjectsResponse::QS3ListObjectsResponse(const QString &key, const QUrl &url, const QString &prefix_) :
+QS3ListObjectsResponse::QS3ListObjectsResponse(const QString &key, const QUrl &url, const QString &prefix_, bool compact_) :
     QS3Response(key, url, QS3::ListObjects),
     isTruncated(false),
-    prefix(prefix_)
+    prefix(prefix_),
+    compact(compact_),
+    autoContinue(true),
+    v2(false)
+{
+}
+
+int QS3ListObjectsResponse::objectCount() const
 {
+    return compact ? compactObjects.size() : objects.size();
+}
+
+QString QS3ListObjectsResponse::lastKey() const
+{
+    if (compact)
+        return !compactObjects.isEmpty() ? compactObjects.last().key() : "";
+    return !objects.isEmpty() ? objects.last().key : "";
 }
 
 void QS3ListObjectsResponse::emitFinished()
@@ -250,8 +391,16 @@ void QS3CopyObjectResponse::emitFinished()
 // QS3GetObjectResponse
 
 QS3GetObjectResponse::QS3GetObjectResponse(const QString &key, const QUrl &url) :
-    QS3Response(key, url, QS3::GetObject)
+    QS3Response(key, url, QS3::GetObject),
+    totalSize(-1),
+    dataOffset(0)
+{
+}
+
+QS3GetObjectResponse::~QS3GetObjectResponse()
 {
+    if (bufferPool_)
+        bufferPool_->release(data);
 }
 
 void QS3GetObjectResponse::downloadProgress(qint64 bytesReceived, qint64 bytesTotal)
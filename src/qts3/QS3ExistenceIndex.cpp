@@ -0,0 +1,182 @@
+
+#include "QS3ExistenceIndex.h"
+#include "QS3BloomFilter.h"
+#include "QS3Client.h"
+
+#include <QTimer>
+#include <QDebug>
+
+namespace
+{
+    static const uint PAGE_SIZE = 1000;
+
+    /// Room for keys added after the listing, relative and absolute.
+    static const double GROWTH_FACTOR = 1.25;
+    static const qint64 GROWTH_KEYS = 1000;
+}
+
+QS3ExistenceIndex::QS3ExistenceIndex(QS3Client *client, const QString &prefix, double falsePositiveRate) :
+    QObject(client),
+    client_(client),
+    prefix_(normalizedKey(prefix)),
+    targetFalsePositiveRate_(falsePositiveRate),
+    filter_(0),
+    finished_(false)
+{
+    QTimer::singleShot(0, this, SLOT(start()));
+}
+
+QS3ExistenceIndex::~QS3ExistenceIndex()
+{
+    if (listing_)
+    {
+        disconnect(listing_, 0, this, 0);
+        listing_->cancel();
+    }
+    delete filter_;
+}
+
+QString QS3ExistenceIndex::prefix() const
+{
+    return prefix_;
+}
+
+bool QS3ExistenceIndex::isReady() const
+{
+    return (filter_ != 0);
+}
+
+bool QS3ExistenceIndex::isFinished() const
+{
+    return finished_;
+}
+
+QS3Error QS3ExistenceIndex::error() const
+{
+    return error_;
+}
+
+QString QS3ExistenceIndex::normalizedKey(const QString &key)
+{
+    // Listed keys have no leading slash, request keys do.
+    QString normalized = key;
+    while (normalized.startsWith(QS3::ROOT_PATH))
+        normalized.remove(0, 1);
+    return normalized;
+}
+
+bool QS3ExistenceIndex::covers(const QString &key) const
+{
+    return normalizedKey(key).startsWith(prefix_);
+}
+
+QS3::Existence QS3ExistenceIndex::exists(const QString &key) const
+{
+    if (!filter_)
+        return QS3::ExistenceUnknown;
+    const QString normalized = normalizedKey(key);
+    if (!normalized.startsWith(prefix_))
+        return QS3::ExistenceUnknown;
+    return (filter_->mayContain(QS3BloomFilter::hash(normalized.toUtf8())) ? QS3::MayExist : QS3::DoesNotExist);
+}
+
+void QS3ExistenceIndex::add(const QString &key)
+{
+    const QString normalized = normalizedKey(key);
+    if (finished_ && !filter_)
+        return;
+    if (!normalized.startsWith(prefix_))
+        return;
+
+    // Keys written during the listing may be missing from it.
+    const quint64 hash = QS3BloomFilter::hash(normalized.toUtf8());
+    if (filter_)
+        filter_->insert(hash);
+    else
+        pending_ << hash;
+}
+
+qint64 QS3ExistenceIndex::keyCount() const
+{
+    return (filter_ ? filter_->count() : pending_.size());
+}
+
+qint64 QS3ExistenceIndex::sizeBytes() const
+{
+    return (filter_ ? filter_->sizeBytes() : 0);
+}
+
+double QS3ExistenceIndex::falsePositiveRate() const
+{
+    return (filter_ ? filter_->falsePositiveRate() : 1.0);
+}
+
+void QS3ExistenceIndex::start()
+{
+    if (finished_)
+        return;
+    if (!client_)
+    {
+        error_.error = "QS3Client was destroyed before the index was built.";
+        finish();
+        return;
+    }
+    listNextPage();
+}
+
+void QS3ExistenceIndex::listNextPage()
+{
+    listing_ = (client_ ? client_->listObjectsPage(prefix_, marker_, "", PAGE_SIZE) : 0);
+    if (!listing_)
+    {
+        error_.error = "Failed to list " + prefix_;
+        finish();
+        return;
+    }
+    connect(listing_, SIGNAL(finished(QS3ListObjectsResponse*)), SLOT(onListObjects(QS3ListObjectsResponse*)));
+}
+
+void QS3ExistenceIndex::onListObjects(QS3ListObjectsResponse *response)
+{
+    if (response != listing_)
+        return;
+    listing_ = 0;
+
+    if (!response->succeeded)
+    {
+        error_ = response->error;
+        pending_.clear();
+        qDebug() << "QS3ExistenceIndex: Error: Failed to list" << prefix_ << error_.toString();
+        finish();
+        return;
+    }
+
+    foreach(const QS3Object &object, response->objects)
+        pending_ << QS3BloomFilter::hash(object.key.toUtf8());
+
+    if (response->isTruncated && !response->objects.isEmpty())
+    {
+        marker_ = response->lastKey();
+        listNextPage();
+        return;
+    }
+    build();
+}
+
+void QS3ExistenceIndex::build()
+{
+    const qint64 expected = static_cast<qint64>(pending_.size() * GROWTH_FACTOR) + GROWTH_KEYS;
+    filter_ = new QS3BloomFilter(expected, targetFalsePositiveRate_);
+    foreach(quint64 hash, pending_)
+        filter_->insert(hash);
+    pending_ = QVector<quint64>();
+    finish();
+}
+
+void QS3ExistenceIndex::finish()
+{
+    if (finished_)
+        return;
+    finished_ = true;
+    emit finished(this);
+}
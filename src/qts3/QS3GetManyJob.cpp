@@ -0,0 +1,221 @@
+
+#include "QS3GetManyJob.h"
+#include "QS3Client.h"
+#include "QS3BufferPool.h"
+
+#include <QTimer>
+
+QS3GetManyJob::QS3GetManyJob(QS3Client *client, const QStringList &keys) :
+    QObject(client),
+    client_(client),
+    keys_(keys),
+    maxConcurrent_(16),
+    ordered_(false),
+    maxBuffered_(64),
+    next_(0),
+    nextDelivered_(0),
+    httpStatusCodes_(keys.size(), 0),
+    succeeded_(keys.size(), false),
+    delivered_(0),
+    bytesReceived_(0),
+    elapsed_(-1),
+    finished_(false)
+{
+    QTimer::singleShot(0, this, SLOT(start()));
+}
+
+QS3GetManyJob::~QS3GetManyJob()
+{
+    if (client_)
+    {
+        foreach(QS3RequestId id, ongoing_.keys())
+            client_->cancel(id);
+    }
+}
+
+void QS3GetManyJob::setMaxConcurrent(int maxConcurrent)
+{
+    maxConcurrent_ = qMax(1, maxConcurrent);
+}
+
+void QS3GetManyJob::setOrdered(bool ordered)
+{
+    ordered_ = ordered;
+}
+
+void QS3GetManyJob::setMaxBuffered(int maxBuffered)
+{
+    maxBuffered_ = qMax(1, maxBuffered);
+}
+
+QStringList QS3GetManyJob::keys() const
+{
+    return keys_;
+}
+
+int QS3GetManyJob::delivered() const
+{
+    return delivered_;
+}
+
+bool QS3GetManyJob::succeeded(int index) const
+{
+    return succeeded_.value(index, false);
+}
+
+int QS3GetManyJob::httpStatusCode(int index) const
+{
+    return httpStatusCodes_.value(index, 0);
+}
+
+QHash<int, QS3Error> QS3GetManyJob::failures() const
+{
+    return failures_;
+}
+
+qint64 QS3GetManyJob::bytesReceived() const
+{
+    return bytesReceived_;
+}
+
+qint64 QS3GetManyJob::elapsed() const
+{
+    if (elapsed_ >= 0)
+        return elapsed_;
+    return (runTimer_.isValid() ? runTimer_.elapsed() : 0);
+}
+
+bool QS3GetManyJob::isFinished() const
+{
+    return finished_;
+}
+
+void QS3GetManyJob::start()
+{
+    if (finished_)
+        return;
+    runTimer_.start();
+    if (!client_)
+    {
+        cancel();
+        return;
+    }
+    pump();
+}
+
+void QS3GetManyJob::cancel()
+{
+    if (finished_)
+        return;
+
+    if (client_)
+    {
+        foreach(QS3RequestId id, ongoing_.keys())
+            client_->cancel(id);
+    }
+    ongoing_.clear();
+
+    // Everything not yet delivered fails. Buffered results are dropped so delivery
+    // stays in order, their keys fail as well since they were never delivered.
+    QS3Error error;
+    error.error = (client_ ? "Canceled." : "QS3Client was destroyed before the job finished.");
+    QMap<int, QS3Result>::iterator bufferedIter = buffered_.begin();
+    for (; bufferedIter != buffered_.end(); ++bufferedIter)
+    {
+        if (!bufferedIter.value().succeeded)
+            continue;
+        succeeded_[bufferedIter.key()] = false;
+        bytesReceived_ -= bufferedIter.value().data.size();
+        failures_[bufferedIter.key()] = error;
+        if (client_)
+            client_->bufferPool()->release(bufferedIter.value().data);
+    }
+    buffered_.clear();
+    for (int i=0; i<keys_.size(); ++i)
+    {
+        if (!succeeded_[i] && !failures_.contains(i))
+            failures_[i] = error;
+    }
+    finish();
+}
+
+void QS3GetManyJob::pump()
+{
+    if (finished_)
+        return;
+
+    // In order mode the reorder buffer bounds how far ahead gets may run.
+    while (client_ && !finished_ && next_ < keys_.size() && ongoing_.size() < maxConcurrent_ &&
+           (!ordered_ || next_ - nextDelivered_ < maxBuffered_ + maxConcurrent_))
+    {
+        const int index = next_++;
+        QS3RequestId id = client_->get(keys_[index], this, index);
+        if (id == 0)
+        {
+            QS3Result result;
+            result.type = QS3::GetObject;
+            result.key = keys_[index];
+            result.error.error = "Invalid key.";
+            complete(index, result);
+            continue;
+        }
+        ongoing_[id] = index;
+    }
+
+    if (!finished_ && next_ >= keys_.size() && ongoing_.isEmpty() && buffered_.isEmpty())
+        finish();
+}
+
+void QS3GetManyJob::handleResult(const QS3Result &result)
+{
+    if (!ongoing_.contains(result.id))
+        return;
+    complete(ongoing_.take(result.id), result);
+    pump();
+}
+
+void QS3GetManyJob::complete(int index, const QS3Result &result)
+{
+    succeeded_[index] = result.succeeded;
+    httpStatusCodes_[index] = result.httpStatusCode;
+    if (result.succeeded)
+        bytesReceived_ += result.data.size();
+    else
+        failures_[index] = result.error;
+
+    if (!ordered_)
+    {
+        deliver(index, result);
+        return;
+    }
+
+    // Held until every earlier key has been delivered.
+    buffered_.insert(index, result);
+    while (!buffered_.isEmpty() && buffered_.constBegin().key() == nextDelivered_)
+    {
+        QS3Result next = buffered_.take(nextDelivered_);
+        deliver(nextDelivered_++, next);
+
+        // The buffered reference kept the data out of the pool when the handler returned.
+        if (client_)
+            client_->bufferPool()->release(next.data);
+        if (finished_)
+            return;
+    }
+}
+
+void QS3GetManyJob::deliver(int index, const QS3Result &result)
+{
+    delivered_++;
+    emit received(this, index, result);
+    emit progress(this, delivered_, keys_.size());
+}
+
+void QS3GetManyJob::finish()
+{
+    if (finished_)
+        return;
+    finished_ = true;
+    elapsed_ = (runTimer_.isValid() ? runTimer_.elapsed() : 0);
+    emit finished(this);
+}
@@ -0,0 +1,886 @@
+
+#ifdef _WIN32
+#include <winsock2.h>
+#else
+#include <sys/types.h>
+#include <sys/socket.h>
+#endif
+
+#include "QS3HttpEngine.h"
+
+#include <QNetworkAccessManager>
+#include <QTcpSocket>
+#include <QTimer>
+#include <QUrl>
+#include <QDebug>
+
+#include <cstring>
+
+namespace
+{
+    /// Body bytes kept in the socket write buffer while uploading and the size of each write.
+    static const qint64 UPLOAD_WATERMARK = 256 * 1024;
+    static const qint64 UPLOAD_CHUNK = 64 * 1024;
+
+    /// Longest accepted status, header or chunk size line.
+    static const int MAX_LINE = 64 * 1024;
+
+    static QByteArray HostKey(const QUrl &url)
+    {
+        return url.host().toLower().toUtf8() + ":" + QByteArray::number(url.port(80));
+    }
+
+    static QNetworkReply::NetworkError HttpError(int statusCode)
+    {
+        // Same mapping as QNetworkAccessManager.
+        switch (statusCode)
+        {
+            case 401: return QNetworkReply::AuthenticationRequiredError;
+            case 403: return QNetworkReply::ContentAccessDenied;
+            case 404: return QNetworkReply::ContentNotFoundError;
+            case 405: return QNetworkReply::ContentOperationNotPermittedError;
+            case 407: return QNetworkReply::ProxyAuthenticationRequiredError;
+            default: break;
+        }
+        if (statusCode > 500)
+            return QNetworkReply::ProtocolUnknownError;
+        if (statusCode >= 400)
+            return QNetworkReply::UnknownContentError;
+        return QNetworkReply::ProtocolFailure;
+    }
+
+    static QNetworkReply::NetworkError SocketError(QAbstractSocket::SocketError socketError)
+    {
+        switch (socketError)
+        {
+            case QAbstractSocket::ConnectionRefusedError: return QNetworkReply::ConnectionRefusedError;
+            case QAbstractSocket::RemoteHostClosedError: return QNetworkReply::RemoteHostClosedError;
+            case QAbstractSocket::HostNotFoundError: return QNetworkReply::HostNotFoundError;
+            case QAbstractSocket::SocketTimeoutError: return QNetworkReply::TimeoutError;
+            default: return QNetworkReply::UnknownNetworkError;
+        }
+    }
+
+    /// Connection picked for a waiting reply.
+    struct Assignment
+    {
+        QPointer<QS3HttpReply> reply;
+        QByteArray hostKey;
+        QTcpSocket *socket;
+        bool reused;
+    };
+}
+
+// QS3HttpReply
+
+QS3HttpReply::QS3HttpReply(QS3HttpEngine *engine, const QByteArray &verb, const QNetworkRequest &request, const QByteArray &body, QIODevice *device) :
+    QNetworkReply(engine),
+    engine_(engine),
+    verb_(verb),
+    hostKey_(HostKey(request.url())),
+    body_(body),
+    device_(device),
+    uploadSize_(device ? -1 : body.size()),
+    reused_(false),
+    retried_(false),
+    state_(WaitingState),
+    headSize_(0),
+    written_(0),
+    acknowledged_(0),
+    requestSent_(false),
+    httpMajor_(1),
+    httpMinor_(1),
+    statusCode_(0),
+    headersDone_(false),
+    keepAlive_(false),
+    responseStarted_(false),
+    framing_(NoBody),
+    contentLength_(-1),
+    consumed_(0),
+    arrived_(false),
+    chunkRemaining_(-1),
+    chunkTrailer_(false)
+{
+    setRequest(request);
+    setUrl(request.url());
+    if (verb == "GET")
+        setOperation(QNetworkAccessManager::GetOperation);
+    else if (verb == "PUT")
+        setOperation(QNetworkAccessManager::PutOperation);
+    else if (verb == "POST")
+        setOperation(QNetworkAccessManager::PostOperation);
+    else if (verb == "DELETE")
+        setOperation(QNetworkAccessManager::DeleteOperation);
+    else if (verb == "HEAD")
+        setOperation(QNetworkAccessManager::HeadOperation);
+    else
+    {
+        setOperation(QNetworkAccessManager::CustomOperation);
+        setAttribute(QNetworkRequest::CustomVerbAttribute, verb);
+    }
+
+    if (device_)
+    {
+        bool ok = false;
+        uploadSize_ = request.header(QNetworkRequest::ContentLengthHeader).toLongLong(&ok);
+        if (!ok)
+            uploadSize_ = (device_->isSequential() ? -1 : device_->size());
+        connect(device_, SIGNAL(readyRead()), SLOT(onUploadReadyRead()));
+    }
+
+    // Unbuffered so that read hands the caller buffer straight to readData.
+    open(QIODevice::ReadOnly | QIODevice::Unbuffered);
+}
+
+QS3HttpReply::~QS3HttpReply()
+{
+    // A body that was not read to the end leaves the connection out of sync.
+    releaseSocket(false);
+}
+
+void QS3HttpReply::abort()
+{
+    if (state_ == DoneState)
+    {
+        releaseSocket(false);
+        buffer_.clear();
+        return;
+    }
+    fail(QNetworkReply::OperationCanceledError, "Operation canceled");
+}
+
+qint64 QS3HttpReply::bytesAvailable() const
+{
+    return buffer_.size() + socketBodyBytes() + QIODevice::bytesAvailable();
+}
+
+void QS3HttpReply::setReadBufferSize(qint64 size)
+{
+    QNetworkReply::setReadBufferSize(size);
+    if (socket_ && headersDone_ && framing_ != ChunkedBody)
+        socket_->setReadBufferSize(size);
+}
+
+qint64 QS3HttpReply::socketBodyBytes() const
+{
+    if (!socket_ || !headersDone_ || (framing_ != LengthBody && framing_ != UntilCloseBody))
+        return 0;
+    const qint64 available = socket_->bytesAvailable();
+    return (framing_ == LengthBody ? qMin(available, contentLength_ - consumed_) : available);
+}
+
+qint64 QS3HttpReply::readData(char *data, qint64 maxSize)
+{
+    if (!buffer_.isEmpty())
+    {
+        const int count = static_cast<int>(qMin<qint64>(maxSize, buffer_.size()));
+        memcpy(data, buffer_.constData(), count);
+        buffer_.remove(0, count);
+        return count;
+    }
+
+    const qint64 count = qMin(maxSize, socketBodyBytes());
+    if (count <= 0)
+        return (state_ == DoneState && !socket_ ? -1 : 0);
+
+    // Straight from the socket buffer into the caller buffer.
+    const qint64 read = socket_->read(data, count);
+    if (read <= 0)
+        return 0;
+    consumed_ += read;
+
+    if (framing_ == LengthBody && consumed_ >= contentLength_ && state_ == DoneState)
+        releaseSocket(keepAlive_ && requestSent_);
+    else if (!arrived_)
+        QMetaObject::invokeMethod(this, "checkBodyArrived", Qt::QueuedConnection);
+    return read;
+}
+
+qint64 QS3HttpReply::writeData(const char * /*data*/, qint64 /*maxSize*/)
+{
+    return -1;
+}
+
+void QS3HttpReply::start(QTcpSocket *socket, bool reused)
+{
+    socket_ = socket;
+    reused_ = reused;
+    state_ = ConnectingState;
+    connect(socket, SIGNAL(readyRead()), SLOT(onReadyRead()));
+    connect(socket, SIGNAL(bytesWritten(qint64)), SLOT(onBytesWritten(qint64)));
+    connect(socket, SIGNAL(error(QAbstractSocket::SocketError)), SLOT(onSocketError(QAbstractSocket::SocketError)));
+    connect(socket, SIGNAL(disconnected()), SLOT(onDisconnected()));
+
+    if (socket->state() == QAbstractSocket::ConnectedState)
+        onConnected();
+    else
+        connect(socket, SIGNAL(connected()), SLOT(onConnected()));
+}
+
+QByteArray QS3HttpReply::requestHead() const
+{
+    const QNetworkRequest networkRequest = request();
+    const QUrl requestUrl = networkRequest.url();
+
+    QByteArray path = requestUrl.encodedPath();
+    if (path.isEmpty())
+        path = "/";
+    if (requestUrl.hasQuery())
+        path += "?" + requestUrl.encodedQuery();
+
+    QByteArray head;
+    head.reserve(1024);
+    head += verb_ + " " + path + " HTTP/1.1\r\n";
+
+    bool hasHost = false;
+    bool hasContentType = false;
+    bool hasUserAgent = false;
+    foreach(const QByteArray &name, networkRequest.rawHeaderList())
+    {
+        const QByteArray lowerName = name.toLower();
+        if (lowerName == "content-length")
+            continue; // Written from the body below.
+        hasHost = hasHost || lowerName == "host";
+        hasContentType = hasContentType || lowerName == "content-type";
+        hasUserAgent = hasUserAgent || lowerName == "user-agent";
+        head += name + ": " + networkRequest.rawHeader(name) + "\r\n";
+    }
+    if (!hasHost)
+    {
+        head += "Host: " + QUrl::toAce(requestUrl.host());
+        if (requestUrl.port(80) != 80)
+            head += ":" + QByteArray::number(requestUrl.port());
+        head += "\r\n";
+    }
+    if (!hasContentType && networkRequest.header(QNetworkRequest::ContentTypeHeader).isValid())
+        head += "Content-Type: " + networkRequest.header(QNetworkRequest::ContentTypeHeader).toString().toUtf8() + "\r\n";
+    if (uploadSize_ > 0 || verb_ == "PUT" || verb_ == "POST")
+        head += "Content-Length: " + QByteArray::number(qMax<qint64>(0, uploadSize_)) + "\r\n";
+    if (!hasUserAgent)
+        head += "User-Agent: qts3\r\n";
+    head += "\r\n";
+    return head;
+}
+
+void QS3HttpReply::onConnected()
+{
+    if (!socket_ || state_ != ConnectingState)
+        return;
+    if (!reused_ && engine_)
+        engine_->applySocketOptions(socket_);
+
+    state_ = SendingState;
+    const QByteArray head = requestHead();
+    headSize_ = head.size();
+    written_ = 0;
+    acknowledged_ = 0;
+    if (socket_->write(head) != head.size())
+    {
+        fail(QNetworkReply::UnknownNetworkError, "Failed to send request: " + socket_->errorString());
+        return;
+    }
+    written_ = headSize_;
+    writeBody();
+}
+
+void QS3HttpReply::writeBody()
+{
+    if (!socket_ || state_ != SendingState)
+        return;
+
+    // The body is written in pieces as the socket drains, it is never copied whole to the write buffer.
+    while (written_ - headSize_ < uploadSize_ && socket_->bytesToWrite() < UPLOAD_WATERMARK)
+    {
+        const qint64 offset = written_ - headSize_;
+        const qint64 count = qMin(UPLOAD_CHUNK, uploadSize_ - offset);
+        qint64 sent = 0;
+        if (device_)
+        {
+            const QByteArray data = device_->read(count);
+            if (data.isEmpty())
+            {
+                // Throttled devices come back with readyRead.
+                if (!device_->isOpen() || (!device_->isSequential() && device_->atEnd()))
+                    fail(QNetworkReply::ProtocolFailure, "Upload device ended before Content-Length.");
+                return;
+            }
+            sent = socket_->write(data);
+        }
+        else if (body_.size() >= offset + count)
+            sent = socket_->write(body_.constData() + offset, count);
+        if (sent <= 0)
+        {
+            fail(QNetworkReply::UnknownNetworkError, "Failed to send request body: " + (socket_ ? socket_->errorString() : QString()));
+            return;
+        }
+        written_ += sent;
+    }
+    if (written_ - headSize_ >= qMax<qint64>(0, uploadSize_))
+    {
+        state_ = SentState;
+        requestSent_ = true;
+    }
+}
+
+void QS3HttpReply::onBytesWritten(qint64 bytes)
+{
+    acknowledged_ += bytes;
+    if (uploadSize_ > 0 && acknowledged_ > headSize_)
+        emit uploadProgress(qMin(acknowledged_ - headSize_, uploadSize_), uploadSize_);
+    writeBody();
+}
+
+void QS3HttpReply::onUploadReadyRead()
+{
+    writeBody();
+}
+
+bool QS3HttpReply::readHead()
+{
+    while (!headersDone_ && socket_->canReadLine())
+    {
+        QByteArray line = socket_->readLine(MAX_LINE);
+        if (!line.endsWith('\n'))
+            return false;
+        line.chop(line.endsWith("\r\n") ? 2 : 1);
+
+        if (statusCode_ == 0)
+        {
+            // HTTP/1.1 200 OK
+            if (line.size() < 12 || !line.startsWith("HTTP/") || line[6] != '.')
+                return false;
+            httpMajor_ = line[5] - '0';
+            httpMinor_ = line[7] - '0';
+            statusCode_ = line.mid(9, 3).toInt();
+            reasonPhrase_ = line.mid(13);
+            if (statusCode_ < 100)
+                return false;
+            continue;
+        }
+
+        if (line.isEmpty())
+        {
+            // Interim responses such as 100 Continue are followed by the real one.
+            if (statusCode_ < 200)
+            {
+                statusCode_ = 0;
+                continue;
+            }
+            headersDone_ = true;
+            break;
+        }
+
+        if ((line[0] == ' ' || line[0] == '\t') && !lastHeader_.isEmpty())
+        {
+            setRawHeader(lastHeader_, rawHeader(lastHeader_) + " " + line.trimmed());
+            continue;
+        }
+        const int colon = line.indexOf(':');
+        if (colon <= 0)
+            return false;
+        lastHeader_ = line.left(colon).trimmed();
+        const QByteArray value = line.mid(colon + 1).trimmed();
+        setRawHeader(lastHeader_, hasRawHeader(lastHeader_) ? rawHeader(lastHeader_) + ", " + value : value);
+    }
+    if (!headersDone_)
+        return (socket_->bytesAvailable() < MAX_LINE);
+
+    setAttribute(QNetworkRequest::HttpStatusCodeAttribute, statusCode_);
+    setAttribute(QNetworkRequest::HttpReasonPhraseAttribute, QString::fromUtf8(reasonPhrase_));
+
+    const QByteArray connection = rawHeader("Connection").toLower();
+    keepAlive_ = (httpMajor_ == 1 && httpMinor_ >= 1 ? !connection.contains("close") : connection.contains("keep-alive"));
+
+    bool hasLength = false;
+    contentLength_ = rawHeader("Content-Length").trimmed().toLongLong(&hasLength);
+    if (verb_ == "HEAD" || statusCode_ == 204 || statusCode_ == 304)
+        framing_ = NoBody;
+    else if (rawHeader("Transfer-Encoding").toLower().contains("chunked"))
+        framing_ = ChunkedBody;
+    else if (hasLength && contentLength_ >= 0)
+        framing_ = (contentLength_ > 0 ? LengthBody : NoBody);
+    else
+    {
+        framing_ = UntilCloseBody;
+        keepAlive_ = false;
+    }
+
+    // Chunk size lines must fit in the socket buffer, direct bodies follow the reply read buffer.
+    socket_->setReadBufferSize(framing_ == ChunkedBody ? 0 : readBufferSize());
+    return true;
+}
+
+bool QS3HttpReply::readChunks()
+{
+    while (socket_ && !arrived_)
+    {
+        if (chunkTrailer_)
+        {
+            if (!socket_->canReadLine())
+                return (socket_->bytesAvailable() < MAX_LINE);
+            if (socket_->readLine(MAX_LINE).trimmed().isEmpty())
+                arrived_ = true;
+            continue;
+        }
+        if (chunkRemaining_ < 0)
+        {
+            if (!socket_->canReadLine())
+                return (socket_->bytesAvailable() < MAX_LINE);
+
+            // The line break after chunk data reads as an empty line.
+            QByteArray line = socket_->readLine(MAX_LINE).trimmed();
+            if (line.isEmpty())
+                continue;
+            const int extension = line.indexOf(';');
+            if (extension >= 0)
+                line.truncate(extension);
+            bool ok = false;
+            const qint64 size = line.trimmed().toLongLong(&ok, 16);
+            if (!ok || size < 0)
+                return false;
+            if (size == 0)
+                chunkTrailer_ = true;
+            else
+                chunkRemaining_ = size;
+            continue;
+        }
+
+        const qint64 count = qMin(chunkRemaining_, socket_->bytesAvailable());
+        if (count <= 0)
+            return true;
+        buffer_.append(socket_->read(count));
+        consumed_ += count;
+        chunkRemaining_ -= count;
+        if (chunkRemaining_ == 0)
+            chunkRemaining_ = -1;
+    }
+    return true;
+}
+
+void QS3HttpReply::onReadyRead()
+{
+    if (!socket_ || state_ == DoneState || state_ == ConnectingState)
+        return;
+    responseStarted_ = true;
+
+    if (!headersDone_)
+    {
+        if (!readHead())
+        {
+            fail(QNetworkReply::ProtocolFailure, "Invalid HTTP response from " + url().host());
+            return;
+        }
+        if (!headersDone_)
+            return;
+        // A response before the whole request was sent leaves the connection out of sync.
+        if (state_ != SentState)
+            keepAlive_ = false;
+        emit metaDataChanged();
+        if (state_ == DoneState)
+            return;
+    }
+
+    if (framing_ == ChunkedBody && !readChunks())
+    {
+        fail(QNetworkReply::ProtocolFailure, "Invalid chunked response from " + url().host());
+        return;
+    }
+
+    const qint64 received = consumed_ + socketBodyBytes();
+    if (bytesAvailable() > 0)
+    {
+        emit downloadProgress(received, framing_ == LengthBody ? contentLength_ : -1);
+        if (state_ == DoneState)
+            return;
+        emit readyRead();
+    }
+    checkBodyArrived();
+}
+
+void QS3HttpReply::checkBodyArrived()
+{
+    if (state_ == DoneState || !headersDone_)
+        return;
+    if (framing_ == NoBody)
+        arrived_ = true;
+    else if (framing_ == LengthBody)
+        arrived_ = (consumed_ + socketBodyBytes() >= contentLength_);
+    if (arrived_)
+        finish();
+}
+
+void QS3HttpReply::onSocketError(QAbstractSocket::SocketError socketError)
+{
+    if (state_ == DoneState && !socket_)
+        return;
+    if (socketError == QAbstractSocket::RemoteHostClosedError)
+    {
+        onDisconnected();
+        return;
+    }
+    if (state_ == DoneState)
+    {
+        releaseSocket(false);
+        return;
+    }
+    if (retry())
+        return;
+    fail(SocketError(socketError), socket_ ? socket_->errorString() : QString("Network error"));
+}
+
+void QS3HttpReply::onDisconnected()
+{
+    if (!socket_)
+        return;
+
+    // Data already received stays readable after the connection is gone.
+    const qint64 leftover = socketBodyBytes();
+    if (leftover > 0)
+    {
+        buffer_.append(socket_->read(leftover));
+        consumed_ += leftover;
+    }
+    if (framing_ == ChunkedBody && headersDone_)
+        readChunks();
+    keepAlive_ = false;
+
+    if (state_ == DoneState)
+    {
+        releaseSocket(false);
+        return;
+    }
+    if (headersDone_ && (framing_ == UntilCloseBody || arrived_ || (framing_ == LengthBody && consumed_ >= contentLength_)))
+    {
+        arrived_ = true;
+        finish();
+        return;
+    }
+    if (retry())
+        return;
+    fail(QNetworkReply::RemoteHostClosedError, "Connection closed by " + url().host());
+}
+
+void QS3HttpReply::failUnsupported()
+{
+    if (uploadSize_ < 0)
+        fail(QNetworkReply::ProtocolFailure, "Upload device of unknown size needs a Content-Length header.");
+    else
+        fail(QNetworkReply::ProtocolUnknownError, "Protocol " + url().scheme() + " is not supported by QS3HttpEngine.");
+}
+
+bool QS3HttpReply::retry()
+{
+    // Servers close idle connections at any time, a request that found one closed was never processed.
+    if (!reused_ || retried_ || responseStarted_ || !engine_)
+        return false;
+    if (device_ && (device_->isSequential() || !device_->seek(0)))
+        return false;
+
+    retried_ = true;
+    releaseSocket(false);
+    state_ = WaitingState;
+    headSize_ = 0;
+    written_ = 0;
+    acknowledged_ = 0;
+    requestSent_ = false;
+    engine_->enqueue(this, true);
+    return true;
+}
+
+void QS3HttpReply::releaseSocket(bool reusable)
+{
+    if (!socket_)
+        return;
+    QTcpSocket *socket = socket_;
+    socket_ = 0;
+    disconnect(socket, 0, this, 0);
+
+    reusable = reusable && socket->state() == QAbstractSocket::ConnectedState && socket->bytesAvailable() == 0;
+    if (engine_)
+        engine_->release(hostKey_, socket, reusable);
+    else
+    {
+        socket->abort();
+        socket->deleteLater();
+    }
+}
+
+void QS3HttpReply::fail(QNetworkReply::NetworkError code, const QString &message)
+{
+    if (state_ == DoneState)
+        return;
+    releaseSocket(false);
+    if (engine_)
+        engine_->dequeue(this);
+    setError(code, message);
+    finish();
+}
+
+void QS3HttpReply::finish()
+{
+    if (state_ == DoneState)
+        return;
+    state_ = DoneState;
+    if (device_)
+        disconnect(device_, 0, this, 0);
+
+    // Bodies read from the socket release it when read to the end.
+    if (framing_ != LengthBody || consumed_ >= contentLength_)
+        releaseSocket(keepAlive_ && requestSent_);
+
+    if (error() == QNetworkReply::NoError && statusCode_ >= 400)
+        setError(HttpError(statusCode_), QString("Error downloading %1 - server replied: %2").arg(url().toString(QUrl::RemoveQuery)).arg(QString::fromUtf8(reasonPhrase_)));
+    if (error() != QNetworkReply::NoError)
+        emit error(error());
+
+#if QT_VERSION >= 0x040800
+    setFinished(true);
+#endif
+    emit readChannelFinished();
+    emit finished();
+}
+
+// QS3HttpEngine
+
+QS3HttpEngine::QS3HttpEngine(const QS3Config &config, QObject *parent) :
+    QS3Transport(parent),
+    connectionsPerHost_(qMax(1, config.connectionsPerHost)),
+    idleTimeout_(qMax(0, config.idleConnectionTimeout)),
+    tcpNoDelay_(config.tcpNoDelay),
+    socketBufferSize_(qMax(0, config.socketBufferSize)),
+    idleTimer_(new QTimer(this)),
+    dispatchScheduled_(false)
+{
+    clock_.start();
+    idleTimer_->setInterval(1000);
+    connect(idleTimer_, SIGNAL(timeout()), SLOT(onIdleTimer()));
+}
+
+QS3HttpEngine::~QS3HttpEngine()
+{
+    // Replies and sockets are children, replies left alive close their sockets without the engine.
+    foreach(QS3HttpReply *reply, findChildren<QS3HttpReply*>())
+        reply->engine_ = 0;
+    pools_.clear();
+    idleHosts_.clear();
+}
+
+QNetworkReply *QS3HttpEngine::send(const QByteArray &verb, const QNetworkRequest &request, const QByteArray &body, QIODevice *device)
+{
+    QS3HttpReply *reply = new QS3HttpReply(this, verb, request, body, device);
+    connect(reply, SIGNAL(finished()), SLOT(onReplyFinished()));
+
+    // Failed later like any reply, the caller connects to it first.
+    if (request.url().scheme().toLower() != "http" || reply->uploadSize_ < 0)
+        QTimer::singleShot(0, reply, SLOT(failUnsupported()));
+    else
+        enqueue(reply, false);
+    return reply;
+}
+
+void QS3HttpEngine::enqueue(QS3HttpReply *reply, bool first)
+{
+    HostPool &pool = pools_[reply->hostKey_];
+    if (first)
+        pool.waiting.prepend(reply);
+    else
+    {
+        // In order within a priority, QNetworkRequest::HighPriority has the lowest value.
+        const int priority = reply->request().priority();
+        int i = pool.waiting.size();
+        while (i > 0 && (!pool.waiting[i-1] || pool.waiting[i-1]->request().priority() > priority))
+            --i;
+        pool.waiting.insert(i, reply);
+    }
+    scheduleDispatch();
+}
+
+void QS3HttpEngine::dequeue(QS3HttpReply *reply)
+{
+    if (pools_.contains(reply->hostKey_))
+        pools_[reply->hostKey_].waiting.removeAll(reply);
+}
+
+void QS3HttpEngine::scheduleDispatch()
+{
+    // Replies are started from the event loop, never inside send or a reply signal.
+    if (dispatchScheduled_)
+        return;
+    dispatchScheduled_ = true;
+    QMetaObject::invokeMethod(this, "dispatchWaiting", Qt::QueuedConnection);
+}
+
+void QS3HttpEngine::dispatchWaiting()
+{
+    dispatchScheduled_ = false;
+    QList<Assignment> assignments;
+
+    QMutableHashIterator<QByteArray, HostPool> it(pools_);
+    while (it.hasNext())
+    {
+        it.next();
+        const QByteArray hostKey = it.key();
+        HostPool &pool = it.value();
+        while (!pool.waiting.isEmpty())
+        {
+            if (!pool.waiting.first())
+            {
+                pool.waiting.removeFirst();
+                continue;
+            }
+
+            // The most recently used idle connection is the least likely to have been closed.
+            QTcpSocket *socket = 0;
+            bool reused = false;
+            while (!socket && !pool.idle.isEmpty())
+            {
+                QTcpSocket *idle = pool.idle.takeLast().socket;
+                idleHosts_.remove(idle);
+                disconnect(idle, 0, this, 0);
+                if (idle->state() == QAbstractSocket::ConnectedState && idle->bytesAvailable() == 0)
+                {
+                    socket = idle;
+                    reused = true;
+                }
+                else
+                    closeSocket(hostKey, idle);
+            }
+            if (!socket)
+            {
+                if (pool.open >= connectionsPerHost_)
+                    break;
+                const QUrl url = pool.waiting.first()->url();
+                socket = new QTcpSocket(this);
+                pool.open++;
+                socket->connectToHost(url.host(), url.port(80));
+            }
+
+            Assignment assignment;
+            assignment.reply = pool.waiting.takeFirst();
+            assignment.hostKey = hostKey;
+            assignment.socket = socket;
+            assignment.reused = reused;
+            assignments << assignment;
+        }
+    }
+
+    // Started after the pools are settled, a failing start reenters the engine.
+    foreach(const Assignment &assignment, assignments)
+    {
+        if (assignment.reply)
+            assignment.reply->start(assignment.socket, assignment.reused);
+        else
+            release(assignment.hostKey, assignment.socket, assignment.reused);
+    }
+}
+
+void QS3HttpEngine::release(const QByteArray &hostKey, QTcpSocket *socket, bool reusable)
+{
+    if (!pools_.contains(hostKey))
+    {
+        socket->abort();
+        socket->deleteLater();
+        return;
+    }
+    if (!reusable || idleTimeout_ == 0)
+    {
+        closeSocket(hostKey, socket);
+        scheduleDispatch();
+        return;
+    }
+
+    socket->setReadBufferSize(0);
+    IdleSocket idle;
+    idle.socket = socket;
+    idle.since = clock_.elapsed();
+    pools_[hostKey].idle << idle;
+    idleHosts_[socket] = hostKey;
+
+    // Data on an idle connection means it is out of sync, a close means the server dropped it.
+    connect(socket, SIGNAL(disconnected()), SLOT(onIdleSocketClosed()));
+    connect(socket, SIGNAL(readyRead()), SLOT(onIdleSocketClosed()));
+    if (!idleTimer_->isActive())
+        idleTimer_->start();
+    scheduleDispatch();
+}
+
+void QS3HttpEngine::closeSocket(const QByteArray &hostKey, QTcpSocket *socket)
+{
+    idleHosts_.remove(socket);
+    disconnect(socket, 0, this, 0);
+    socket->abort();
+    socket->deleteLater();
+    if (pools_.contains(hostKey))
+    {
+        HostPool &pool = pools_[hostKey];
+        pool.open = qMax(0, pool.open - 1);
+    }
+}
+
+void QS3HttpEngine::applySocketOptions(QTcpSocket *socket)
+{
+    socket->setSocketOption(QAbstractSocket::LowDelayOption, tcpNoDelay_ ? 1 : 0);
+    socket->setSocketOption(QAbstractSocket::KeepAliveOption, 1);
+    if (socketBufferSize_ <= 0 || socket->socketDescriptor() == -1)
+        return;
+
+    // Not exposed by QAbstractSocket in Qt 4.
+#ifdef _WIN32
+    const SOCKET fd = static_cast<SOCKET>(socket->socketDescriptor());
+#else
+    const int fd = static_cast<int>(socket->socketDescriptor());
+#endif
+    const int size = socketBufferSize_;
+    const char *value = reinterpret_cast<const char*>(&size);
+    if (setsockopt(fd, SOL_SOCKET, SO_RCVBUF, value, sizeof(size)) != 0 || setsockopt(fd, SOL_SOCKET, SO_SNDBUF, value, sizeof(size)) != 0)
+        qDebug() << "QS3HttpEngine: Warning: Failed to set socket buffer size to" << size;
+}
+
+void QS3HttpEngine::onReplyFinished()
+{
+    QNetworkReply *reply = qobject_cast<QNetworkReply*>(sender());
+    if (reply)
+        emit finished(reply);
+}
+
+void QS3HttpEngine::onIdleSocketClosed()
+{
+    QTcpSocket *socket = qobject_cast<QTcpSocket*>(sender());
+    if (!socket || !idleHosts_.contains(socket))
+        return;
+    const QByteArray hostKey = idleHosts_.value(socket);
+    QList<IdleSocket> &idle = pools_[hostKey].idle;
+    for (int i=0; i<idle.size(); ++i)
+    {
+        if (idle[i].socket == socket)
+        {
+            idle.removeAt(i);
+            break;
+        }
+    }
+    closeSocket(hostKey, socket);
+}
+
+void QS3HttpEngine::onIdleTimer()
+{
+    const qint64 now = clock_.elapsed();
+    bool anyIdle = false;
+
+    QMutableHashIterator<QByteArray, HostPool> it(pools_);
+    while (it.hasNext())
+    {
+        it.next();
+        QList<IdleSocket> &idle = it.value().idle;
+        for (int i=idle.size()-1; i>=0; --i)
+        {
+            if (now - idle[i].since < idleTimeout_)
+                continue;
+            QTcpSocket *socket = idle[i].socket;
+            idle.removeAt(i);
+            closeSocket(it.key(), socket);
+        }
+        anyIdle = anyIdle || !idle.isEmpty();
+    }
+    if (!anyIdle)
+        idleTimer_->stop();
+}
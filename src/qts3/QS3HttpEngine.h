@@ -0,0 +1,207 @@
+
+#pragma once
+
+#include "QS3Transport.h"
+#include "QS3Defines.h"
+
+#include <QNetworkReply>
+#include <QNetworkRequest>
+#include <QAbstractSocket>
+#include <QByteArray>
+#include <QHash>
+#include <QList>
+#include <QPointer>
+#include <QElapsedTimer>
+
+class QTcpSocket;
+class QTimer;
+class QS3HttpEngine;
+
+/// QS3HttpReply
+
+/** Reply of QS3HttpEngine.
+
+    The body of a response with a Content-Length is not copied by the
+    reply, read takes it straight from the socket buffer into the caller
+    buffer and finished is emitted once the whole body is in the socket.
+    The connection returns to the pool when the body has been read.
+    Chunked responses are decoded into a buffer. */
+class QS3HttpReply : public QNetworkReply
+{
+Q_OBJECT
+
+friend class QS3HttpEngine;
+
+public:
+    ~QS3HttpReply();
+
+    void abort();
+    qint64 bytesAvailable() const;
+    void setReadBufferSize(qint64 size);
+
+protected:
+    qint64 readData(char *data, qint64 maxSize);
+    qint64 writeData(const char *data, qint64 maxSize);
+
+private slots:
+    void onConnected();
+    void onReadyRead();
+    void onBytesWritten(qint64 bytes);
+    void onUploadReadyRead();
+    void onSocketError(QAbstractSocket::SocketError socketError);
+    void onDisconnected();
+    void checkBodyArrived();
+    void failUnsupported();
+
+private:
+    QS3HttpReply(QS3HttpEngine *engine, const QByteArray &verb, const QNetworkRequest &request, const QByteArray &body, QIODevice *device);
+
+    enum State
+    {
+        WaitingState = 0,
+        ConnectingState,
+        SendingState,
+        SentState,
+        DoneState
+    };
+
+    enum Framing
+    {
+        NoBody = 0,
+        LengthBody,
+        ChunkedBody,
+        UntilCloseBody
+    };
+
+    /// Sends the request on socket, reused if it served earlier requests.
+    void start(QTcpSocket *socket, bool reused);
+    QByteArray requestHead() const;
+
+    /// Writes body data while the socket write buffer is low.
+    void writeBody();
+
+    /// Parses the status line and headers, returns false on a protocol error.
+    bool readHead();
+
+    /// Decodes chunks from the socket into buffer_, returns false on a protocol error.
+    bool readChunks();
+
+    /// Body bytes that can be read from the socket.
+    qint64 socketBodyBytes() const;
+
+    /// Returns true if a stale reused connection was closed before the response and the request was sent again.
+    bool retry();
+
+    /// Hands the socket back to the engine, reusable only after a complete exchange.
+    void releaseSocket(bool reusable);
+    void fail(QNetworkReply::NetworkError code, const QString &message);
+    void finish();
+
+    QPointer<QS3HttpEngine> engine_;
+    QByteArray verb_;
+    QByteArray hostKey_;
+    QByteArray body_;
+    QPointer<QIODevice> device_;
+    qint64 uploadSize_;
+
+    QPointer<QTcpSocket> socket_;
+    bool reused_;
+    bool retried_;
+    State state_;
+
+    /// Request head size and bytes of head and body written to the socket and acknowledged by bytesWritten.
+    qint64 headSize_;
+    qint64 written_;
+    qint64 acknowledged_;
+
+    bool requestSent_;
+
+    int httpMajor_;
+    int httpMinor_;
+    int statusCode_;
+    QByteArray reasonPhrase_;
+    QByteArray lastHeader_;
+    bool headersDone_;
+    bool keepAlive_;
+    bool responseStarted_;
+
+    Framing framing_;
+    qint64 contentLength_;
+
+    /// Body bytes taken from the socket, read directly or moved to buffer_.
+    qint64 consumed_;
+    bool arrived_;
+
+    /// Chunked body state, -1 while reading a chunk size line.
+    qint64 chunkRemaining_;
+    bool chunkTrailer_;
+
+    /// Decoded chunked body and data left over from a closed connection.
+    QByteArray buffer_;
+};
+
+/// QS3HttpEngine
+
+/** QS3Config::NativeTransport, HTTP/1.1 on QTcpSocket.
+
+    Each host has a pool of up to QS3Config::connectionsPerHost persistent
+    connections. Requests over the limit wait in priority order for a free
+    connection, idle connections are closed after
+    QS3Config::idleConnectionTimeout. Sockets are set up with
+    QS3Config::tcpNoDelay and QS3Config::socketBufferSize. A request that
+    finds a reused connection closed by the server is sent once again on a
+    new one. Only plain http urls are supported, like QS3Client uses. */
+class QS3HttpEngine : public QS3Transport
+{
+Q_OBJECT
+
+friend class QS3HttpReply;
+
+public:
+    QS3HttpEngine(const QS3Config &config, QObject *parent = 0);
+    ~QS3HttpEngine();
+
+    QNetworkReply *send(const QByteArray &verb, const QNetworkRequest &request, const QByteArray &body, QIODevice *device);
+
+private slots:
+    void onReplyFinished();
+    void onIdleSocketClosed();
+    void onIdleTimer();
+    void dispatchWaiting();
+
+private:
+    struct IdleSocket
+    {
+        QTcpSocket *socket;
+        qint64 since;
+    };
+
+    struct HostPool
+    {
+        HostPool() : open(0) {}
+
+        /// Sockets of the host, connecting, in use and idle.
+        int open;
+        QList<IdleSocket> idle;
+        QList<QPointer<QS3HttpReply> > waiting;
+    };
+
+    /// Queues reply for a connection to its host.
+    void enqueue(QS3HttpReply *reply, bool first);
+    void dequeue(QS3HttpReply *reply);
+    void release(const QByteArray &hostKey, QTcpSocket *socket, bool reusable);
+    void closeSocket(const QByteArray &hostKey, QTcpSocket *socket);
+    void applySocketOptions(QTcpSocket *socket);
+    void scheduleDispatch();
+
+    int connectionsPerHost_;
+    int idleTimeout_;
+    bool tcpNoDelay_;
+    int socketBufferSize_;
+
+    QHash<QByteArray, HostPool> pools_;
+    QHash<QTcpSocket*, QByteArray> idleHosts_;
+    QTimer *idleTimer_;
+    QElapsedTimer clock_;
+    bool dispatchScheduled_;
+};
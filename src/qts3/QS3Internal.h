@@ -5,8 +5,9 @@
 #include <QStringList>
 #include <QDateTime>
 #include <QHash>
-#include <QCryptographicHash>
+#include <QUrl>
 #include <QByteArray>
+#include <QVariant>
 
 namespace QS3
 {   
@@ -22,11 +23,16 @@ namespace QS3
     static QByteArray AMAZON_HEADER_COPY_SOURCE         = "x-amz-copy-source";
     static QByteArray STANDARD_HEADER_AUTHORIZATION     = "Authorization";
     static QByteArray STANDARD_HEADER_DATE              = "Date";
+    static QByteArray STANDARD_HEADER_RANGE             = "Range";
+    static QByteArray STANDARD_HEADER_CONTENT_RANGE     = "Content-Range";
+    static QByteArray STANDARD_HEADER_IF_MATCH          = "If-Match";
+    static QByteArray STANDARD_HEADER_ETAG              = "ETag";
 
     static void initStaticData()
     {
         AMAZON_QUERY_KEYS.clear();
-        AMAZON_QUERY_KEYS << "versioning" << "location" << "acl" << "torrent" << "lifecycle" << "versionid";
+        AMAZON_QUERY_KEYS << "versioning" << "location" << "acl" << "torrent" << "lifecycle" << "versionid"
+                          << "uploads" << "uploadId" << "partNumber";
 
         MONTHS.clear();
         MONTHS[1] = "Jan";
@@ -52,11 +58,6 @@ namespace QS3
         DAYS[7] = "Sun";
     }
 
-    bool QueryItemCompare(const QS3QueryPair &q1, const QS3QueryPair &q2)
-    {
-        return (q1.first.compare(q2.first) < 0);
-    }
-
     static QString generateTimestamp()
     {
         // Generate the needed timestamp
@@ -71,61 +72,6 @@ namespace QS3
         return formatted;
     }
 
-    // Copied from http://www.d-pointer.com/solutions/kqoauth/ Class: KQOAuthUtils
-    static QString hmacSha1(const QString &message, const QString &key)
-    {
-        QByteArray keyBytes = key.toAscii();
-        int keyLength;              // Lenght of key word
-        const int blockSize = 64;   // Both MD5 and SHA-1 have a block size of 64.
-
-        keyLength = keyBytes.size();
-        // If key is longer than block size, we need to hash the key
-        if (keyLength > blockSize) {
-            QCryptographicHash hash(QCryptographicHash::Sha1);
-            hash.addData(keyBytes);
-            keyBytes = hash.result();
-        }
-
-        /* http://tools.ietf.org/html/rfc2104  - (1) */
-        // Create the opad and ipad for the hash function.
-        QByteArray ipad;
-        QByteArray opad;
-
-        ipad.fill( 0, blockSize);
-        opad.fill( 0, blockSize);
-
-        ipad.replace(0, keyBytes.length(), keyBytes);
-        opad.replace(0, keyBytes.length(), keyBytes);
-
-        /* http://tools.ietf.org/html/rfc2104 - (2) & (5) */
-        for (int i=0; i<64; i++) {
-            ipad[i] = ipad[i] ^ 0x36;
-            opad[i] = opad[i] ^ 0x5c;
-        }
-
-        QByteArray workArray;
-        workArray.clear();
-
-        workArray.append(ipad, 64);
-        /* http://tools.ietf.org/html/rfc2104 - (3) */
-        workArray.append(message.toAscii());
-
-
-        /* http://tools.ietf.org/html/rfc2104 - (4) */
-        QByteArray sha1 = QCryptographicHash::hash(workArray, QCryptographicHash::Sha1);
-
-        /* http://tools.ietf.org/html/rfc2104 - (6) */
-        workArray.clear();
-        workArray.append(opad, 64);
-        workArray.append(sha1);
-
-        sha1.clear();
-
-        /* http://tools.ietf.org/html/rfc2104 - (7) */
-        sha1 = QCryptographicHash::hash(workArray, QCryptographicHash::Sha1);
-        return QString(sha1.toBase64());
-    }
-    
     static QByteArray cannedAclToHeader(QS3::CannedAcl cannedAcl)
     {
         switch(cannedAcl)
@@ -148,22 +94,64 @@ namespace QS3
         return "";
     }
     
-    static void addOrReplaceQuery(QUrl *url, const QString &key, const QString &value)
+    static QByteArray generateRangeHeader(qint64 offset, qint64 length)
+    {
+        // http://www.w3.org/Protocols/rfc2616/rfc2616-sec14.html#sec14.35
+        // Example: bytes=500-999
+        if (length > 0)
+            return "bytes=" + QByteArray::number(offset) + "-" + QByteArray::number(offset + length - 1);
+        return "bytes=" + QByteArray::number(offset) + "-";
+    }
+
+    static qint64 parseTotalSize(const QByteArray &contentRange, const QVariant &contentLength)
     {
-        // Set the marker
-        if (url->hasQueryItem(key))
+        // Ranged responses tell the full size in Content-Range: bytes 0-1023/146515
+        int slash = contentRange.lastIndexOf('/');
+        if (slash >= 0)
         {
-            QS3QueryPairList query = url->queryItems();
-            for(int i=0; i<query.size(); ++i)
-            {
-                QS3QueryPair &pair = query[i];
-                if (pair.first == key)
-                    pair.second = value;
-            }
-            url->setQueryItems(query);
+            bool ok = false;
+            qint64 total = contentRange.mid(slash + 1).toLongLong(&ok);
+            if (ok)
+                return total;
         }
-        else
-            url->addQueryItem(key, value);
+        return contentLength.isNull() ? -1 : contentLength.toLongLong();
+    }
+
+    static qint64 parseRangeStart(const QByteArray &contentRange)
+    {
+        // bytes 500-999/146515, -1 if not a byte range.
+        int space = contentRange.indexOf(' ');
+        int dash = contentRange.indexOf('-');
+        if (space < 0 || dash < space)
+            return -1;
+        bool ok = false;
+        qint64 first = contentRange.mid(space + 1, dash - space - 1).trimmed().toLongLong(&ok);
+        return (ok ? first : -1);
+    }
+
+    static qint64 parseDataOffset(const QByteArray &contentRange, int httpStatusCode, qint64 dataSize)
+    {
+        // Only 206 Partial Content is a range, anything else is the object from its start.
+        if (httpStatusCode != 206)
+            return 0;
+        // Data ends where Content-Range ends, bytes 500-999/146515. Data of a resumed get
+        // is prepended to the last response, so its start is counted back from the end.
+        int dash = contentRange.indexOf('-');
+        int slash = contentRange.lastIndexOf('/');
+        if (dash < 0 || slash < dash)
+            return -1;
+        bool ok = false;
+        qint64 last = contentRange.mid(dash + 1, slash - dash - 1).trimmed().toLongLong(&ok);
+        if (!ok || last + 1 < dataSize)
+            return -1;
+        return last + 1 - dataSize;
+    }
+
+    static void setEncodedQuery(QUrl *url, const QString &key, const QString &value)
+    {
+        // QUrl leaves '+' unencoded and S3 reads it as a space, encode everything.
+        url->removeAllQueryItems(key);
+        url->addEncodedQueryItem(QUrl::toPercentEncoding(key), QUrl::toPercentEncoding(value));
     }
 
     static QString generateOrderedQuery(const Q3SQueryParams &queryParams)
@@ -171,8 +159,12 @@ namespace QS3
         if (queryParams.isEmpty())
             return "";
 
+        // Subresources are signed in lexicographic order, QHash keys are not ordered.
+        QStringList queryKeys = queryParams.keys();
+        qSort(queryKeys);
+
         QString query = "?";
-        foreach(QString queryKey, queryParams.keys())
+        foreach(QString queryKey, queryKeys)
         {
             if (queryParams[queryKey].isEmpty())
                 query += queryKey + "&";
@@ -184,20 +176,34 @@ namespace QS3
         return query;
     }
     
-    static QString generateOrderedQuery(QS3QueryPairList queryItems, const QStringList &keepKeys)
+    static QByteArray canonicalSubresources(const QUrl &url)
     {
-        if (queryItems.isEmpty())
-            return "";
+        // Only the amazon subresource keys are signed, sorted by key.
+        QList<QPair<QByteArray, QByteArray> > items = url.encodedQueryItems();
+        QList<QPair<QByteArray, QByteArray> > subresources;
+        for (int i=0; i<items.size(); ++i)
+        {
+            foreach(const QString &subresource, AMAZON_QUERY_KEYS)
+            {
+                if (subresource.compare(QLatin1String(items[i].first.constData()), Qt::CaseInsensitive) == 0)
+                {
+                    subresources << qMakePair(items[i].first, QUrl::fromPercentEncoding(items[i].second).toUtf8());
+                    break;
+                }
+            }
+        }
+        if (subresources.isEmpty())
+            return QByteArray();
+        qSort(subresources);
 
-        qSort(queryItems.begin(), queryItems.end(), QS3::QueryItemCompare);
-        Q3SQueryParams queryParams;
-        foreach(QS3QueryPair queryPair, queryItems)
+        QByteArray query;
+        for (int i=0; i<subresources.size(); ++i)
         {
-            if (keepKeys.isEmpty())
-                queryParams[queryPair.first] = queryPair.second;
-            else if (keepKeys.contains(queryPair.first, Qt::CaseInsensitive))
-                queryParams[queryPair.first] = queryPair.second;
+            query += (i == 0 ? '?' : '&');
+            query += subresources[i].first;
+            if (!subresources[i].second.isEmpty())
+                query += '=' + subresources[i].second;
         }
-        return generateOrderedQuery(queryParams);
+        return query;
     }
 }
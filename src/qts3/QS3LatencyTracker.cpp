@@ -0,0 +1,43 @@
+
+#include "QS3LatencyTracker.h"
+
+#include <QtAlgorithms>
+
+QS3LatencyTracker::QS3LatencyTracker(int capacity) :
+    capacity_(qMax(1, capacity)),
+    next_(0),
+    dirty_(false)
+{
+    samples_.reserve(capacity_);
+}
+
+void QS3LatencyTracker::addSample(qint64 msecs)
+{
+    if (samples_.size() < capacity_)
+        samples_.append(msecs);
+    else
+        samples_[next_] = msecs;
+    next_ = (next_ + 1) % capacity_;
+    dirty_ = true;
+}
+
+int QS3LatencyTracker::sampleCount() const
+{
+    return samples_.size();
+}
+
+qint64 QS3LatencyTracker::percentile(double percentile)
+{
+    if (samples_.isEmpty())
+        return -1;
+
+    // Sorted lazily, queries are much more frequent than new samples.
+    if (dirty_)
+    {
+        sorted_ = samples_;
+        qSort(sorted_);
+        dirty_ = false;
+    }
+    int index = static_cast<int>(qBound(0.0, percentile, 1.0) * (sorted_.size() - 1) + 0.5);
+    return sorted_[index];
+}
@@ -0,0 +1,30 @@
+
+#pragma once
+
+#include <QtGlobal>
+#include <QVector>
+
+/// QS3LatencyTracker
+
+/** Keeps the most recent latency samples in a ring buffer and
+    answers percentile queries over them. */
+class QS3LatencyTracker
+{
+public:
+    explicit QS3LatencyTracker(int capacity = 256);
+
+    void addSample(qint64 msecs);
+
+    /// Returns the number of samples, at most capacity.
+    int sampleCount() const;
+
+    /// Returns the latency at percentile in [0, 1], -1 if there are no samples.
+    qint64 percentile(double percentile);
+
+private:
+    QVector<qint64> samples_;
+    QVector<qint64> sorted_;
+    int capacity_;
+    int next_;
+    bool dirty_;
+};
@@ -0,0 +1,589 @@
+
+#include "QS3MultipartUpload.h"
+#include "QS3Client.h"
+#include "QS3Xml.h"
+
+#include <QFile>
+#include <QFileInfo>
+#include <QDateTime>
+#include <QUrl>
+#include <QTimer>
+#include <QDebug>
+
+namespace
+{
+    static const qint64 MIN_PART_SIZE = 5 * 1024 * 1024;
+    static const int MAX_PARTS = 10000;
+    static const int MAX_PART_ATTEMPTS = 3;
+    static const QByteArray JOURNAL_MAGIC = "qts3-multipart-journal 1";
+}
+
+const QString QS3MultipartUpload::JournalSuffix = ".qts3journal";
+
+QS3MultipartUpload::QS3MultipartUpload(QS3Client *client, const QString &key, const QString &fileName, const QString &journalFileName, const QS3FileMetadata &metadata, QS3::CannedAcl cannedAcl) :
+    QObject(client),
+    client_(client),
+    operation_(Upload),
+    key_(key),
+    fileName_(fileName),
+    journalFileName_(journalFileName),
+    bucket_(client->bucket()),
+    metadata_(metadata),
+    cannedAcl_(cannedAcl),
+    fileSize_(0),
+    fileModified_(0),
+    partSize_(8 * 1024 * 1024),
+    partCount_(0),
+    maxConcurrent_(4),
+    file_(0),
+    journal_(0),
+    nextPart_(1),
+    uploadedBytes_(0),
+    finished_(false),
+    succeeded_(false)
+{
+    QTimer::singleShot(0, this, SLOT(start()));
+}
+
+QS3MultipartUpload::QS3MultipartUpload(QS3Client *client, const QString &journalFileName, Operation operation) :
+    QObject(client),
+    client_(client),
+    operation_(operation),
+    journalFileName_(journalFileName),
+    cannedAcl_(QS3::NoCannedAcl),
+    fileSize_(0),
+    fileModified_(0),
+    partSize_(8 * 1024 * 1024),
+    partCount_(0),
+    maxConcurrent_(4),
+    file_(0),
+    journal_(0),
+    nextPart_(1),
+    uploadedBytes_(0),
+    finished_(false),
+    succeeded_(false)
+{
+    QTimer::singleShot(0, this, SLOT(start()));
+}
+
+QS3MultipartUpload::~QS3MultipartUpload()
+{
+    if (client_)
+    {
+        foreach(QS3RequestId id, ongoing_.keys())
+            client_->cancel(id);
+    }
+    delete file_;
+    delete journal_;
+}
+
+void QS3MultipartUpload::setPartSize(qint64 partSize)
+{
+    partSize_ = qMax(MIN_PART_SIZE, partSize);
+}
+
+void QS3MultipartUpload::setMaxConcurrent(int maxConcurrent)
+{
+    maxConcurrent_ = qMax(1, maxConcurrent);
+}
+
+QString QS3MultipartUpload::key() const
+{
+    return key_;
+}
+
+QString QS3MultipartUpload::fileName() const
+{
+    return fileName_;
+}
+
+QString QS3MultipartUpload::journalFileName() const
+{
+    return journalFileName_;
+}
+
+QString QS3MultipartUpload::uploadId() const
+{
+    return uploadId_;
+}
+
+qint64 QS3MultipartUpload::uploadedBytes() const
+{
+    return uploadedBytes_;
+}
+
+qint64 QS3MultipartUpload::totalBytes() const
+{
+    return fileSize_;
+}
+
+bool QS3MultipartUpload::isFinished() const
+{
+    return finished_;
+}
+
+bool QS3MultipartUpload::succeeded() const
+{
+    return succeeded_;
+}
+
+QS3Error QS3MultipartUpload::error() const
+{
+    return error_;
+}
+
+QString QS3MultipartUpload::eTag() const
+{
+    return eTag_;
+}
+
+void QS3MultipartUpload::start()
+{
+    if (finished_)
+        return;
+    if (!client_)
+    {
+        fail("QS3Client was destroyed before the job started.");
+        return;
+    }
+
+    if (operation_ == Upload)
+    {
+        QFileInfo info(fileName_);
+        fileSize_ = info.size();
+        fileModified_ = info.lastModified().toTime_t();
+        if (fileSize_ <= 0)
+        {
+            fail("Input file is empty or does not exist: " + fileName_);
+            return;
+        }
+        initiate();
+        return;
+    }
+
+    if (!readJournal())
+        return;
+    if (bucket_ != client_->bucket())
+    {
+        fail("Journal is for bucket " + bucket_ + ", the client uses bucket " + client_->bucket());
+        return;
+    }
+
+    if (operation_ == Abort || !fileMatchesJournal())
+    {
+        // Nothing to resume if the file has changed, the uploaded parts are stale.
+        if (operation_ == Resume)
+            error_.error = "File has changed since the upload was started: " + fileName_;
+        QS3RequestId id = client_->abortMultipartUpload(key_, uploadId_, this, AbortRequest);
+        if (id == 0)
+        {
+            fail("Invalid journal " + journalFileName_);
+            return;
+        }
+        ongoing_[id] = 0;
+        return;
+    }
+
+    QS3RequestId id = client_->listParts(key_, uploadId_, 0, this, ListRequest);
+    if (id == 0)
+    {
+        fail("Invalid journal " + journalFileName_);
+        return;
+    }
+    ongoing_[id] = 0;
+}
+
+void QS3MultipartUpload::cancel()
+{
+    if (finished_)
+        return;
+
+    if (client_)
+    {
+        foreach(QS3RequestId id, ongoing_.keys())
+            client_->cancel(id);
+    }
+    ongoing_.clear();
+    error_.error = "Operation canceled";
+    finish();
+}
+
+void QS3MultipartUpload::initiate()
+{
+    computeParts();
+    QS3RequestId id = client_->initiateMultipartUpload(key_, metadata_, cannedAcl_, this, InitiateRequest);
+    if (id == 0)
+    {
+        fail("Invalid key " + key_);
+        return;
+    }
+    ongoing_[id] = 0;
+}
+
+void QS3MultipartUpload::computeParts()
+{
+    const qint64 minPartSize = (fileSize_ + MAX_PARTS - 1) / MAX_PARTS;
+    partSize_ = qMax(partSize_, minPartSize);
+    partCount_ = static_cast<int>((fileSize_ + partSize_ - 1) / partSize_);
+}
+
+qint64 QS3MultipartUpload::partLength(int partNumber) const
+{
+    if (partNumber < partCount_)
+        return partSize_;
+    return fileSize_ - static_cast<qint64>(partCount_ - 1) * partSize_;
+}
+
+void QS3MultipartUpload::handleResult(const QS3Result &result)
+{
+    if (!ongoing_.contains(result.id))
+        return;
+    int partNumber = ongoing_.take(result.id);
+
+    switch (result.tag)
+    {
+        case InitiateRequest: onInitiated(result); break;
+        case ListRequest: onPartsListed(result); break;
+        case PartRequest: onPartUploaded(result, partNumber); break;
+        case CompleteRequest: onCompleted(result); break;
+        case AbortRequest: onAborted(result); break;
+        default: break;
+    }
+}
+
+void QS3MultipartUpload::onInitiated(const QS3Result &result)
+{
+    QString errorMessage;
+    if (!result.succeeded)
+    {
+        fail("Failed to initiate multipart upload.", result.error);
+        return;
+    }
+    if (!QS3Xml::parseInitiateMultipartUpload(uploadId_, result.data, errorMessage))
+    {
+        fail(errorMessage);
+        return;
+    }
+    if (!writeJournalHeader())
+    {
+        // Without a journal the upload could not be resumed or cleaned up, do not leave it behind.
+        error_.error = "Failed to write journal " + journalFileName_;
+        QS3RequestId id = client_ ? client_->abortMultipartUpload(key_, uploadId_, this, AbortRequest) : 0;
+        if (id == 0)
+        {
+            const QString message = error_.error;
+            fail(message);
+            return;
+        }
+        ongoing_[id] = 0;
+        return;
+    }
+    pump();
+}
+
+void QS3MultipartUpload::onPartsListed(const QS3Result &result)
+{
+    if (!result.succeeded)
+    {
+        // The upload has been completed, aborted or expired. Start over.
+        if (result.httpStatusCode == 404 || result.error.code == "NoSuchUpload")
+        {
+            qDebug() << "QS3MultipartUpload: Upload" << uploadId_ << "no longer exists, starting again:" << fileName_;
+            removeJournal();
+            journalParts_.clear();
+            uploadId_.clear();
+            initiate();
+            return;
+        }
+        fail("Failed to list uploaded parts.", result.error);
+        return;
+    }
+
+    bool isTruncated = false;
+    int nextMarker = 0;
+    QString errorMessage;
+    if (!QS3Xml::parseListParts(listedETags_, listedSizes_, isTruncated, nextMarker, result.data, errorMessage))
+    {
+        fail(errorMessage);
+        return;
+    }
+    if (isTruncated && nextMarker > 0)
+    {
+        QS3RequestId id = client_ ? client_->listParts(key_, uploadId_, nextMarker, this, ListRequest) : 0;
+        if (id == 0)
+        {
+            fail("Failed to list uploaded parts.");
+            return;
+        }
+        ongoing_[id] = 0;
+        return;
+    }
+
+    // Trust only parts that S3 has with the journaled ETag and expected size.
+    QMap<int, QString>::const_iterator iter = journalParts_.constBegin();
+    for (; iter != journalParts_.constEnd(); ++iter)
+    {
+        const int partNumber = iter.key();
+        if (partNumber > partCount_ || listedETags_.value(partNumber) != iter.value() || listedSizes_.value(partNumber, -1) != partLength(partNumber))
+            continue;
+        completedParts_[partNumber] = iter.value();
+        uploadedBytes_ += partLength(partNumber);
+    }
+    journalParts_.clear();
+    listedETags_.clear();
+    listedSizes_.clear();
+
+    emit progress(this, uploadedBytes_, fileSize_);
+    pump();
+}
+
+void QS3MultipartUpload::onPartUploaded(const QS3Result &result, int partNumber)
+{
+    if (finished_)
+        return;
+
+    if (!result.succeeded || result.eTag.isEmpty())
+    {
+        if (++attempts_[partNumber] < MAX_PART_ATTEMPTS && sendPart(partNumber))
+            return;
+        fail(QString("Failed to upload part %1.").arg(partNumber), result.error);
+        return;
+    }
+
+    completedParts_[partNumber] = result.eTag;
+    uploadedBytes_ += partLength(partNumber);
+    if (!appendJournal("part " + QByteArray::number(partNumber) + " " + QUrl::toPercentEncoding(result.eTag)))
+        qDebug() << "QS3MultipartUpload: Warning: Failed to write part" << partNumber << "to journal" << journalFileName_;
+
+    emit progress(this, uploadedBytes_, fileSize_);
+    pump();
+}
+
+void QS3MultipartUpload::onCompleted(const QS3Result &result)
+{
+    if (!result.succeeded)
+    {
+        fail("Failed to complete multipart upload.", result.error);
+        return;
+    }
+
+    QS3Error error;
+    QString errorMessage;
+    if (!QS3Xml::parseCompleteMultipartUpload(eTag_, error, result.data, errorMessage))
+    {
+        fail(errorMessage, error);
+        return;
+    }
+    removeJournal();
+    succeeded_ = true;
+    finish();
+}
+
+void QS3MultipartUpload::onAborted(const QS3Result &result)
+{
+    // An upload that no longer exists is as good as aborted.
+    if (!result.succeeded && result.httpStatusCode != 404 && result.error.code != "NoSuchUpload")
+    {
+        fail("Failed to abort multipart upload.", result.error);
+        return;
+    }
+    removeJournal();
+
+    // Uploads are aborted when they cannot be continued, the job still failed.
+    if (operation_ != Abort)
+    {
+        const QString message = error_.error;
+        fail(message);
+        return;
+    }
+    succeeded_ = true;
+    finish();
+}
+
+void QS3MultipartUpload::pump()
+{
+    if (finished_ || !client_)
+        return;
+
+    while (ongoing_.size() < maxConcurrent_ && nextPart_ <= partCount_)
+    {
+        int partNumber = nextPart_++;
+        if (completedParts_.contains(partNumber))
+            continue;
+        if (!sendPart(partNumber))
+        {
+            fail(QString("Failed to read part %1 from %2").arg(partNumber).arg(fileName_));
+            return;
+        }
+    }
+
+    if (ongoing_.isEmpty() && completedParts_.size() == partCount_)
+    {
+        QS3RequestId id = client_->completeMultipartUpload(key_, uploadId_, completedParts_, this, CompleteRequest);
+        if (id == 0)
+        {
+            fail("Failed to complete multipart upload.");
+            return;
+        }
+        ongoing_[id] = 0;
+    }
+}
+
+bool QS3MultipartUpload::sendPart(int partNumber)
+{
+    if (!client_)
+        return false;
+    if (!file_)
+    {
+        file_ = new QFile(fileName_);
+        if (!file_->open(QIODevice::ReadOnly))
+            return false;
+    }
+
+    // Only the ongoing parts are in memory.
+    const qint64 length = partLength(partNumber);
+    if (!file_->seek(static_cast<qint64>(partNumber - 1) * partSize_))
+        return false;
+    QByteArray data = file_->read(length);
+    if (data.size() != length)
+        return false;
+
+    QS3RequestId id = client_->uploadPart(key_, uploadId_, partNumber, data, this, PartRequest);
+    if (id == 0)
+        return false;
+    ongoing_[id] = partNumber;
+    return true;
+}
+
+bool QS3MultipartUpload::writeJournalHeader()
+{
+    delete journal_;
+    journal_ = new QFile(journalFileName_);
+    if (!journal_->open(QIODevice::WriteOnly | QIODevice::Truncate))
+        return false;
+
+    // One record per line, values percent encoded. Parts are appended as they complete.
+    QByteArray header = JOURNAL_MAGIC + "\n";
+    header += "bucket " + QUrl::toPercentEncoding(bucket_) + "\n";
+    header += "key " + QUrl::toPercentEncoding(key_) + "\n";
+    header += "file " + QUrl::toPercentEncoding(fileName_) + "\n";
+    header += "size " + QByteArray::number(fileSize_) + "\n";
+    header += "modified " + QByteArray::number(fileModified_) + "\n";
+    header += "partsize " + QByteArray::number(partSize_) + "\n";
+    header += "acl " + QByteArray::number(static_cast<int>(cannedAcl_)) + "\n";
+    header += "contenttype " + QUrl::toPercentEncoding(metadata_.contentType) + "\n";
+    header += "contentencoding " + QUrl::toPercentEncoding(metadata_.contentEncoding) + "\n";
+    header += "uploadid " + QUrl::toPercentEncoding(uploadId_) + "\n";
+    if (journal_->write(header) != header.size())
+        return false;
+    return journal_->flush();
+}
+
+bool QS3MultipartUpload::appendJournal(const QByteArray &line)
+{
+    if (!journal_)
+    {
+        journal_ = new QFile(journalFileName_);
+        if (!journal_->open(QIODevice::WriteOnly | QIODevice::Append))
+            return false;
+    }
+    // Flushed per record so a crash loses at most the part being written.
+    const QByteArray record = line + "\n";
+    if (journal_->write(record) != record.size())
+        return false;
+    return journal_->flush();
+}
+
+bool QS3MultipartUpload::readJournal()
+{
+    QFile journal(journalFileName_);
+    if (!journal.open(QIODevice::ReadOnly))
+    {
+        fail("Failed to open journal " + journalFileName_);
+        return false;
+    }
+
+    QByteArray magic = journal.readLine().trimmed();
+    if (magic != JOURNAL_MAGIC)
+    {
+        fail("Invalid journal " + journalFileName_);
+        return false;
+    }
+
+    while (!journal.atEnd())
+    {
+        QByteArray line = journal.readLine();
+        if (!line.endsWith('\n'))
+            break; // Partially written record.
+        QList<QByteArray> parts = line.trimmed().split(' ');
+        if (parts.size() < 2)
+            continue;
+
+        const QByteArray &name = parts[0];
+        const QString value = QUrl::fromPercentEncoding(parts[1]);
+        if (name == "bucket") bucket_ = value;
+        else if (name == "key") key_ = value;
+        else if (name == "file") fileName_ = value;
+        else if (name == "size") fileSize_ = parts[1].toLongLong();
+        else if (name == "modified") fileModified_ = parts[1].toUInt();
+        else if (name == "partsize") partSize_ = parts[1].toLongLong();
+        else if (name == "acl") cannedAcl_ = static_cast<QS3::CannedAcl>(parts[1].toInt());
+        else if (name == "contenttype") metadata_.contentType = value;
+        else if (name == "contentencoding") metadata_.contentEncoding = value;
+        else if (name == "uploadid") uploadId_ = value;
+        else if (name == "part" && parts.size() >= 3)
+            journalParts_[parts[1].toInt()] = QUrl::fromPercentEncoding(parts[2]);
+    }
+
+    if (key_.isEmpty() || uploadId_.isEmpty() || fileSize_ <= 0 || partSize_ <= 0)
+    {
+        fail("Incomplete journal " + journalFileName_);
+        return false;
+    }
+    partCount_ = static_cast<int>((fileSize_ + partSize_ - 1) / partSize_);
+    return true;
+}
+
+void QS3MultipartUpload::removeJournal()
+{
+    delete journal_;
+    journal_ = 0;
+    QFile::remove(journalFileName_);
+}
+
+bool QS3MultipartUpload::fileMatchesJournal() const
+{
+    QFileInfo info(fileName_);
+    return info.isFile() && info.size() == fileSize_ && info.lastModified().toTime_t() == fileModified_;
+}
+
+void QS3MultipartUpload::fail(const QString &message, const QS3Error &error)
+{
+    if (finished_)
+        return;
+
+    if (client_)
+    {
+        foreach(QS3RequestId id, ongoing_.keys())
+            client_->cancel(id);
+    }
+    ongoing_.clear();
+
+    error_ = error;
+    error_.error = message + (error.error.isEmpty() ? "" : " " + error.error);
+    qDebug() << "QS3MultipartUpload: Error:" << error_.error << journalFileName_;
+    finish();
+}
+
+void QS3MultipartUpload::finish()
+{
+    if (finished_)
+        return;
+    finished_ = true;
+
+    delete file_;
+    file_ = 0;
+    delete journal_;
+    journal_ = 0;
+    emit finished(this);
+}
@@ -0,0 +1,32 @@
+
+#include "QS3NetworkTransport.h"
+
+#include <QNetworkAccessManager>
+#include <QNetworkRequest>
+#include <QNetworkReply>
+
+QS3NetworkTransport::QS3NetworkTransport(QObject *parent) :
+    QS3Transport(parent),
+    network_(new QNetworkAccessManager(this))
+{
+    connect(network_, SIGNAL(finished(QNetworkReply*)), this, SIGNAL(finished(QNetworkReply*)));
+}
+
+QS3NetworkTransport::~QS3NetworkTransport()
+{
+}
+
+QNetworkReply *QS3NetworkTransport::send(const QByteArray &verb, const QNetworkRequest &request, const QByteArray &body, QIODevice *device)
+{
+    if (verb == "GET")
+        return network_->get(request);
+    else if (verb == "PUT")
+        return (device ? network_->put(request, device) : network_->put(request, body));
+    else if (verb == "POST")
+        return (device ? network_->post(request, device) : network_->post(request, body));
+    else if (verb == "DELETE")
+        return network_->deleteResource(request);
+    else if (verb == "HEAD")
+        return network_->head(request);
+    return 0;
+}
@@ -0,0 +1,23 @@
+
+#pragma once
+
+#include "QS3Transport.h"
+
+class QNetworkAccessManager;
+
+/// QS3NetworkTransport
+
+/** QS3Config::QtNetworkTransport, sends requests with QNetworkAccessManager. */
+class QS3NetworkTransport : public QS3Transport
+{
+Q_OBJECT
+
+public:
+    QS3NetworkTransport(QObject *parent = 0);
+    ~QS3NetworkTransport();
+
+    QNetworkReply *send(const QByteArray &verb, const QNetworkRequest &request, const QByteArray &body, QIODevice *device);
+
+private:
+    QNetworkAccessManager *network_;
+};
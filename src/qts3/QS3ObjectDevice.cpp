@@ -0,0 +1,368 @@
+
+#include "QS3ObjectDevice.h"
+#include "QS3Client.h"
+
+#include <QEventLoop>
+#include <QTimer>
+#include <QDebug>
+
+namespace
+{
+    static const qint64 DEFAULT_BLOCK_SIZE = 256 * 1024;
+    static const qint64 DEFAULT_CACHE_SIZE = 16 * 1024 * 1024;
+    static const int DEFAULT_MAX_READ_AHEAD = 16;
+    static const int MAX_BLOCKS_PER_REQUEST = 64;
+}
+
+QS3ObjectDevice::QS3ObjectDevice(QS3Client *client, const QString &key, qint64 size, QObject *parent) :
+    QIODevice(parent),
+    client_(client),
+    key_(key),
+    size_(size),
+    blockSize_(DEFAULT_BLOCK_SIZE),
+    maxReadAhead_(DEFAULT_MAX_READ_AHEAD),
+    readAhead_(0),
+    lastReadEnd_(-1),
+    fetchFailed_(false),
+    cache_(DEFAULT_CACHE_SIZE),
+    waitLoop_(0)
+{
+}
+
+QS3ObjectDevice::~QS3ObjectDevice()
+{
+    close();
+}
+
+QString QS3ObjectDevice::key() const
+{
+    return key_;
+}
+
+void QS3ObjectDevice::setBlockSize(qint64 blockSize)
+{
+    if (isOpen())
+    {
+        qDebug() << "QS3ObjectDevice::setBlockSize() Error: Cannot change block size while the device is open.";
+        return;
+    }
+    if (blockSize > 0)
+        blockSize_ = blockSize;
+}
+
+qint64 QS3ObjectDevice::blockSize() const
+{
+    return blockSize_;
+}
+
+void QS3ObjectDevice::setCacheSize(qint64 cacheSize)
+{
+    cache_.setMaxCost(static_cast<int>(qBound<qint64>(blockSize_, cacheSize, 0x7FFFFFFF)));
+}
+
+qint64 QS3ObjectDevice::cacheSize() const
+{
+    return cache_.maxCost();
+}
+
+void QS3ObjectDevice::setMaxReadAhead(int blocks)
+{
+    maxReadAhead_ = qMax(0, blocks);
+}
+
+int QS3ObjectDevice::maxReadAhead() const
+{
+    return maxReadAhead_;
+}
+
+bool QS3ObjectDevice::isSizeKnown() const
+{
+    return size_ >= 0;
+}
+
+bool QS3ObjectDevice::waitForSize(int msecs)
+{
+    if (!isOpen())
+        return false;
+    if (size_ < 0 && pendingRequests_.isEmpty())
+        fetch(0, 1);
+    while (size_ < 0 && !pendingRequests_.isEmpty())
+    {
+        if (!waitForResult(msecs))
+            break;
+    }
+    return size_ >= 0;
+}
+
+bool QS3ObjectDevice::open(OpenMode mode)
+{
+    if ((mode & WriteOnly) || (mode & Append))
+    {
+        qDebug() << "QS3ObjectDevice::open() Error: Device is read only.";
+        return false;
+    }
+    if (!client_)
+    {
+        qDebug() << "QS3ObjectDevice::open() Error: QS3Client is null.";
+        return false;
+    }
+
+    // No QIODevice buffering, the block cache serves the same purpose.
+    if (!QIODevice::open(mode | Unbuffered))
+        return false;
+
+    readAhead_ = 0;
+    lastReadEnd_ = -1;
+    fetchFailed_ = false;
+
+    // The first block tells the object size.
+    fetchAt(0);
+    return true;
+}
+
+void QS3ObjectDevice::close()
+{
+    if (client_)
+    {
+        foreach(QS3RequestId id, pendingRequests_.keys())
+            client_->cancel(id);
+    }
+    pendingRequests_.clear();
+    pendingBlocks_.clear();
+    cache_.clear();
+    if (waitLoop_)
+        waitLoop_->quit();
+
+    if (isOpen())
+        QIODevice::close();
+}
+
+bool QS3ObjectDevice::isSequential() const
+{
+    return false;
+}
+
+qint64 QS3ObjectDevice::size() const
+{
+    return size_ >= 0 ? size_ : 0;
+}
+
+bool QS3ObjectDevice::seek(qint64 pos)
+{
+    if (pos < 0 || (size_ >= 0 && pos > size_))
+        return false;
+    if (!QIODevice::seek(pos))
+        return false;
+
+    // Random access, reset read ahead and start fetching the new position.
+    if (pos != lastReadEnd_)
+        readAhead_ = 0;
+    if (isOpen())
+        fetchAt(pos);
+    return true;
+}
+
+bool QS3ObjectDevice::atEnd() const
+{
+    return size_ >= 0 && pos() >= size_;
+}
+
+qint64 QS3ObjectDevice::bytesAvailable() const
+{
+    return cachedBytesAt(pos()) + QIODevice::bytesAvailable();
+}
+
+bool QS3ObjectDevice::waitForReadyRead(int msecs)
+{
+    if (!isOpen() || atEnd())
+        return false;
+    if (cachedBytesAt(pos()) > 0)
+        return true;
+
+    fetchFailed_ = false;
+    while (cachedBytesAt(pos()) == 0)
+    {
+        fetchAt(pos());
+        if (fetchFailed_ || atEnd())
+            return false;
+        if (!waitForResult(msecs))
+            return false;
+    }
+    return true;
+}
+
+bool QS3ObjectDevice::waitForResult(int msecs)
+{
+    if (pendingRequests_.isEmpty() || waitLoop_)
+        return false;
+
+    QEventLoop loop;
+    QTimer timer;
+    timer.setSingleShot(true);
+    connect(&timer, SIGNAL(timeout()), &loop, SLOT(quit()));
+    timer.start(msecs);
+
+    waitLoop_ = &loop;
+    loop.exec(QEventLoop::ExcludeUserInputEvents);
+    waitLoop_ = 0;
+
+    return timer.isActive();
+}
+
+qint64 QS3ObjectDevice::cachedBytesAt(qint64 pos) const
+{
+    qint64 available = 0;
+    qint64 block = pos / blockSize_;
+    qint64 offset = pos % blockSize_;
+    while (true)
+    {
+        QByteArray *data = cache_.object(block);
+        if (!data || data->size() <= offset)
+            break;
+        available += data->size() - offset;
+        if (data->size() < blockSize_)
+            break;
+        offset = 0;
+        ++block;
+    }
+    return available;
+}
+
+qint64 QS3ObjectDevice::readData(char *data, qint64 maxSize)
+{
+    const qint64 start = pos();
+    if (size_ >= 0 && start >= size_)
+        return 0;
+
+    // Sequential access detection, grows read ahead exponentially.
+    if (start == lastReadEnd_)
+        readAhead_ = qMin(maxReadAhead_, readAhead_ > 0 ? readAhead_ * 2 : 1);
+    else
+        readAhead_ = 0;
+
+    qint64 read = 0;
+    while (read < maxSize)
+    {
+        const qint64 position = start + read;
+        const qint64 block = position / blockSize_;
+        const qint64 offset = position % blockSize_;
+        QByteArray *cached = cache_.object(block);
+        if (!cached || cached->size() <= offset)
+            break;
+
+        const qint64 count = qMin<qint64>(cached->size() - offset, maxSize - read);
+        memcpy(data + read, cached->constData() + offset, count);
+        read += count;
+        if (cached->size() < blockSize_)
+            break;
+    }
+
+    if (read > 0)
+        lastReadEnd_ = start + read;
+    fetchAt(start + read);
+    return read;
+}
+
+qint64 QS3ObjectDevice::writeData(const char * /*data*/, qint64 /*maxSize*/)
+{
+    return -1;
+}
+
+void QS3ObjectDevice::fetchAt(qint64 pos)
+{
+    if (size_ >= 0 && pos >= size_)
+        return;
+    fetch(pos / blockSize_, 1 + readAhead_);
+}
+
+void QS3ObjectDevice::fetch(qint64 first, int count)
+{
+    if (!client_ || !isOpen())
+        return;
+
+    qint64 end = first + count;
+    if (size_ >= 0)
+        end = qMin(end, (size_ + blockSize_ - 1) / blockSize_);
+
+    qint64 block = first;
+    while (block < end)
+    {
+        if (cache_.contains(block) || pendingBlocks_.contains(block))
+        {
+            ++block;
+            continue;
+        }
+
+        // Request a run of adjacent missing blocks with a single range.
+        const qint64 runStart = block;
+        int runLength = 0;
+        while (block < end && runLength < MAX_BLOCKS_PER_REQUEST && !cache_.contains(block) && !pendingBlocks_.contains(block))
+        {
+            pendingBlocks_.insert(block);
+            ++runLength;
+            ++block;
+        }
+
+        QS3RequestId id = client_->get(key_, runStart * blockSize_, runLength * blockSize_, this, static_cast<quint64>(runStart));
+        if (id != 0)
+            pendingRequests_[id] = qMakePair(runStart, runLength);
+        else
+        {
+            for (qint64 b = runStart; b < runStart + runLength; ++b)
+                pendingBlocks_.remove(b);
+            return;
+        }
+    }
+}
+
+void QS3ObjectDevice::handleResult(const QS3Result &result)
+{
+    if (!pendingRequests_.contains(result.id))
+        return;
+
+    QPair<qint64, int> range = pendingRequests_.take(result.id);
+    for (qint64 block = range.first; block < range.first + range.second; ++block)
+        pendingBlocks_.remove(block);
+
+    if (!result.succeeded)
+    {
+        // Range starting at or past the end of the object.
+        if (result.httpStatusCode == 416 && size_ < 0)
+            size_ = range.first * blockSize_;
+        else
+        {
+            fetchFailed_ = true;
+            setErrorString(result.error.toString());
+        }
+    }
+    else
+    {
+        if (result.totalSize >= 0)
+            size_ = result.totalSize;
+
+        // Blocks are cached from where the data really starts, a server that ignores
+        // Range answers 200 with the object from offset 0.
+        const qint64 start = range.first * blockSize_;
+        if (result.dataOffset < 0 || result.dataOffset > start)
+        {
+            fetchFailed_ = true;
+            setErrorString("Response range does not start at requested offset " + QString::number(start));
+        }
+        else
+        {
+            for (int i=0; i<range.second; ++i)
+            {
+                const qint64 offset = start - result.dataOffset + i * blockSize_;
+                if (offset >= result.data.size())
+                    break;
+                QByteArray *block = new QByteArray(result.data.mid(offset, blockSize_));
+                cache_.insert(range.first + i, block, block->size());
+            }
+        }
+    }
+
+    if (waitLoop_)
+        waitLoop_->quit();
+    if (result.succeeded)
+        emit readyRead();
+}
@@ -0,0 +1,408 @@
+
+#include "QS3Pack.h"
+#include "QS3Client.h"
+#include "QS3Crypto.h"
+
+#include <QFile>
+#include <QDataStream>
+#include <QTimer>
+#include <QDebug>
+#include <QtAlgorithms>
+
+namespace
+{
+    static const QByteArray PACK_MAGIC = "QS3PACK1";
+    static const int HEADER_SIZE = 12;
+
+    /// Bytes read when opening a pack, enough for the index of a few hundred members.
+    static const int HEAD_READ_SIZE = 64 * 1024;
+
+    static bool OffsetLessThan(const QS3PackMember &a, const QS3PackMember &b)
+    {
+        return a.offset < b.offset;
+    }
+
+    static QByteArray serializeIndex(const QList<QS3PackMember> &members)
+    {
+        QByteArray index;
+        QDataStream stream(&index, QIODevice::WriteOnly);
+        stream.setVersion(QDataStream::Qt_4_6);
+        stream << (quint32)members.size();
+        foreach(const QS3PackMember &member, members)
+        {
+            stream << member.name.toUtf8() << (quint64)member.offset << (quint32)member.length;
+            stream.writeRawData(member.sha256.constData(), QS3Sha256::DigestSize);
+        }
+        return index;
+    }
+
+    /// Parses an index whose member offsets are relative to dataOffset.
+    static bool parseIndex(const QByteArray &index, qint64 dataOffset, QHash<QString, QS3PackMember> &members)
+    {
+        QDataStream stream(index);
+        stream.setVersion(QDataStream::Qt_4_6);
+        quint32 count = 0;
+        stream >> count;
+        for (quint32 i=0; i<count && stream.status() == QDataStream::Ok; ++i)
+        {
+            QByteArray name;
+            quint64 offset = 0;
+            quint32 length = 0;
+            QS3PackMember member;
+            member.sha256.resize(QS3Sha256::DigestSize);
+            stream >> name >> offset >> length;
+            if (stream.readRawData(member.sha256.data(), QS3Sha256::DigestSize) != QS3Sha256::DigestSize)
+                return false;
+            member.name = QString::fromUtf8(name);
+            member.offset = dataOffset + (qint64)offset;
+            member.length = length;
+            members.insert(member.name, member);
+        }
+        return stream.status() == QDataStream::Ok;
+    }
+}
+
+// QS3PackMember
+
+QS3PackMember::QS3PackMember() :
+    offset(0),
+    length(0)
+{
+}
+
+// QS3PackWriter
+
+QS3PackWriter::QS3PackWriter()
+{
+}
+
+bool QS3PackWriter::add(const QString &name, const QByteArray &data)
+{
+    if (name.isEmpty() || names_.contains(name))
+    {
+        qDebug() << "QS3PackWriter::add() Error: Member name is empty or already in the pack:" << name;
+        return false;
+    }
+
+    QS3PackMember member;
+    member.name = name;
+    member.offset = data_.size();
+    member.length = data.size();
+    member.sha256 = QS3Sha256::hash(data);
+    members_ << member;
+    names_.insert(name);
+    data_.append(data);
+    return true;
+}
+
+bool QS3PackWriter::addFile(const QString &name, const QString &fileName)
+{
+    QFile file(fileName);
+    if (!file.open(QIODevice::ReadOnly))
+    {
+        qDebug() << "QS3PackWriter::addFile() Error: Could not open" << fileName << ":" << file.errorString();
+        return false;
+    }
+    return add(name, file.readAll());
+}
+
+int QS3PackWriter::count() const
+{
+    return members_.size();
+}
+
+QList<QS3PackMember> QS3PackWriter::members() const
+{
+    // Offsets are stored relative to the data, the index size is only known here.
+    const qint64 dataOffset = HEADER_SIZE + serializeIndex(members_).size();
+    QList<QS3PackMember> members = members_;
+    for (int i=0; i<members.size(); ++i)
+        members[i].offset += dataOffset;
+    return members;
+}
+
+QByteArray QS3PackWriter::pack() const
+{
+    const QByteArray index = serializeIndex(members_);
+
+    QByteArray pack;
+    pack.reserve(HEADER_SIZE + index.size() + data_.size());
+    pack += PACK_MAGIC;
+    QDataStream stream(&pack, QIODevice::WriteOnly | QIODevice::Append);
+    stream << (quint32)index.size();
+    pack += index;
+    pack += data_;
+    return pack;
+}
+
+void QS3PackWriter::clear()
+{
+    members_.clear();
+    names_.clear();
+    data_.clear();
+}
+
+// QS3PackReader
+
+QS3PackReader::QS3PackReader(QS3Client *client, const QString &key) :
+    QObject(client),
+    client_(client),
+    key_(key),
+    maxGap_(16 * 1024),
+    maxRangeSize_(8 * 1024 * 1024),
+    headRequest_(0),
+    open_(false),
+    openFailed_(false),
+    flushScheduled_(false),
+    rangeRequests_(0)
+{
+    QTimer::singleShot(0, this, SLOT(start()));
+}
+
+QS3PackReader::~QS3PackReader()
+{
+    if (client_)
+    {
+        if (headRequest_)
+            client_->cancel(headRequest_);
+        foreach(QS3RequestId id, ongoing_.keys())
+            client_->cancel(id);
+    }
+}
+
+void QS3PackReader::setMaxGap(int maxGap)
+{
+    maxGap_ = qMax(0, maxGap);
+}
+
+void QS3PackReader::setMaxRangeSize(int maxRangeSize)
+{
+    maxRangeSize_ = qMax(1, maxRangeSize);
+}
+
+QString QS3PackReader::key() const
+{
+    return key_;
+}
+
+bool QS3PackReader::isOpen() const
+{
+    return open_;
+}
+
+QStringList QS3PackReader::members() const
+{
+    return index_.keys();
+}
+
+bool QS3PackReader::contains(const QString &name) const
+{
+    return index_.contains(name);
+}
+
+QS3PackMember QS3PackReader::member(const QString &name) const
+{
+    return index_.value(name);
+}
+
+int QS3PackReader::rangeRequests() const
+{
+    return rangeRequests_;
+}
+
+void QS3PackReader::start()
+{
+    if (open_ || openFailed_ || headRequest_)
+        return;
+    headRequest_ = (client_ ? client_->get(key_, 0, HEAD_READ_SIZE, this, HeadRequest) : 0);
+    if (!headRequest_)
+        failOpen(client_ ? "Invalid pack key " + key_ : "QS3Client was destroyed before the pack was opened.");
+}
+
+void QS3PackReader::get(const QString &name)
+{
+    get(QStringList() << name);
+}
+
+void QS3PackReader::get(const QStringList &names)
+{
+    requested_ << names;
+    if (!flushScheduled_ && (open_ || openFailed_))
+    {
+        flushScheduled_ = true;
+        QTimer::singleShot(0, this, SLOT(flush()));
+    }
+}
+
+void QS3PackReader::handleResult(const QS3Result &result)
+{
+    if (result.tag == HeadRequest && result.id == headRequest_)
+    {
+        headRequest_ = 0;
+        onHead(result);
+    }
+    else if (ongoing_.contains(result.id))
+        onRange(result);
+}
+
+void QS3PackReader::onHead(const QS3Result &result)
+{
+    if (!result.succeeded)
+    {
+        failOpen("Could not read pack " + key_ + ": " + result.error.toString());
+        return;
+    }
+    if (!eTag_.isEmpty() && !result.eTag.isEmpty() && result.eTag != eTag_)
+    {
+        failOpen("Pack " + key_ + " changed while it was opened.");
+        return;
+    }
+    eTag_ = result.eTag;
+    head_.append(result.data);
+
+    if (head_.size() < HEADER_SIZE || !head_.startsWith(PACK_MAGIC))
+    {
+        failOpen(key_ + " is not a pack.");
+        return;
+    }
+    quint32 indexSize = 0;
+    QDataStream stream(head_.mid(PACK_MAGIC.size(), 4));
+    stream >> indexSize;
+    const qint64 dataOffset = HEADER_SIZE + (qint64)indexSize;
+
+    // Large indexes need a second read for the rest.
+    if (head_.size() < dataOffset)
+    {
+        if (result.data.isEmpty() || !client_)
+        {
+            failOpen("Pack " + key_ + " is truncated.");
+            return;
+        }
+        headRequest_ = client_->get(key_, head_.size(), dataOffset - head_.size(), this, HeadRequest);
+        if (!headRequest_)
+            failOpen("Could not read pack " + key_);
+        return;
+    }
+
+    if (!parseIndex(head_.mid(HEADER_SIZE, indexSize), dataOffset, index_))
+    {
+        index_.clear();
+        failOpen("Invalid index in pack " + key_);
+        return;
+    }
+    open_ = true;
+    emit opened(this);
+    flush();
+}
+
+void QS3PackReader::failOpen(const QString &message)
+{
+    openFailed_ = true;
+    openError_ = message;
+    head_.clear();
+    emit failed(this, QString(), message);
+    flush();
+}
+
+void QS3PackReader::flush()
+{
+    flushScheduled_ = false;
+    if (!open_ && !openFailed_)
+        return;
+
+    QStringList names = requested_;
+    requested_.clear();
+
+    // Unknown members fail, members already read with the index are delivered directly.
+    QList<QS3PackMember> pending;
+    foreach(const QString &name, names)
+    {
+        if (openFailed_)
+            emit failed(this, name, openError_);
+        else if (!index_.contains(name))
+            emit failed(this, name, "No member " + name + " in pack " + key_);
+        else
+        {
+            const QS3PackMember &member = index_[name];
+            if (member.length == 0)
+                deliver(member, QByteArray(), member.offset);
+            else if (member.offset + member.length <= head_.size())
+                deliver(member, head_, 0);
+            else
+                pending << member;
+        }
+    }
+    if (pending.isEmpty())
+        return;
+
+    // Neighbouring members share a get while the gap and the range stay small.
+    qStableSort(pending.begin(), pending.end(), OffsetLessThan);
+    QList<Range> ranges;
+    foreach(const QS3PackMember &member, pending)
+    {
+        if (!ranges.isEmpty())
+        {
+            Range &last = ranges.last();
+            const qint64 end = last.offset + last.length;
+            const qint64 newEnd = qMax(end, member.offset + member.length);
+            if (member.offset - end <= maxGap_ && newEnd - last.offset <= maxRangeSize_)
+            {
+                last.length = newEnd - last.offset;
+                last.members << member;
+                continue;
+            }
+        }
+        Range range;
+        range.offset = member.offset;
+        range.length = member.length;
+        range.members << member;
+        ranges << range;
+    }
+
+    foreach(const Range &range, ranges)
+    {
+        QS3RequestId id = (client_ ? client_->get(key_, range.offset, range.length, this, RangeRequest) : 0);
+        if (!id)
+        {
+            foreach(const QS3PackMember &member, range.members)
+                emit failed(this, member.name, "Could not request member " + member.name + " of pack " + key_);
+            continue;
+        }
+        ongoing_[id] = range;
+        rangeRequests_++;
+    }
+}
+
+void QS3PackReader::onRange(const QS3Result &result)
+{
+    const Range range = ongoing_.take(result.id);
+
+    QString error;
+    if (!result.succeeded)
+        error = result.error.toString();
+    else if (!eTag_.isEmpty() && !result.eTag.isEmpty() && result.eTag != eTag_)
+        error = "Pack " + key_ + " has changed since it was opened.";
+    else if (result.data.size() != range.length)
+        error = QString("Expected %1 bytes from pack %2, received %3.").arg(range.length).arg(key_).arg(result.data.size());
+
+    foreach(const QS3PackMember &member, range.members)
+    {
+        if (error.isEmpty())
+            deliver(member, result.data, range.offset);
+        else
+            emit failed(this, member.name, error);
+    }
+}
+
+void QS3PackReader::deliver(const QS3PackMember &member, const QByteArray &data, qint64 dataOffset)
+{
+    const int start = (int)(member.offset - dataOffset);
+    QS3Sha256 hash;
+    hash.addData(data.constData() + start, (int)member.length);
+    if (hash.result() != member.sha256)
+    {
+        emit failed(this, member.name, "Hash mismatch for member " + member.name + " of pack " + key_);
+        return;
+    }
+    emit received(this, member.name, data.mid(start, (int)member.length));
+}
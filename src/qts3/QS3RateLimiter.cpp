@@ -0,0 +1,176 @@
+
+#include "QS3RateLimiter.h"
+
+#include <QTimer>
+
+#include <string.h>
+#include <limits>
+
+namespace
+{
+    static const qint64 MIN_BURST_BYTES = 16 * 1024;
+    static const int MAX_WAIT_MSECS = 1000;
+}
+
+// QS3RateLimiter
+
+QS3RateLimiter::QS3RateLimiter(qint64 bytesPerSecond) :
+    rate_(0),
+    burst_(0),
+    tokens_(0),
+    lastRefill_(0)
+{
+    clock_.start();
+    setRate(bytesPerSecond);
+}
+
+void QS3RateLimiter::setRate(qint64 bytesPerSecond)
+{
+    refill();
+    const bool wasLimited = isLimited();
+    rate_ = qMax<qint64>(0, bytesPerSecond);
+    burst_ = qMax(MIN_BURST_BYTES, rate_ / 10);
+    tokens_ = (wasLimited ? qMin(tokens_, burst_) : burst_);
+    lastRefill_ = clock_.elapsed();
+}
+
+qint64 QS3RateLimiter::rate() const
+{
+    return rate_;
+}
+
+bool QS3RateLimiter::isLimited() const
+{
+    return rate_ > 0;
+}
+
+void QS3RateLimiter::refill()
+{
+    if (!isLimited())
+        return;
+
+    const qint64 now = clock_.elapsed();
+    const qint64 elapsed = now - lastRefill_;
+    if (elapsed <= 0)
+        return;
+
+    const qint64 refilled = elapsed * rate_ / 1000;
+    if (refilled <= 0)
+        return;
+
+    // Advance only by the time that produced whole tokens so slow rates do not lose them.
+    tokens_ = qMin(burst_, tokens_ + refilled);
+    lastRefill_ = (tokens_ == burst_ ? now : lastRefill_ + refilled * 1000 / rate_);
+}
+
+qint64 QS3RateLimiter::available()
+{
+    if (!isLimited())
+        return std::numeric_limits<qint64>::max();
+    refill();
+    return qMax<qint64>(0, tokens_);
+}
+
+void QS3RateLimiter::consume(qint64 bytes)
+{
+    if (!isLimited())
+        return;
+    refill();
+    tokens_ -= bytes;
+}
+
+int QS3RateLimiter::msecsUntilAvailable(qint64 bytes)
+{
+    if (!isLimited())
+        return 0;
+    refill();
+    const qint64 needed = qMin(bytes, burst_) - tokens_;
+    if (needed <= 0)
+        return 0;
+    return static_cast<int>(qMin<qint64>(MAX_WAIT_MSECS, (needed * 1000 + rate_ - 1) / rate_));
+}
+
+qint64 QS3RateLimiter::available(const QList<QS3RateLimiter*> &limiters)
+{
+    qint64 bytes = std::numeric_limits<qint64>::max();
+    foreach(QS3RateLimiter *limiter, limiters)
+        bytes = qMin(bytes, limiter->available());
+    return bytes;
+}
+
+void QS3RateLimiter::consume(const QList<QS3RateLimiter*> &limiters, qint64 bytes)
+{
+    foreach(QS3RateLimiter *limiter, limiters)
+        limiter->consume(bytes);
+}
+
+int QS3RateLimiter::msecsUntilAvailable(const QList<QS3RateLimiter*> &limiters, qint64 bytes)
+{
+    int msecs = 0;
+    foreach(QS3RateLimiter *limiter, limiters)
+        msecs = qMax(msecs, limiter->msecsUntilAvailable(bytes));
+    return msecs;
+}
+
+// QS3ThrottledDevice
+
+QS3ThrottledDevice::QS3ThrottledDevice(const QByteArray &data, const QList<QS3RateLimiter*> &limiters, QObject *parent) :
+    QIODevice(parent),
+    data_(data),
+    limiters_(limiters),
+    refillTimer_(new QTimer(this))
+{
+    refillTimer_->setSingleShot(true);
+    connect(refillTimer_, SIGNAL(timeout()), SLOT(onRefill()));
+    open(QIODevice::ReadOnly | QIODevice::Unbuffered);
+}
+
+bool QS3ThrottledDevice::isSequential() const
+{
+    return false;
+}
+
+qint64 QS3ThrottledDevice::size() const
+{
+    return data_.size();
+}
+
+bool QS3ThrottledDevice::atEnd() const
+{
+    return pos() >= data_.size();
+}
+
+qint64 QS3ThrottledDevice::bytesAvailable() const
+{
+    return (data_.size() - pos()) + QIODevice::bytesAvailable();
+}
+
+qint64 QS3ThrottledDevice::readData(char *data, qint64 maxSize)
+{
+    const qint64 remaining = data_.size() - pos();
+    if (remaining <= 0)
+        return 0;
+
+    qint64 count = qMin(qMin(maxSize, remaining), QS3RateLimiter::available(limiters_));
+    if (count <= 0)
+    {
+        // Out of tokens, tell the reader to come back when there are some.
+        if (!refillTimer_->isActive())
+            refillTimer_->start(qMax(1, QS3RateLimiter::msecsUntilAvailable(limiters_, qMin<qint64>(maxSize, remaining))));
+        return 0;
+    }
+
+    memcpy(data, data_.constData() + pos(), count);
+    QS3RateLimiter::consume(limiters_, count);
+    return count;
+}
+
+qint64 QS3ThrottledDevice::writeData(const char * /*data*/, qint64 /*maxSize*/)
+{
+    return -1;
+}
+
+void QS3ThrottledDevice::onRefill()
+{
+    emit readyRead();
+}
@@ -0,0 +1,84 @@
+
+#pragma once
+
+#include <QObject>
+#include <QIODevice>
+#include <QByteArray>
+#include <QList>
+#include <QElapsedTimer>
+
+QT_BEGIN_NAMESPACE
+class QTimer;
+QT_END_NAMESPACE
+
+/// QS3RateLimiter
+
+/** Token bucket for limiting transfer bandwidth. Tokens are bytes that
+    refill at the configured rate up to a burst of roughly 100 ms worth.
+    Consuming more than is available puts the bucket in debt, which
+    delays later transfers instead of dropping data. A rate of 0 means
+    no limit. */
+class QS3RateLimiter
+{
+public:
+    explicit QS3RateLimiter(qint64 bytesPerSecond = 0);
+
+    void setRate(qint64 bytesPerSecond);
+    qint64 rate() const;
+    bool isLimited() const;
+
+    /// Returns bytes that can be transferred now.
+    qint64 available();
+
+    /// Consumes bytes. The bucket may go negative.
+    void consume(qint64 bytes);
+
+    /// Returns milliseconds until at least bytes are available.
+    int msecsUntilAvailable(qint64 bytes);
+
+    /// Helpers for a set of limiters that all must allow the transfer.
+    /// Without limits available returns the largest qint64.
+    static qint64 available(const QList<QS3RateLimiter*> &limiters);
+    static void consume(const QList<QS3RateLimiter*> &limiters, qint64 bytes);
+    static int msecsUntilAvailable(const QList<QS3RateLimiter*> &limiters, qint64 bytes);
+
+private:
+    void refill();
+
+    qint64 rate_;
+    qint64 burst_;
+    qint64 tokens_;
+    qint64 lastRefill_;
+    QElapsedTimer clock_;
+};
+
+/// QS3ThrottledDevice
+
+/** Random access read only device over a byte array that hands out
+    data only as fast as its rate limiters allow. Used as the upload
+    device of throttled requests, QNetworkAccessManager waits for
+    readyRead when a read returns no data. */
+class QS3ThrottledDevice : public QIODevice
+{
+Q_OBJECT
+
+public:
+    QS3ThrottledDevice(const QByteArray &data, const QList<QS3RateLimiter*> &limiters, QObject *parent = 0);
+
+    bool isSequential() const;
+    qint64 size() const;
+    bool atEnd() const;
+    qint64 bytesAvailable() const;
+
+protected:
+    qint64 readData(char *data, qint64 maxSize);
+    qint64 writeData(const char *data, qint64 maxSize);
+
+private slots:
+    void onRefill();
+
+private:
+    QByteArray data_;
+    QList<QS3RateLimiter*> limiters_;
+    QTimer *refillTimer_;
+};
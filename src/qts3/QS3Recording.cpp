@@ -0,0 +1,137 @@
+
+#include "QS3Recording.h"
+
+#include <QFile>
+#include <QUrl>
+#include <QDebug>
+
+namespace
+{
+    static const QByteArray RECORDING_MAGIC = "qts3-recording 1";
+    static const int RECORD_FIELDS = 10;
+}
+
+QS3RecordedRequest::QS3RecordedRequest() :
+    type(QS3::GetObject),
+    rangeOffset(0),
+    rangeLength(-1),
+    bytesSent(0),
+    bytesReceived(0),
+    httpStatusCode(0),
+    scheduled(0),
+    duration(0),
+    inflight(0)
+{
+}
+
+QS3Recording::QS3Recording() :
+    file_(0)
+{
+}
+
+QS3Recording::~QS3Recording()
+{
+    close();
+}
+
+bool QS3Recording::open(const QString &fileName)
+{
+    close();
+
+    file_ = new QFile(fileName);
+    if (!file_->open(QIODevice::WriteOnly | QIODevice::Truncate) || file_->write(RECORDING_MAGIC + "\n") < 0)
+    {
+        qDebug() << "QS3Recording: Error: Could not open" << fileName << "for writing:" << file_->errorString();
+        delete file_;
+        file_ = 0;
+        return false;
+    }
+    return true;
+}
+
+bool QS3Recording::isOpen() const
+{
+    return (file_ != 0);
+}
+
+void QS3Recording::write(const QS3RecordedRequest &request)
+{
+    if (!file_)
+        return;
+
+    // scheduled duration type status inflight sent received offset length key
+    QByteArray line;
+    line.reserve(96 + request.key.size());
+    line += QByteArray::number(request.scheduled) + ' ';
+    line += QByteArray::number(request.duration) + ' ';
+    line += QByteArray::number((int)request.type) + ' ';
+    line += QByteArray::number(request.httpStatusCode) + ' ';
+    line += QByteArray::number(request.inflight) + ' ';
+    line += QByteArray::number(request.bytesSent) + ' ';
+    line += QByteArray::number(request.bytesReceived) + ' ';
+    line += QByteArray::number(request.rangeOffset) + ' ';
+    line += QByteArray::number(request.rangeLength) + ' ';
+    line += QUrl::toPercentEncoding(request.key, "/");
+    line += '\n';
+    file_->write(line);
+}
+
+void QS3Recording::close()
+{
+    if (!file_)
+        return;
+    file_->close();
+    delete file_;
+    file_ = 0;
+}
+
+bool QS3Recording::read(const QString &fileName, QList<QS3RecordedRequest> &requests, QString &errorMessage)
+{
+    QFile file(fileName);
+    if (!file.open(QIODevice::ReadOnly))
+    {
+        errorMessage = "Could not open " + fileName + ": " + file.errorString();
+        return false;
+    }
+    if (file.readLine().trimmed() != RECORDING_MAGIC)
+    {
+        errorMessage = "Invalid recording " + fileName;
+        return false;
+    }
+
+    int lineNumber = 1;
+    while (!file.atEnd())
+    {
+        lineNumber++;
+        const QByteArray line = file.readLine().trimmed();
+        if (line.isEmpty())
+            continue;
+
+        // The key may be empty, the root of a listing.
+        QList<QByteArray> fields = line.split(' ');
+        if (fields.size() == RECORD_FIELDS - 1)
+            fields << QByteArray();
+        bool ok = (fields.size() == RECORD_FIELDS);
+        QS3RecordedRequest request;
+        if (ok) request.scheduled = fields[0].toLongLong(&ok);
+        if (ok) request.duration = fields[1].toLongLong(&ok);
+        int type = 0;
+        if (ok) type = fields[2].toInt(&ok);
+        if (ok) ok = (type >= QS3::ListObjects && type <= QS3::AbortMultipartUpload);
+        if (ok) request.type = static_cast<QS3::RequestType>(type);
+        if (ok) request.httpStatusCode = fields[3].toInt(&ok);
+        if (ok) request.inflight = fields[4].toInt(&ok);
+        if (ok) request.bytesSent = fields[5].toLongLong(&ok);
+        if (ok) request.bytesReceived = fields[6].toLongLong(&ok);
+        if (ok) request.rangeOffset = fields[7].toLongLong(&ok);
+        if (ok) request.rangeLength = fields[8].toLongLong(&ok);
+        if (!ok)
+        {
+            errorMessage = QString("Invalid request on line %1 of %2").arg(lineNumber).arg(fileName);
+            return false;
+        }
+        request.key = QUrl::fromPercentEncoding(fields[9]);
+        requests << request;
+    }
+    return true;
+}
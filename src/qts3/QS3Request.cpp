@@ -0,0 +1,66 @@
+
+#include "QS3Request.h"
+
+#include <QFile>
+#include <QIODevice>
+
+QS3Request::QS3Request(QS3::RequestType type_, const QString &key_, const QString &verb_, const QNetworkRequest &request_) :
+    id(0),
+    type(type_),
+    key(key_),
+    verb(verb_),
+    request(request_),
+    uploadDevice(0),
+    mapping(0),
+    response(0),
+    handler(0),
+    tag(0),
+    priority(QS3::NormalPriority),
+    receivedSize(0),
+    headersMsecs(-1),
+    timeout(0),
+    stallTimeout(0),
+    deadline(-1),
+    lastActivity(0),
+    abortRetryable(false),
+    rangeOffset(0),
+    rangeLength(-1),
+    resumeAttempts(0),
+    traced(false),
+    traceScheduled(-1),
+    traceDispatched(-1),
+    traceSigned(-1),
+    traceHeaders(-1),
+    inflight(0)
+{
+}
+
+QS3Request::~QS3Request()
+{
+    // The network layer may still touch the device until the reply is deleted.
+    if (uploadDevice)
+        uploadDevice->deleteLater();
+    if (mapping)
+    {
+        // The reply may still read the mapping until it is deleted, it takes the mapping along.
+        body.clear();
+        if (mappingReply)
+            mapping->setParent(mappingReply);
+        else
+            delete mapping;
+    }
+}
+
+QS3FileMapping::QS3FileMapping(QFile *file_, uchar *data_) :
+    file(file_),
+    data(data_)
+{
+}
+
+QS3FileMapping::~QS3FileMapping()
+{
+    if (data)
+        file->unmap(data);
+    file->close();
+    delete file;
+}
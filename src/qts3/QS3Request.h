@@ -0,0 +1,137 @@
+
+#pragma once
+
+#include "QS3Fwd.h"
+#include "QS3Defines.h"
+
+#include <QString>
+#include <QByteArray>
+#include <QNetworkRequest>
+#include <QElapsedTimer>
+#include <QObject>
+#include <QPointer>
+#include <QNetworkReply>
+
+/// QS3FileMapping
+
+/** Memory mapping of a file uploaded with QS3Config::memoryMapUploads,
+    unmapped and closed when destroyed. */
+class QS3FileMapping : public QObject
+{
+public:
+    QS3FileMapping(QFile *file_, uchar *data_);
+    ~QS3FileMapping();
+
+    QFile *file;
+    uchar *data;
+};
+
+/// QS3Request
+
+/** Internal state of a single request issued by QS3Client. The request is
+    delivered either to a QS3Response (signal API) or to a QS3ResultHandler
+    (callback API), never both. */
+class QS3Request
+{
+public:
+    QS3Request(QS3::RequestType type_, const QString &key_, const QString &verb_, const QNetworkRequest &request_);
+    ~QS3Request();
+
+    /// Unique request id within the client.
+    QS3RequestId id;
+
+    /// Type of the request.
+    QS3::RequestType type;
+
+    /// Request Amazon S3 object key.
+    QString key;
+
+    /// HTTP verb.
+    QString verb;
+
+    /// Network request. Signed when sent.
+    QNetworkRequest request;
+
+    /// Upload payload for PUT and POST requests.
+    QByteArray body;
+
+    /// SignatureV4 hash of body, empty until the request is first signed.
+    QByteArray payloadHash;
+
+    /// Throttled upload device reading from body, null if uploads are not throttled.
+    QIODevice *uploadDevice;
+
+    /// Memory mapped file that body points to, null if the body is in memory.
+    /** When the request is destroyed the mapping is handed to mappingReply if it still
+        exists, the reply and uploadDevice may read from it until the reply is deleted. */
+    QS3FileMapping *mapping;
+
+    /// Latest reply sending body from mapping.
+    QPointer<QNetworkReply> mappingReply;
+
+    /// Response object for the signal API.
+    QS3Response *response;
+
+    /// Result handler for the callback API.
+    QS3ResultHandler *handler;
+
+    /// User provided tag for the callback API.
+    quint64 tag;
+
+    /// Bandwidth priority class, see QS3Client::setPriority.
+    QS3::Priority priority;
+
+    /// Response body read so far to a pooled buffer and the number of bytes read. The buffer
+    /// is reserved from Content-Length and may be larger than what has been read.
+    QByteArray received;
+    int receivedSize;
+
+    /// Key prefix holding a concurrency slot, empty if not limited. See QS3Config::adaptiveConcurrency.
+    QString concurrencyPrefix;
+
+    /// Started when the request is sent to the network.
+    QElapsedTimer sentTime;
+
+    /// Milliseconds from sending until the response headers arrived, negative if not yet.
+    qint64 headersMsecs;
+
+    /// Request and stall timeouts in milliseconds, 0 for no limit.
+    int timeout;
+    int stallTimeout;
+
+    /// Client clock time when the request must be finished, negative for no deadline.
+    qint64 deadline;
+
+    /// Client clock time of the last transferred data.
+    qint64 lastActivity;
+
+    /// Error message if the request was aborted by the client, eg. on timeout.
+    QString abortReason;
+
+    /// True if an abort by the client may be resumed, eg. on stall.
+    bool abortRetryable;
+
+    /// Requested byte range of a get, length negative for the rest of the object.
+    qint64 rangeOffset;
+    qint64 rangeLength;
+
+    /// Body received before a resumed get failed, its ETag and the number of resumes.
+    QByteArray resumeData;
+    QByteArray resumeETag;
+    int resumeAttempts;
+
+    /// Identifies identical requests that can share a network request, empty if not coalesced.
+    QByteArray coalesceKey;
+
+    /// True if the request is recorded by QS3Client::startTrace. Trace times are microseconds
+    /// on the client clock when the request was scheduled, sent, signed and got headers, negative if not yet.
+    /// The scheduled time is also set while recording, see QS3Client::startRecording.
+    bool traced;
+    qint64 traceScheduled;
+    qint64 traceDispatched;
+    qint64 traceSigned;
+    qint64 traceHeaders;
+
+    /// Requests in the network when this one was scheduled, set while recording.
+    int inflight;
+};
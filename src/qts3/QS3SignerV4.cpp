@@ -0,0 +1,173 @@
+
+#include "QS3SignerV4.h"
+
+#include <QNetworkRequest>
+#include <QUrl>
+#include <QList>
+#include <QPair>
+#include <QtAlgorithms>
+
+namespace
+{
+    static const QByteArray ALGORITHM = "AWS4-HMAC-SHA256";
+    static const QByteArray TERMINATOR = "aws4_request";
+    static const QByteArray AMAZON_HEADER_PREFIX = "x-amz-";
+
+    typedef QPair<QByteArray, QByteArray> ByteArrayPair;
+}
+
+const QByteArray QS3SignerV4::UnsignedPayload = "UNSIGNED-PAYLOAD";
+
+QS3SignerV4::QS3SignerV4(const QByteArray &accessKey, const QByteArray &secretKey, const QByteArray &region, const QByteArray &service) :
+    accessKey_(accessKey),
+    secretKey_(secretKey),
+    region_(region),
+    service_(service)
+{
+}
+
+QByteArray QS3SignerV4::payloadHash(const QByteArray &data)
+{
+    return QS3Sha256::hash(data).toHex();
+}
+
+QByteArray QS3SignerV4::scope(const QByteArray &date) const
+{
+    return date + '/' + region_ + '/' + service_ + '/' + TERMINATOR;
+}
+
+const QS3HmacSha256 &QS3SignerV4::signingKey(const QByteArray &date)
+{
+    QHash<QByteArray, QS3HmacSha256>::const_iterator iter = keys_.constFind(date);
+    if (iter != keys_.constEnd())
+        return iter.value();
+
+    // Keys of past days are not needed again.
+    if (keys_.size() > 2)
+        keys_.clear();
+
+    QByteArray dateKey = QS3HmacSha256("AWS4" + secretKey_).sign(date);
+    QByteArray regionKey = QS3HmacSha256(dateKey).sign(region_);
+    QByteArray serviceKey = QS3HmacSha256(regionKey).sign(service_);
+    QByteArray signingKey = QS3HmacSha256(serviceKey).sign(TERMINATOR);
+    return keys_.insert(date, QS3HmacSha256(signingKey)).value();
+}
+
+QByteArray QS3SignerV4::signature(const QByteArray &canonicalRequest, const QByteArray &amzDate)
+{
+    const QByteArray date = amzDate.left(8);
+
+    QByteArray stringToSign;
+    stringToSign.reserve(160);
+    stringToSign += ALGORITHM + '\n';
+    stringToSign += amzDate + '\n';
+    stringToSign += scope(date) + '\n';
+    stringToSign += QS3Sha256::hash(canonicalRequest).toHex();
+
+    return signingKey(date).sign(stringToSign).toHex();
+}
+
+void QS3SignerV4::signRequest(QNetworkRequest *request, const QByteArray &httpVerb, const QByteArray &payloadHash, const QDateTime &now)
+{
+    const QByteArray amzDate = now.toUTC().toString("yyyyMMdd'T'hhmmss'Z'").toLatin1();
+    request->setRawHeader("x-amz-date", amzDate);
+    request->setRawHeader("x-amz-content-sha256", payloadHash);
+
+    // Host, Content-Type and amazon headers are signed, lowercased and sorted by name.
+    QList<ByteArrayPair> headers;
+    headers << ByteArrayPair("host", hostHeader(request->url()));
+    foreach(const QByteArray &header, request->rawHeaderList())
+    {
+        QByteArray name = header.toLower();
+        if (name == "content-type" || name.startsWith(AMAZON_HEADER_PREFIX))
+            headers << ByteArrayPair(name, request->rawHeader(header).trimmed());
+    }
+    qSort(headers);
+
+    QByteArray canonicalHeaders;
+    QByteArray signedHeaders;
+    foreach(const ByteArrayPair &header, headers)
+    {
+        canonicalHeaders += header.first + ':' + header.second + '\n';
+        if (!signedHeaders.isEmpty())
+            signedHeaders += ';';
+        signedHeaders += header.first;
+    }
+
+    QByteArray canonicalRequest;
+    canonicalRequest.reserve(512);
+    canonicalRequest += httpVerb + '\n';
+    canonicalRequest += canonicalUri(request->url()) + '\n';
+    canonicalRequest += canonicalQuery(request->url()) + '\n';
+    canonicalRequest += canonicalHeaders + '\n';
+    canonicalRequest += signedHeaders + '\n';
+    canonicalRequest += payloadHash;
+
+    QByteArray authorization = ALGORITHM + " Credential=" + accessKey_ + '/' + scope(amzDate.left(8))
+                             + ", SignedHeaders=" + signedHeaders
+                             + ", Signature=" + signature(canonicalRequest, amzDate);
+    request->setRawHeader("Authorization", authorization);
+}
+
+QByteArray QS3SignerV4::presignQuery(const QByteArray &httpVerb, const QByteArray &encodedPath, const QByteArray &host, int expiresSecs, const QDateTime &now)
+{
+    const QByteArray amzDate = now.toUTC().toString("yyyyMMdd'T'hhmmss'Z'").toLatin1();
+
+    // Already in sorted order.
+    QByteArray query = "X-Amz-Algorithm=" + ALGORITHM
+                     + "&X-Amz-Credential=" + QUrl::toPercentEncoding(accessKey_ + '/' + scope(amzDate.left(8)))
+                     + "&X-Amz-Date=" + amzDate
+                     + "&X-Amz-Expires=" + QByteArray::number(expiresSecs)
+                     + "&X-Amz-SignedHeaders=host";
+
+    QByteArray canonicalRequest;
+    canonicalRequest.reserve(256 + encodedPath.size());
+    canonicalRequest += httpVerb + '\n';
+    canonicalRequest += encodedPath + '\n';
+    canonicalRequest += query + '\n';
+    canonicalRequest += "host:" + host + "\n\n";
+    canonicalRequest += "host\n";
+    canonicalRequest += UnsignedPayload;
+
+    return query + "&X-Amz-Signature=" + signature(canonicalRequest, amzDate);
+}
+
+QByteArray QS3SignerV4::canonicalUri(const QUrl &url)
+{
+    // Each path segment encoded once, S3 does not double encode.
+    QByteArray path = QUrl::toPercentEncoding(url.path(), "/");
+    return path.isEmpty() ? QByteArray("/") : path;
+}
+
+QByteArray QS3SignerV4::canonicalQuery(const QUrl &url)
+{
+    if (!url.hasQuery())
+        return QByteArray();
+
+    // All parameters, names and values encoded and sorted. Empty values keep the '='.
+    QList<ByteArrayPair> items = url.encodedQueryItems();
+    for (int i=0; i<items.size(); ++i)
+    {
+        items[i].first = QUrl::toPercentEncoding(QUrl::fromPercentEncoding(items[i].first));
+        items[i].second = QUrl::toPercentEncoding(QUrl::fromPercentEncoding(items[i].second));
+    }
+    qSort(items);
+
+    QByteArray query;
+    for (int i=0; i<items.size(); ++i)
+    {
+        if (i > 0)
+            query += '&';
+        query += items[i].first + '=' + items[i].second;
+    }
+    return query;
+}
+
+QByteArray QS3SignerV4::hostHeader(const QUrl &url)
+{
+    QByteArray host = url.encodedHost();
+    int port = url.port(-1);
+    if (port != -1 && !(url.scheme() == "http" && port == 80) && !(url.scheme() == "https" && port == 443))
+        host += ':' + QByteArray::number(port);
+    return host;
+}
@@ -0,0 +1,66 @@
+
+#pragma once
+
+#include "QS3Crypto.h"
+
+#include <QByteArray>
+#include <QHash>
+#include <QDateTime>
+
+class QNetworkRequest;
+class QUrl;
+
+/// QS3SignerV4
+
+/** AWS Signature Version 4 for S3 requests and pre-signed urls.
+    http://docs.aws.amazon.com/AmazonS3/latest/API/sig-v4-authenticating-requests.html
+
+    The signing key is derived with four HMAC steps from the secret, date,
+    region and service. Derived keys are cached per scope so the derivation
+    runs once a day instead of once per request. */
+class QS3SignerV4
+{
+public:
+    QS3SignerV4(const QByteArray &accessKey, const QByteArray &secretKey, const QByteArray &region, const QByteArray &service = "s3");
+
+    /// Payload hash for bodies that are not signed.
+    static const QByteArray UnsignedPayload;
+
+    /// Returns the lowercase hex SHA-256 of data.
+    static QByteArray payloadHash(const QByteArray &data);
+
+    /// Adds x-amz-date, x-amz-content-sha256 and Authorization headers to request.
+    /** @param QByteArray payload hash from payloadHash or UnsignedPayload. */
+    void signRequest(QNetworkRequest *request, const QByteArray &httpVerb, const QByteArray &payloadHash, const QDateTime &now);
+
+    /// Returns the query string, without '?', that pre-signs the url.
+    /** @param QByteArray encoded path of the url.
+        @param QByteArray host header of the url.
+        @param int seconds the url is valid for, at most a week. */
+    QByteArray presignQuery(const QByteArray &httpVerb, const QByteArray &encodedPath, const QByteArray &host, int expiresSecs, const QDateTime &now);
+
+    /// Returns the url path and query canonicalized for signing.
+    static QByteArray canonicalUri(const QUrl &url);
+    static QByteArray canonicalQuery(const QUrl &url);
+
+    /// Returns the Host header value of url.
+    static QByteArray hostHeader(const QUrl &url);
+
+private:
+    /// Returns date/region/service/aws4_request.
+    QByteArray scope(const QByteArray &date) const;
+
+    /// Returns the HMAC state of the derived signing key for date.
+    const QS3HmacSha256 &signingKey(const QByteArray &date);
+
+    /// Returns the hex signature of the canonical request.
+    QByteArray signature(const QByteArray &canonicalRequest, const QByteArray &amzDate);
+
+    QByteArray accessKey_;
+    QByteArray secretKey_;
+    QByteArray region_;
+    QByteArray service_;
+
+    /// Derived signing keys by date.
+    QHash<QByteArray, QS3HmacSha256> keys_;
+};
@@ -0,0 +1,346 @@
+
+#include "QS3StreamUpload.h"
+#include "QS3Client.h"
+#include "QS3Xml.h"
+
+#include <QTimer>
+#include <QDebug>
+
+namespace
+{
+    static const qint64 MIN_PART_SIZE = 5 * 1024 * 1024;
+    static const qint64 MAX_PART_SIZE = Q_INT64_C(5) * 1024 * 1024 * 1024;
+    static const int MAX_PARTS = 10000;
+    static const int PARTS_PER_SIZE = 1000;
+    static const int MAX_PART_ATTEMPTS = 3;
+}
+
+QS3StreamUpload::QS3StreamUpload(QS3Client *client, const QString &key, QIODevice *source, const QS3FileMetadata &metadata, QS3::CannedAcl cannedAcl) :
+    QObject(client),
+    client_(client),
+    source_(source),
+    key_(key),
+    metadata_(metadata),
+    cannedAcl_(cannedAcl),
+    partSize_(8 * 1024 * 1024),
+    partNumber_(0),
+    partAttempts_(0),
+    ongoing_(0),
+    sourceFinished_(false),
+    readBytes_(0),
+    uploadedBytes_(0),
+    finished_(false),
+    succeeded_(false)
+{
+    QTimer::singleShot(0, this, SLOT(start()));
+}
+
+QS3StreamUpload::~QS3StreamUpload()
+{
+    if (client_ && ongoing_)
+        client_->cancel(ongoing_);
+}
+
+void QS3StreamUpload::setPartSize(qint64 partSize)
+{
+    partSize_ = qBound(MIN_PART_SIZE, partSize, MAX_PART_SIZE);
+}
+
+QString QS3StreamUpload::key() const
+{
+    return key_;
+}
+
+qint64 QS3StreamUpload::readBytes() const
+{
+    return readBytes_;
+}
+
+qint64 QS3StreamUpload::uploadedBytes() const
+{
+    return uploadedBytes_;
+}
+
+bool QS3StreamUpload::isMultipart() const
+{
+    return !uploadId_.isEmpty();
+}
+
+bool QS3StreamUpload::isFinished() const
+{
+    return finished_;
+}
+
+bool QS3StreamUpload::succeeded() const
+{
+    return succeeded_;
+}
+
+QS3Error QS3StreamUpload::error() const
+{
+    return error_;
+}
+
+QString QS3StreamUpload::eTag() const
+{
+    return eTag_;
+}
+
+void QS3StreamUpload::start()
+{
+    if (finished_)
+        return;
+    if (!client_)
+    {
+        fail("QS3Client was destroyed before the upload started.");
+        return;
+    }
+    if (!source_ || !source_->isReadable())
+    {
+        fail("Source of " + key_ + " is not readable.");
+        return;
+    }
+    connect(source_, SIGNAL(readyRead()), SLOT(onReadyRead()));
+    connect(source_, SIGNAL(readChannelFinished()), SLOT(onReadChannelFinished()));
+    readSource();
+}
+
+void QS3StreamUpload::cancel()
+{
+    fail("Operation canceled");
+}
+
+void QS3StreamUpload::onReadyRead()
+{
+    readSource();
+}
+
+void QS3StreamUpload::onReadChannelFinished()
+{
+    sourceFinished_ = true;
+    readSource();
+}
+
+bool QS3StreamUpload::sourceEnded() const
+{
+    return sourceFinished_ || !source_ || !source_->isOpen() || (!source_->isSequential() && source_->atEnd());
+}
+
+qint64 QS3StreamUpload::currentPartSize() const
+{
+    return qMin(MAX_PART_SIZE, partSize_ << qMin(partNumber_ / PARTS_PER_SIZE, 16));
+}
+
+void QS3StreamUpload::readSource()
+{
+    // Nothing is read while a request is ongoing, the part being uploaded is the only one in memory.
+    if (finished_ || ongoing_ || !client_)
+        return;
+
+    const qint64 partSize = currentPartSize();
+    while (source_ && buffer_.size() < partSize)
+    {
+        QByteArray data = source_->read(partSize - buffer_.size());
+        if (data.isEmpty())
+            break;
+        readBytes_ += data.size();
+        buffer_.append(data);
+    }
+
+    if (buffer_.size() >= partSize)
+    {
+        if (uploadId_.isEmpty())
+            initiate();
+        else
+            sendPart();
+        return;
+    }
+    if (!sourceEnded())
+        return;
+
+    // The whole source fit in one part.
+    if (uploadId_.isEmpty())
+    {
+        if (buffer_.isEmpty())
+        {
+            fail("Source of " + key_ + " is empty.");
+            return;
+        }
+        partData_ = buffer_;
+        buffer_.clear();
+        ongoing_ = client_->put(key_, partData_, metadata_, cannedAcl_, this, PutRequest);
+        if (!ongoing_)
+            fail("Invalid key " + key_);
+        return;
+    }
+
+    if (!buffer_.isEmpty())
+        sendPart();
+    else
+        complete();
+}
+
+void QS3StreamUpload::initiate()
+{
+    ongoing_ = client_->initiateMultipartUpload(key_, metadata_, cannedAcl_, this, InitiateRequest);
+    if (!ongoing_)
+        fail("Invalid key " + key_);
+}
+
+void QS3StreamUpload::sendPart()
+{
+    // A retried part is sent again from partData_.
+    if (!buffer_.isEmpty())
+    {
+        if (partNumber_ >= MAX_PARTS)
+        {
+            fail(QString("Source of %1 does not fit in %2 parts.").arg(key_).arg(MAX_PARTS));
+            return;
+        }
+        partData_ = buffer_;
+        buffer_ = QByteArray();
+        partNumber_++;
+        partAttempts_ = 0;
+    }
+
+    ongoing_ = client_->uploadPart(key_, uploadId_, partNumber_, partData_, this, PartRequest);
+    if (!ongoing_)
+        fail(QString("Failed to upload part %1.").arg(partNumber_));
+}
+
+void QS3StreamUpload::complete()
+{
+    ongoing_ = client_->completeMultipartUpload(key_, uploadId_, completedParts_, this, CompleteRequest);
+    if (!ongoing_)
+        fail("Failed to complete multipart upload.");
+}
+
+void QS3StreamUpload::handleResult(const QS3Result &result)
+{
+    if (result.id != ongoing_)
+        return;
+    ongoing_ = 0;
+
+    switch (result.tag)
+    {
+        case PutRequest:
+            if (!result.succeeded)
+            {
+                fail("Failed to upload " + key_ + ".", result.error);
+                return;
+            }
+            uploadedBytes_ = partData_.size();
+            partData_.clear();
+            eTag_ = result.eTag;
+            succeeded_ = true;
+            emit progress(this, uploadedBytes_);
+            finish();
+            break;
+        case InitiateRequest: onInitiated(result); break;
+        case PartRequest: onPartUploaded(result); break;
+        case CompleteRequest: onCompleted(result); break;
+        case AbortRequest: onAborted(result); break;
+        default: break;
+    }
+}
+
+void QS3StreamUpload::onInitiated(const QS3Result &result)
+{
+    QString errorMessage;
+    if (!result.succeeded)
+    {
+        fail("Failed to initiate multipart upload.", result.error);
+        return;
+    }
+    if (!QS3Xml::parseInitiateMultipartUpload(uploadId_, result.data, errorMessage))
+    {
+        uploadId_.clear();
+        fail(errorMessage);
+        return;
+    }
+    sendPart();
+}
+
+void QS3StreamUpload::onPartUploaded(const QS3Result &result)
+{
+    if (!result.succeeded || result.eTag.isEmpty())
+    {
+        if (++partAttempts_ < MAX_PART_ATTEMPTS)
+        {
+            sendPart();
+            return;
+        }
+        fail(QString("Failed to upload part %1.").arg(partNumber_), result.error);
+        return;
+    }
+
+    completedParts_[partNumber_] = result.eTag;
+    uploadedBytes_ += partData_.size();
+    partData_ = QByteArray();
+    emit progress(this, uploadedBytes_);
+    readSource();
+}
+
+void QS3StreamUpload::onCompleted(const QS3Result &result)
+{
+    if (!result.succeeded)
+    {
+        fail("Failed to complete multipart upload.", result.error);
+        return;
+    }
+
+    QS3Error error;
+    QString errorMessage;
+    if (!QS3Xml::parseCompleteMultipartUpload(eTag_, error, result.data, errorMessage))
+    {
+        fail(errorMessage, error);
+        return;
+    }
+    succeeded_ = true;
+    finish();
+}
+
+void QS3StreamUpload::onAborted(const QS3Result &result)
+{
+    // An upload that no longer exists is as good as aborted.
+    if (!result.succeeded && result.httpStatusCode != 404 && result.error.code != "NoSuchUpload")
+        qDebug() << "QS3StreamUpload: Warning: Failed to abort multipart upload" << uploadId_ << "of" << key_ << result.error.toString();
+    uploadId_.clear();
+    finish();
+}
+
+void QS3StreamUpload::fail(const QString &message, const QS3Error &error)
+{
+    if (finished_ || !error_.error.isEmpty())
+        return;
+
+    if (client_ && ongoing_)
+        client_->cancel(ongoing_);
+    ongoing_ = 0;
+    buffer_ = QByteArray();
+    partData_ = QByteArray();
+
+    error_ = error;
+    error_.error = message + (error.error.isEmpty() ? "" : " " + error.error);
+    qDebug() << "QS3StreamUpload: Error:" << error_.error << key_;
+
+    // Parts of an unfinished upload are stored and billed until it is aborted.
+    if (!uploadId_.isEmpty() && client_)
+    {
+        ongoing_ = client_->abortMultipartUpload(key_, uploadId_, this, AbortRequest);
+        if (ongoing_)
+            return;
+    }
+    finish();
+}
+
+void QS3StreamUpload::finish()
+{
+    if (finished_)
+        return;
+    finished_ = true;
+
+    if (source_)
+        disconnect(source_, 0, this, 0);
+    emit finished(this);
+}
@@ -0,0 +1,175 @@
+
+#include "QS3Tracer.h"
+
+#include <QtGlobal>
+
+#include <cstdlib>
+
+namespace
+{
+    static const char *requestTypeName(QS3::RequestType type)
+    {
+        switch (type)
+        {
+            case QS3::ListObjects: return "ListObjects";
+            case QS3::RemoveObject: return "RemoveObject";
+            case QS3::CopyObject: return "CopyObject";
+            case QS3::GetObject: return "GetObject";
+            case QS3::PutObject: return "PutObject";
+            case QS3::GetAcl: return "GetAcl";
+            case QS3::SetAcl: return "SetAcl";
+            case QS3::InitiateMultipartUpload: return "InitiateMultipartUpload";
+            case QS3::UploadPart: return "UploadPart";
+            case QS3::ListParts: return "ListParts";
+            case QS3::CompleteMultipartUpload: return "CompleteMultipartUpload";
+            case QS3::AbortMultipartUpload: return "AbortMultipartUpload";
+        }
+        return "Request";
+    }
+
+    static void appendJsonString(QByteArray &json, const QString &str)
+    {
+        static const char hex[] = "0123456789abcdef";
+
+        const QByteArray utf8 = str.toUtf8();
+        json += '"';
+        for (int i=0; i<utf8.size(); ++i)
+        {
+            const char c = utf8.at(i);
+            if (c == '"' || c == '\\')
+            {
+                json += '\\';
+                json += c;
+            }
+            else if (static_cast<uchar>(c) < 0x20)
+            {
+                json += "\\u00";
+                json += hex[(c >> 4) & 0xf];
+                json += hex[c & 0xf];
+            }
+            else
+                json += c;
+        }
+        json += '"';
+    }
+
+    /// Appends a nestable async begin or end event.
+    static void appendEvent(QByteArray &json, char phase, const char *name, QS3RequestId id, qint64 timestamp)
+    {
+        if (!json.endsWith('['))
+            json += ",\n";
+        json += "{\"name\":\"";
+        json += name;
+        json += "\",\"cat\":\"qts3\",\"ph\":\"";
+        json += phase;
+        json += "\",\"id\":";
+        json += QByteArray::number(id);
+        json += ",\"pid\":1,\"tid\":1,\"ts\":";
+        json += QByteArray::number(timestamp);
+        json += '}';
+    }
+
+    /// Appends a child phase of a request if both ends were reached.
+    static void appendPhase(QByteArray &json, const char *name, QS3RequestId id, qint64 begin, qint64 end)
+    {
+        if (begin < 0 || end < begin)
+            return;
+        appendEvent(json, 'b', name, id, begin);
+        appendEvent(json, 'e', name, id, end);
+    }
+}
+
+QS3TraceSpan::QS3TraceSpan() :
+    id(0),
+    type(QS3::ListObjects),
+    httpStatusCode(0),
+    bytesSent(0),
+    bytesReceived(0),
+    scheduled(-1),
+    dispatched(-1),
+    signedTime(-1),
+    headers(-1),
+    replied(-1),
+    finished(-1)
+{
+}
+
+QS3Tracer::QS3Tracer(int capacity, double sampleRate) :
+    spans_(qMax(1, capacity)),
+    capacity_(qMax(1, capacity)),
+    next_(0),
+    count_(0),
+    sampleRate_(sampleRate)
+{
+}
+
+bool QS3Tracer::sample()
+{
+    if (sampleRate_ >= 1.0)
+        return true;
+    if (sampleRate_ <= 0.0)
+        return false;
+    return qrand() < sampleRate_ * (double(RAND_MAX) + 1.0);
+}
+
+void QS3Tracer::setSampleRate(double sampleRate)
+{
+    sampleRate_ = sampleRate;
+}
+
+void QS3Tracer::record(const QS3TraceSpan &span)
+{
+    // Oldest spans are overwritten when full.
+    spans_[next_] = span;
+    next_ = (next_ + 1) % capacity_;
+    if (count_ < capacity_)
+        count_++;
+}
+
+int QS3Tracer::spanCount() const
+{
+    return count_;
+}
+
+QByteArray QS3Tracer::toJson() const
+{
+    QByteArray json;
+    json.reserve(count_ * 640 + 64);
+    json += "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[";
+
+    const int first = (count_ < capacity_ ? 0 : next_);
+    for (int i=0; i<count_; ++i)
+    {
+        const QS3TraceSpan &span = spans_[(first + i) % capacity_];
+        const char *name = requestTypeName(span.type);
+
+        // The request from scheduling to finished emission, with its details.
+        appendEvent(json, 'b', name, span.id, span.scheduled);
+        json.chop(1);
+        json += ",\"args\":{\"key\":";
+        appendJsonString(json, span.key);
+        json += ",\"verb\":";
+        appendJsonString(json, span.verb);
+        json += ",\"status\":" + QByteArray::number(span.httpStatusCode);
+        json += ",\"bytesSent\":" + QByteArray::number(span.bytesSent);
+        json += ",\"bytesReceived\":" + QByteArray::number(span.bytesReceived);
+        json += "}}";
+
+        // Coalesced requests are never sent, they wait for the reply of an identical request.
+        if (span.dispatched >= 0)
+        {
+            appendPhase(json, "queued", span.id, span.scheduled, span.dispatched);
+            appendPhase(json, "sign", span.id, span.dispatched, span.signedTime);
+            appendPhase(json, "wait", span.id, span.signedTime, span.headers >= 0 ? span.headers : span.replied);
+            appendPhase(json, "receive", span.id, span.headers, span.replied);
+        }
+        else
+            appendPhase(json, "coalesced", span.id, span.scheduled, span.replied);
+        appendPhase(json, "finish", span.id, span.replied, span.finished);
+
+        appendEvent(json, 'e', name, span.id, span.finished);
+    }
+
+    json += "]}\n";
+    return json;
+}
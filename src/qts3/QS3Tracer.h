@@ -0,0 +1,66 @@
+
+#pragma once
+
+#include "QS3Defines.h"
+
+#include <QString>
+#include <QByteArray>
+#include <QVector>
+
+/// QS3TraceSpan
+
+/** Timeline of one finished request. Times are microseconds on the client
+    clock, negative if the request did not go through the phase, eg. a
+    coalesced request is never signed. */
+struct QS3TraceSpan
+{
+    QS3TraceSpan();
+
+    QS3RequestId id;
+    QS3::RequestType type;
+    QString key;
+    QString verb;
+    int httpStatusCode;
+    qint64 bytesSent;
+    qint64 bytesReceived;
+
+    qint64 scheduled;
+    qint64 dispatched;
+    qint64 signedTime;
+    qint64 headers;
+    qint64 replied;
+    qint64 finished;
+};
+
+/// QS3Tracer
+
+/** Keeps the most recent request spans in a fixed size ring buffer and
+    exports them as Chrome trace event JSON, which chrome://tracing and
+    Perfetto open. Recording a span is a copy into preallocated storage,
+    requests can be sampled to keep the cost down in production. */
+class QS3Tracer
+{
+public:
+    QS3Tracer(int capacity, double sampleRate);
+
+    /// Returns true if a new request should be traced.
+    bool sample();
+
+    /// Sets the fraction of requests traced, 0 stops tracing new requests.
+    void setSampleRate(double sampleRate);
+
+    void record(const QS3TraceSpan &span);
+
+    /// Number of recorded spans, at most capacity.
+    int spanCount() const;
+
+    /// Returns the recorded spans, oldest first, as trace event JSON.
+    QByteArray toJson() const;
+
+private:
+    QVector<QS3TraceSpan> spans_;
+    int capacity_;
+    int next_;
+    int count_;
+    double sampleRate_;
+};
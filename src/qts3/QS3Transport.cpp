@@ -0,0 +1,11 @@
+
+#include "QS3Transport.h"
+
+QS3Transport::QS3Transport(QObject *parent) :
+    QObject(parent)
+{
+}
+
+QS3Transport::~QS3Transport()
+{
+}
@@ -5,6 +5,8 @@
 #include <QDomDocument>
 #include <QDomElement>
 #include <QDomNode>
+#include <QUrl>
+#include <QStringList>
 #include <QDebug>
 
 namespace QS3Xml
@@ -38,7 +40,23 @@ namespace QS3Xml
         return true;
     }
 
-    bool parseListObjects(QS3ListObjectsResponse *response, const QByteArray &data, QString &errorMessage)
+    static QString decodeUrlEncoded(const QString &value)
+    {
+        // S3 encodes spaces as '+', a literal '+' is %2B.
+        QByteArray encoded = value.toUtf8();
+        encoded.replace('+', ' ');
+        return QUrl::fromPercentEncoding(encoded);
+    }
+
+    static QS3Object directoryObject(const QString &prefix)
+    {
+        QS3Object object;
+        object.key = prefix;
+        object.isDir = true;
+        return object;
+    }
+
+    static bool parseListBucketResult(QS3ListObjectsResponse *response, const QByteArray &data, bool urlEncoded, QString &errorMessage)
     {
         QDomDocument doc;
         if (!doc.setContent(data, &errorMessage))
@@ -53,19 +71,56 @@ namespace QS3Xml
         }
 
         response->isTruncated = root.firstChildElement(NODE_NAME_TRUNCATED).text() == "true" ? true : false;
+        response->nextContinuationToken = root.firstChildElement(NODE_NAME_NEXT_TOKEN).text();
+
+        // Folders one level below the prefix when listed with a delimiter. They are
+        // added as directory entries in key order between the objects of the page.
+        QStringList prefixes;
+        for(QDomElement common = root.firstChildElement(NODE_NAME_COMMON_PREFIXES); !common.isNull(); common = common.nextSiblingElement(NODE_NAME_COMMON_PREFIXES))
+        {
+            QString prefix = common.firstChildElement(NODE_NAME_PREFIX).text();
+            if (urlEncoded)
+                prefix = decodeUrlEncoded(prefix);
+            if (!prefix.isEmpty())
+                prefixes << prefix;
+        }
+        response->commonPrefixes << prefixes;
+        int nextPrefix = 0;
 
         QDomNodeList contents = root.elementsByTagName(NODE_NAME_CONTENTS);
+        if (response->compact)
+        {
+            response->compactObjects.reserve(response->compactObjects.size() + contents.size() + prefixes.size());
+            for(int i=0; i<contents.size(); ++i)
+            {
+                QDomElement content = contents.item(i).toElement();
+                QString key = content.firstChildElement(NODE_NAME_KEY).text();
+                if (urlEncoded)
+                    key = decodeUrlEncoded(key);
+                if (key.isEmpty())
+                    continue;
+                while (nextPrefix < prefixes.size() && prefixes[nextPrefix] < key)
+                    response->compactObjects.append(prefixes[nextPrefix++], "", "", 0, true);
+                qint64 size = content.firstChildElement(NODE_NAME_SIZE).text().toLongLong();
+                response->compactObjects.append(key,
+                                                content.firstChildElement(NODE_NAME_LASTMODIFIED).text(),
+                                                content.firstChildElement(NODE_NAME_ETAG).text(),
+                                                size, key.endsWith(ROOT_PATH) && size == 0);
+            }
+            while (nextPrefix < prefixes.size())
+                response->compactObjects.append(prefixes[nextPrefix++], "", "", 0, true);
+            return true;
+        }
+
         for(int i=0; i<contents.size(); ++i)
         {
             QS3Object object;
 
-            /// @todo Set object.isDir properly, see <CommonPrefixes>
-
             QDomElement child = contents.item(i).firstChildElement();
             while(!child.isNull())
             {
                 if (child.nodeName() == NODE_NAME_KEY)
-                    object.key = child.text();
+                    object.key = urlEncoded ? decodeUrlEncoded(child.text()) : child.text();
                 else if (child.nodeName() == NODE_NAME_LASTMODIFIED)
                     object.lastModified = child.text();
                 else if (child.nodeName() == NODE_NAME_ETAG)
@@ -77,16 +132,35 @@ namespace QS3Xml
 
             if (!object.key.isEmpty())
             {
+                while (nextPrefix < prefixes.size() && prefixes[nextPrefix] < object.key)
+                    response->objects << directoryObject(prefixes[nextPrefix++]);
                 if (object.key.endsWith(ROOT_PATH) && object.size == 0)
                     object.isDir = true;
                 response->objects << object;
             }
         }
+        while (nextPrefix < prefixes.size())
+            response->objects << directoryObject(prefixes[nextPrefix++]);
 
         return true;
     }
 
+    bool parseListObjects(QS3ListObjectsResponse *response, const QByteArray &data, QString &errorMessage)
+    {
+        return parseListBucketResult(response, data, false, errorMessage);
+    }
+
+    bool parseListObjectsV2(QS3ListObjectsResponse *response, const QByteArray &data, QString &errorMessage)
+    {
+        return parseListBucketResult(response, data, true, errorMessage);
+    }
+
     bool parseAclObjects(QS3GetAclResponse *response, const QByteArray &data, QString &errorMessage)
+    {
+        return parseAcl(response->acl, response->url.path(), data, errorMessage);
+    }
+
+    bool parseAcl(QS3Acl &dest, const QString &key, const QByteArray &data, QString &errorMessage)
     {
         QDomDocument doc;
         if (!doc.setContent(data, &errorMessage))
@@ -112,7 +186,7 @@ namespace QS3Xml
         QS3Acl acl;
         acl.ownerName = bucketOwnerName;
         acl.ownerId = bucketOwnerId;
-        acl.key = response->url.path();
+        acl.key = key;
         if (acl.key.isEmpty())
             acl.key = ROOT_PATH;
 
@@ -216,7 +290,98 @@ namespace QS3Xml
             }
         }
         
-        response->acl = acl;
+        dest = acl;
         return true;       
     }
+
+    bool parseInitiateMultipartUpload(QString &uploadId, const QByteArray &data, QString &errorMessage)
+    {
+        QDomDocument doc;
+        if (!doc.setContent(data, &errorMessage))
+            return false;
+
+        // <InitiateMultipartUploadResult>
+        QDomElement root = doc.documentElement();
+        if (root.isNull() || root.nodeName() != NODE_NAME_INIT_UPLOAD)
+        {
+            errorMessage = "Failed to get document root <InitiateMultipartUploadResult> element. XML response was invalid.";
+            return false;
+        }
+        uploadId = root.firstChildElement(NODE_NAME_UPLOAD_ID).text();
+        if (uploadId.isEmpty())
+        {
+            errorMessage = "Failed to find <UploadId> from <InitiateMultipartUploadResult>. XML response was invalid.";
+            return false;
+        }
+        return true;
+    }
+
+    bool parseListParts(QHash<int, QString> &eTags, QHash<int, qint64> &sizes, bool &isTruncated, int &nextPartNumberMarker, const QByteArray &data, QString &errorMessage)
+    {
+        QDomDocument doc;
+        if (!doc.setContent(data, &errorMessage))
+            return false;
+
+        // <ListPartsResult>
+        QDomElement root = doc.documentElement();
+        if (root.isNull() || root.nodeName() != NODE_NAME_LIST_PARTS)
+        {
+            errorMessage = "Failed to get document root <ListPartsResult> element. XML response was invalid.";
+            return false;
+        }
+        isTruncated = (root.firstChildElement(NODE_NAME_TRUNCATED).text().toLower() == "true");
+        nextPartNumberMarker = root.firstChildElement(NODE_NAME_NEXT_PART).text().toInt();
+
+        // <Part>
+        QDomElement part = root.firstChildElement(NODE_NAME_PART);
+        for (; !part.isNull(); part = part.nextSiblingElement(NODE_NAME_PART))
+        {
+            int partNumber = part.firstChildElement(NODE_NAME_PART_NUMBER).text().toInt();
+            if (partNumber <= 0)
+            {
+                errorMessage = "Failed to find <PartNumber> from <Part>. XML response was invalid.";
+                return false;
+            }
+            eTags[partNumber] = part.firstChildElement(NODE_NAME_ETAG).text();
+            sizes[partNumber] = part.firstChildElement(NODE_NAME_SIZE).text().toLongLong();
+        }
+        return true;
+    }
+
+    bool parseCompleteMultipartUpload(QString &eTag, QS3Error &error, const QByteArray &data, QString &errorMessage)
+    {
+        // Complete can fail after a 200 OK status, the error is then in the body.
+        QDomDocument doc;
+        if (!doc.setContent(data, &errorMessage))
+            return false;
+
+        QDomElement root = doc.documentElement();
+        if (!root.isNull() && root.nodeName() == NODE_NAME_ERROR)
+        {
+            QString errorParseError;
+            parseError(error, data, errorParseError);
+            errorMessage = error.toString();
+            return false;
+        }
+        if (root.isNull() || root.nodeName() != NODE_NAME_COMPLETE)
+        {
+            errorMessage = "Failed to get document root <CompleteMultipartUploadResult> element. XML response was invalid.";
+            return false;
+        }
+        eTag = root.firstChildElement(NODE_NAME_ETAG).text();
+        return true;
+    }
+
+    QByteArray generateCompleteMultipartUpload(const QMap<int, QString> &eTags)
+    {
+        QByteArray xml = "<CompleteMultipartUpload>";
+        QMap<int, QString>::const_iterator iter = eTags.constBegin();
+        for (; iter != eTags.constEnd(); ++iter)
+        {
+            xml += "<Part><PartNumber>" + QByteArray::number(iter.key()) + "</PartNumber>";
+            xml += "<ETag>" + iter.value().toUtf8().replace('&', "&amp;").replace('<', "&lt;") + "</ETag></Part>";
+        }
+        xml += "</CompleteMultipartUpload>";
+        return xml;
+    }
 }
@@ -5,12 +5,23 @@
 
 #include <QString>
 #include <QByteArray>
+#include <QHash>
+#include <QMap>
 
 namespace QS3Xml
 {
     bool parseError(QS3Error &dest, const QByteArray &data, QString &errorMessage);
     bool parseListObjects(QS3ListObjectsResponse *response, const QByteArray &data, QString &errorMessage);
+    /// ListObjectsV2 with encoding-type=url. Keys are decoded.
+    bool parseListObjectsV2(QS3ListObjectsResponse *response, const QByteArray &data, QString &errorMessage);
     bool parseAclObjects(QS3GetAclResponse *response, const QByteArray &data, QString &errorMessage);
+    bool parseAcl(QS3Acl &acl, const QString &key, const QByteArray &data, QString &errorMessage);
+
+    /// Multipart upload. Part ETags and sizes are keyed by part number.
+    bool parseInitiateMultipartUpload(QString &uploadId, const QByteArray &data, QString &errorMessage);
+    bool parseListParts(QHash<int, QString> &eTags, QHash<int, qint64> &sizes, bool &isTruncated, int &nextPartNumberMarker, const QByteArray &data, QString &errorMessage);
+    bool parseCompleteMultipartUpload(QString &eTag, QS3Error &error, const QByteArray &data, QString &errorMessage);
+    QByteArray generateCompleteMultipartUpload(const QMap<int, QString> &eTags);
 
     static QString ROOT_PATH = "/";
 
@@ -20,6 +31,9 @@ namespace QS3Xml
     static QString NODE_NAME_SIZE           = "Size";
     static QString NODE_NAME_LASTMODIFIED   = "LastModified";
     static QString NODE_NAME_TRUNCATED      = "IsTruncated";
+    static QString NODE_NAME_NEXT_TOKEN     = "NextContinuationToken";
+    static QString NODE_NAME_COMMON_PREFIXES = "CommonPrefixes";
+    static QString NODE_NAME_PREFIX         = "Prefix";
     static QString NODE_NAME_OWNER          = "Owner";
     static QString NODE_NAME_DISPLAY_NAME   = "DisplayName";
     static QString NODE_NAME_ID             = "ID";
@@ -28,6 +42,13 @@ namespace QS3Xml
     static QString NODE_NAME_GRANTEE        = "Grantee";
     static QString NODE_NAME_PERMISSION     = "Permission";
     static QString NODE_NAME_URI            = "URI";
+    static QString NODE_NAME_UPLOAD_ID      = "UploadId";
+    static QString NODE_NAME_PART           = "Part";
+    static QString NODE_NAME_PART_NUMBER    = "PartNumber";
+    static QString NODE_NAME_NEXT_PART      = "NextPartNumberMarker";
+    static QString NODE_NAME_INIT_UPLOAD    = "InitiateMultipartUploadResult";
+    static QString NODE_NAME_LIST_PARTS     = "ListPartsResult";
+    static QString NODE_NAME_COMPLETE       = "CompleteMultipartUploadResult";
 
     static QString NODE_NAME_ERROR          = "Error";
     static QString NODE_NAME_CODE           = "Code";
@@ -0,0 +1,327 @@
+
+#include "QS3Replay.h"
+#include "QS3Client.h"
+
+#include <QCoreApplication>
+#include <QDebug>
+#include <QTimer>
+#include <QSet>
+#include <QtAlgorithms>
+
+#include <climits>
+
+namespace
+{
+    static const quint64 SEED_TAG = ~quint64(0);
+
+    static bool ScheduledBefore(const QS3RecordedRequest &a, const QS3RecordedRequest &b)
+    {
+        return a.scheduled < b.scheduled;
+    }
+
+    static const char *RequestTypeName(int type)
+    {
+        switch (type)
+        {
+            case QS3::ListObjects: return "ListObjects";
+            case QS3::RemoveObject: return "RemoveObject";
+            case QS3::CopyObject: return "CopyObject";
+            case QS3::GetObject: return "GetObject";
+            case QS3::PutObject: return "PutObject";
+            case QS3::GetAcl: return "GetAcl";
+            case QS3::SetAcl: return "SetAcl";
+            case QS3::UploadPart: return "UploadPart";
+            default: return "Multipart";
+        }
+    }
+
+    static double Percentile(const QVector<qint64> &sorted, double p)
+    {
+        if (sorted.isEmpty())
+            return 0.0;
+        int index = qMin(sorted.size() - 1, (int)(p * sorted.size()));
+        return sorted[index] / 1000.0;
+    }
+}
+
+QS3Replay::QS3Replay(const QStringList &params) :
+    client(0),
+    fast(false),
+    seedsPending(0),
+    maxInflight(1),
+    issuing(false),
+    next(0),
+    outstanding(0),
+    completed(0),
+    failed(0),
+    skipped(0),
+    bytes(0),
+    timer(new QTimer(this))
+{
+    QStringList args = params;
+    QString host;
+    bool seed = false;
+    bool native = false;
+    int connections = 0;
+    for (int i=0; i<args.size(); ++i)
+    {
+        if (args[i] == "--fast")
+            fast = true;
+        else if (args[i] == "--seed")
+            seed = true;
+        else if (args[i] == "--native")
+            native = true;
+        else if (args[i] == "--connections" && i + 1 < args.size())
+            connections = args.takeAt(i + 1).toInt();
+        else if (args[i] == "--host" && i + 1 < args.size())
+            host = args.takeAt(i + 1);
+        else
+            continue;
+        args.removeAt(i--);
+    }
+    if (args.size() < 4)
+    {
+        qDebug() << "Usage: qts3tester replay <accessKey> <secretKey> <bucketName> <recording> [--host host] [--fast] [--seed] [--native] [--connections n]";
+        qDebug() << "  --host  S3 stand-in host, the bucket is prefixed to it, eg. localhost:9000 for bucket.localhost:9000";
+        qDebug() << "  --fast  issue requests as fast as possible with the recorded peak concurrency";
+        qDebug() << "  --seed  put the objects the workload reads before replaying";
+        qDebug() << "  --native  send with the built-in HTTP engine instead of QNetworkAccessManager";
+        qDebug() << "  --connections  connections per host of the built-in HTTP engine, default 16";
+        return;
+    }
+
+    QString errorMessage;
+    if (!QS3Recording::read(args[3], requests, errorMessage))
+    {
+        qDebug() << "[QS3Replay] Error:" << errorMessage.toStdString().c_str();
+        return;
+    }
+    if (requests.isEmpty())
+    {
+        qDebug() << "[QS3Replay]: Recording is empty";
+        return;
+    }
+    qStableSort(requests.begin(), requests.end(), ScheduledBefore);
+
+    QS3Config config(args[0], args[1], args[2], QS3Config::S3_DEFAULT);
+    if (!host.isEmpty())
+        config.host = host;
+    if (native)
+        config.transport = QS3Config::NativeTransport;
+    if (connections > 0)
+        config.connectionsPerHost = connections;
+    client = new QS3Client(config, this);
+    connect(client, SIGNAL(finished(QS3ListObjectsResponse*)), SLOT(OnListObjectsRespose(QS3ListObjectsResponse*)));
+
+    qint64 payloadSize = 1;
+    foreach(const QS3RecordedRequest &request, requests)
+    {
+        maxInflight = qMax(maxInflight, request.inflight + 1);
+        payloadSize = qMax(payloadSize, qMax(request.bytesSent, request.rangeOffset + request.bytesReceived));
+    }
+    payload.fill('x', (int)qMin<qint64>(payloadSize, INT_MAX));
+    issued.resize(requests.size());
+
+    timer->setSingleShot(true);
+    connect(timer, SIGNAL(timeout()), SLOT(OnTimer()));
+
+    if (seed)
+        Seed();
+    else
+        Start();
+}
+
+QS3Replay::~QS3Replay()
+{
+}
+
+QByteArray QS3Replay::Payload(qint64 size) const
+{
+    return QByteArray::fromRawData(payload.constData(), (int)qBound<qint64>(1, size, payload.size()));
+}
+
+qint64 QS3Replay::Now() const
+{
+#if QT_VERSION >= 0x040800
+    return clock.nsecsElapsed() / 1000;
+#else
+    return clock.elapsed() * 1000;
+#endif
+}
+
+void QS3Replay::Seed()
+{
+    // Objects that are read before being written, at the largest size read.
+    QMap<QString, qint64> sizes;
+    QSet<QString> written;
+    foreach(const QS3RecordedRequest &request, requests)
+    {
+        if (request.type == QS3::PutObject || request.type == QS3::UploadPart)
+            written.insert(request.key);
+        else if (!written.contains(request.key) && (request.type == QS3::GetObject || request.type == QS3::GetAcl ||
+                 request.type == QS3::SetAcl || request.type == QS3::CopyObject || request.type == QS3::RemoveObject))
+            sizes[request.key] = qMax(sizes.value(request.key, 1), request.rangeOffset + request.bytesReceived);
+    }
+
+    qDebug() << "[QS3Replay]: Seeding" << sizes.size() << "objects";
+    for (QMap<QString, qint64>::const_iterator iter = sizes.constBegin(); iter != sizes.constEnd(); ++iter)
+    {
+        if (client->put(iter.key(), Payload(iter.value()), QS3FileMetadata(), QS3::NoCannedAcl, this, SEED_TAG))
+            seedsPending++;
+    }
+    if (seedsPending == 0)
+        Start();
+}
+
+void QS3Replay::Start()
+{
+    qDebug() << "[QS3Replay]: Replaying" << requests.size() << "requests" << (fast ? QString("as fast as possible, concurrency %1").arg(maxInflight).toStdString().c_str() : "at recorded times");
+    clock.start();
+    IssueNext();
+}
+
+void QS3Replay::OnTimer()
+{
+    IssueNext();
+}
+
+void QS3Replay::IssueNext()
+{
+    if (fast)
+    {
+        // Requests that complete immediately do not recurse back here.
+        if (issuing)
+            return;
+        issuing = true;
+        while (next < requests.size() && outstanding < maxInflight)
+            Issue(next++);
+        issuing = false;
+        return;
+    }
+
+    // Everything that is due, then wait for the next one.
+    const qint64 now = Now();
+    while (next < requests.size() && requests[next].scheduled <= now)
+        Issue(next++);
+    if (next < requests.size())
+        timer->start((int)qMax<qint64>(0, (requests[next].scheduled - now) / 1000));
+}
+
+void QS3Replay::Issue(int index)
+{
+    const QS3RecordedRequest &request = requests[index];
+    issued[index] = Now();
+    outstanding++;
+
+    QS3RequestId id = 0;
+    switch (request.type)
+    {
+        case QS3::ListObjects:
+        {
+            QS3ListObjectsResponse *response = client->listObjectsPage(request.key, "");
+            if (response)
+            {
+                lists[response] = index;
+                return;
+            }
+            break;
+        }
+        case QS3::GetObject:
+            if (request.rangeOffset > 0 || request.rangeLength >= 0)
+                id = client->get(request.key, request.rangeOffset, request.rangeLength, this, index);
+            else
+                id = client->get(request.key, this, index);
+            break;
+        case QS3::PutObject:
+        case QS3::UploadPart:
+            // Parts are put as whole objects of the same size, the upload itself is not replayed.
+            id = client->put(request.key, Payload(request.bytesSent), QS3FileMetadata(), QS3::NoCannedAcl, this, index);
+            break;
+        case QS3::RemoveObject:
+            id = client->remove(request.key, this, index);
+            break;
+        case QS3::CopyObject:
+            id = client->copy(request.key, request.key + ".replay", QS3::NoCannedAcl, this, index);
+            break;
+        case QS3::GetAcl:
+            id = client->getAcl(request.key, this, index);
+            break;
+        case QS3::SetAcl:
+            id = client->setCannedAcl(request.key, QS3::Private, this, index);
+            break;
+        default:
+            // Multipart bookkeeping requests need a live upload id.
+            skipped++;
+            Complete(index, true, -1);
+            return;
+    }
+    if (!id)
+        Complete(index, false, 0);
+}
+
+void QS3Replay::handleResult(const QS3Result &result)
+{
+    if (result.tag == SEED_TAG)
+    {
+        if (!result.succeeded)
+            qDebug() << "[QS3Replay] Error: Seeding" << result.key << "failed:" << result.error.toString();
+        if (--seedsPending == 0)
+            Start();
+        return;
+    }
+
+    const int index = (int)result.tag;
+    Complete(index, result.succeeded, requests[index].bytesSent + result.data.size());
+}
+
+void QS3Replay::OnListObjectsRespose(QS3ListObjectsResponse *response)
+{
+    if (!lists.contains(response))
+        return;
+    Complete(lists.take(response), response->succeeded, 0);
+}
+
+void QS3Replay::Complete(int index, bool succeeded, qint64 transferred)
+{
+    outstanding--;
+    completed++;
+    if (transferred >= 0)
+    {
+        latencies[requests[index].type] << (Now() - issued[index]);
+        bytes += transferred;
+    }
+    if (!succeeded)
+        failed++;
+
+    if (completed == requests.size())
+        Report();
+    else if (fast)
+        IssueNext();
+}
+
+void QS3Replay::Report()
+{
+    const double secs = qMax<qint64>(1, Now()) / 1000000.0;
+    const double recordedSecs = qMax<qint64>(1, requests.last().scheduled + requests.last().duration) / 1000000.0;
+
+    qDebug() << "[QS3Replay]: Requests   :" << requests.size() << "failed" << failed << "skipped" << skipped;
+    qDebug() << "[QS3Replay]: Time       :" << secs << "s, recorded" << recordedSecs << "s";
+    qDebug() << "[QS3Replay]: Throughput :" << requests.size() / secs << "req/s" << bytes / secs / (1024.0 * 1024.0) << "MB/s";
+
+    // Replayed against recorded latency, in milliseconds.
+    QMap<int, QVector<qint64> > recorded;
+    foreach(const QS3RecordedRequest &request, requests)
+        recorded[request.type] << request.duration;
+    for (QMap<int, QVector<qint64> >::iterator iter = latencies.begin(); iter != latencies.end(); ++iter)
+    {
+        QVector<qint64> &replayed = iter.value();
+        QVector<qint64> &original = recorded[iter.key()];
+        qSort(replayed);
+        qSort(original);
+        qDebug() << "[QS3Replay]:" << RequestTypeName(iter.key()) << replayed.size()
+                 << "p50" << Percentile(replayed, 0.5) << "p90" << Percentile(replayed, 0.9) << "p99" << Percentile(replayed, 0.99)
+                 << "ms, recorded p50" << Percentile(original, 0.5) << "p90" << Percentile(original, 0.9) << "p99" << Percentile(original, 0.99) << "ms";
+    }
+
+    QCoreApplication::quit();
+}
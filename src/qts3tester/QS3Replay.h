@@ -0,0 +1,70 @@
+
+#pragma once
+
+#include "QS3Fwd.h"
+#include "QS3Defines.h"
+#include "QS3Recording.h"
+
+#include <QObject>
+#include <QStringList>
+#include <QList>
+#include <QHash>
+#include <QMap>
+#include <QVector>
+#include <QElapsedTimer>
+
+/// Drives a recorded workload against a bucket and reports throughput and latency.
+/** Requests are issued at their recorded times, or as fast as possible with
+    at most the recorded peak concurrency. Point the client at a local S3
+    stand-in with --host and create the objects the workload reads with --seed. */
+class QS3Replay : public QObject, public QS3ResultHandler
+{
+Q_OBJECT
+
+public:
+    QS3Replay(const QStringList &params);
+    ~QS3Replay();
+
+    void handleResult(const QS3Result &result);
+
+private slots:
+    void OnListObjectsRespose(QS3ListObjectsResponse *response);
+    void OnTimer();
+
+private:
+    void Seed();
+    void Start();
+    void IssueNext();
+    void Issue(int index);
+    void Complete(int index, bool succeeded, qint64 bytes);
+    void Report();
+
+    /// Returns size bytes of payload without copying.
+    QByteArray Payload(qint64 size) const;
+
+    qint64 Now() const;
+
+    QS3Client *client;
+    QList<QS3RecordedRequest> requests;
+    QByteArray payload;
+
+    bool fast;
+    int seedsPending;
+    int maxInflight;
+    bool issuing;
+
+    int next;
+    int outstanding;
+    int completed;
+    int failed;
+    int skipped;
+    qint64 bytes;
+
+    QElapsedTimer clock;
+    QTimer *timer;
+    QVector<qint64> issued;
+    QHash<QS3ListObjectsResponse*, int> lists;
+
+    /// Replayed latencies by request type.
+    QMap<int, QVector<qint64> > latencies;
+};
@@ -1,17 +1,20 @@
 
 #include "QS3Tester.h"
+#include "QS3Replay.h"
 #include "QS3Client.h"
 
 #include <QCoreApplication>
 #include <QDebug>
 #include <QStringList>
 #include <QFile>
+#include <QDateTime>
 
 QS3Tester::QS3Tester(const QStringList &params)
 {
     if (params.size() < 3)
     {
         qDebug() << "Usage: qts3tester <accessKey> <secretKey> <bucketName> [prefix]";
+        qDebug() << "       qts3tester replay <accessKey> <secretKey> <bucketName> <recording> [options]";
         return; 
     }
     
@@ -48,6 +51,9 @@ QS3Tester::QS3Tester(const QStringList &params)
      
     // Remove object
     //client->remove("avatars/remove.file");
+
+    // Pre-signed url
+    //qDebug() << client->presign("GET", "avatars/aaaa.testfile", QDateTime::currentDateTime().addSecs(3600));
 }
 
 QS3Tester::~QS3Tester()
@@ -160,6 +166,11 @@ int main(int argc, char **argv)
         params << argv[i];
 
     QCoreApplication app(argc, argv);
+    if (!params.isEmpty() && params[0] == "replay")
+    {
+        QS3Replay replay(params.mid(1));
+        return app.exec();
+    }
     QS3Tester tester(params);
     return app.exec();
 }